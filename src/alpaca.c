@@ -0,0 +1,935 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* Ref: ASCOM Alpaca API, https://ascom-standards.org/api/
+ *
+ * Only device type "telescope", device number 0 is served.  Requests are
+ * HTTP/1.1 with keep-alive; GET parameters are in the query string and PUT
+ * parameters in an application/x-www-form-urlencoded body.  Parameter
+ * names are case insensitive.  UDP discovery (port 32227) is not
+ * implemented, so clients must be pointed at this port directly.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <ev.h>
+
+#include "log.h"
+#include "xzmalloc.h"
+#include "point.h"
+#include "slew.h"
+
+#include "alpaca.h"
+
+#define LISTEN_BACKLOG 5
+#define MAX_CLIENTS 16
+#define MAX_BUF 4096
+#define MAX_VALUE 64
+
+#define DEVICE_PREFIX "/api/v1/telescope/0/"
+
+/* Alpaca error numbers
+ */
+enum {
+    ERR_NOT_IMPLEMENTED = 0x400,
+    ERR_INVALID_VALUE = 0x401,
+    ERR_VALUE_NOT_SET = 0x402,
+    ERR_INVALID_OPERATION = 0x40B,
+    ERR_UNSPECIFIED = 0x4FF,
+};
+
+enum {
+    GUIDE_NORTH = 0,
+    GUIDE_SOUTH = 1,
+    GUIDE_EAST = 2,
+    GUIDE_WEST = 3,
+};
+
+static const double position_maxage = 0.25; // cached RA/DEC (sec)
+static const int max_pulse_ms = 60000;
+
+struct request {
+    char method[8];
+    char path[128];
+    char params[MAX_BUF];   // query string and form body joined with '&'
+    bool keepalive;
+    int error;              // HTTP status to reject the request with, 0 = ok
+};
+
+struct client {
+    int fd;
+    ev_io w;
+    char buf[MAX_BUF];
+    int len;
+    struct alpaca *al;
+    int num;
+};
+
+struct callback {
+    alpaca_cb_f cb;
+    void *arg;
+};
+
+struct alpaca {
+    int flags;
+    int fd;
+    struct callback pos;
+    struct callback status;
+    struct callback guide;
+    struct callback gto;
+    struct callback stop;
+    struct callback tracking;
+    ev_io listen_w;
+    ev_timer guide_w[2];    // [0] = DEC (N/S), [1] = RA (E/W)
+    struct client clients[MAX_CLIENTS];
+    double t, d;            // axis angular position (degrees)
+    double ra, dec;         // cached corrected position (degrees)
+    double pos_time;        // time of cached position, 0 = invalid
+    bool pos_valid;         // t,d refreshed by the position callback
+    double target_ra, target_dec;
+    bool target_isset;
+    const char *goto_error; // reason goto callback refused the target
+    bool slewing;
+    bool tracking_enabled;
+    int guide_mask;
+    unsigned int transaction;
+    struct point *point;
+    struct ev_loop *loop;
+};
+
+static void client_free (struct client *c);
+
+static int write_all (struct client *c, const char *buf, int len)
+{
+    int n, done = 0;
+
+    while (done < len) {
+        n = write (c->fd, buf + done, len - done);
+        if (n < 0)
+            return -1;
+        done += n;
+    }
+    return len;
+}
+
+static const char *status_text (int status)
+{
+    switch (status) {
+        case 200:
+            return "OK";
+        case 400:
+            return "Bad Request";
+        case 404:
+            return "Not Found";
+        case 413:
+            return "Payload Too Large";
+        case 414:
+            return "URI Too Long";
+        default:
+            return "Internal Server Error";
+    }
+}
+
+static int respond (struct client *c, struct request *r, int status,
+                    const char *ctype, const char *body)
+{
+    char *s;
+    int rc;
+
+    if ((c->al->flags & ALPACA_DEBUG))
+        msg ("client[%d]: < %d %s", c->num, status, body);
+
+    s = xasprintf ("HTTP/1.1 %d %s\r\n"
+                   "Content-Type: %s\r\n"
+                   "Content-Length: %zu\r\n"
+                   "Connection: %s\r\n"
+                   "\r\n"
+                   "%s", status, status_text (status), ctype, strlen (body),
+                   r->keepalive ? "keep-alive" : "close", body);
+    rc = write_all (c, s, strlen (s));
+    free (s);
+    return rc;
+}
+
+static void url_decode (char *dst, const char *src, int srclen, int len)
+{
+    int i, n = 0;
+
+    for (i = 0; i < srclen && n < len - 1; i++) {
+        if (src[i] == '+')
+            dst[n++] = ' ';
+        else if (src[i] == '%' && i + 2 < srclen && isxdigit (src[i + 1])
+                                                 && isxdigit (src[i + 2])) {
+            char hex[3] = { src[i + 1], src[i + 2], '\0' };
+            dst[n++] = strtoul (hex, NULL, 16);
+            i += 2;
+        }
+        else
+            dst[n++] = src[i];
+    }
+    dst[n] = '\0';
+}
+
+/* Look up parameter 'name' (case insensitive) and URL-decode its value.
+ */
+static bool get_param (struct request *r, const char *name,
+                       char *val, int len)
+{
+    const char *p = r->params;
+    int nlen = strlen (name);
+
+    while (*p) {
+        const char *end = strchr (p, '&');
+        const char *eq = strchr (p, '=');
+        if (!end)
+            end = p + strlen (p);
+        if (eq && eq < end && eq - p == nlen && !strncasecmp (p, name, nlen)) {
+            url_decode (val, eq + 1, end - eq - 1, len);
+            return true;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return false;
+}
+
+static bool get_param_double (struct request *r, const char *name,
+                              double *val)
+{
+    char s[MAX_VALUE];
+    char *endptr;
+
+    if (!get_param (r, name, s, sizeof (s)))
+        return false;
+    *val = strtod (s, &endptr);
+    return (endptr != s && *endptr == '\0');
+}
+
+static bool get_param_int (struct request *r, const char *name, int *val)
+{
+    char s[MAX_VALUE];
+    char *endptr;
+
+    if (!get_param (r, name, s, sizeof (s)))
+        return false;
+    *val = strtol (s, &endptr, 10);
+    return (endptr != s && *endptr == '\0');
+}
+
+static bool get_param_bool (struct request *r, const char *name, bool *val)
+{
+    char s[MAX_VALUE];
+
+    if (!get_param (r, name, s, sizeof (s)))
+        return false;
+    if (!strcasecmp (s, "true"))
+        *val = true;
+    else if (!strcasecmp (s, "false"))
+        *val = false;
+    else
+        return false;
+    return true;
+}
+
+/* Send a standard Alpaca response.  If 'value' is NULL, the Value member
+ * is omitted (method and property PUT responses).
+ */
+static int respond_alpaca (struct client *c, struct request *r,
+                           const char *value, int errnum, const char *errmsg)
+{
+    int client_transaction = 0;
+    char *body;
+    int rc;
+
+    (void)get_param_int (r, "ClientTransactionID", &client_transaction);
+    body = xasprintf ("{%s%s%s\"ClientTransactionID\":%u,"
+                      "\"ServerTransactionID\":%u,"
+                      "\"ErrorNumber\":%d,\"ErrorMessage\":\"%s\"}",
+                      value ? "\"Value\":" : "", value ? value : "",
+                      value ? "," : "", (unsigned int)client_transaction,
+                      ++c->al->transaction, errnum, errmsg ? errmsg : "");
+    rc = respond (c, r, 200, "application/json", body);
+    free (body);
+    return rc;
+}
+
+static int respond_double (struct client *c, struct request *r, double val)
+{
+    char s[MAX_VALUE];
+
+    snprintf (s, sizeof (s), "%.8f", val);
+    return respond_alpaca (c, r, s, 0, NULL);
+}
+
+static int respond_bool (struct client *c, struct request *r, bool val)
+{
+    return respond_alpaca (c, r, val ? "true" : "false", 0, NULL);
+}
+
+static int respond_int (struct client *c, struct request *r, int val)
+{
+    char s[MAX_VALUE];
+
+    snprintf (s, sizeof (s), "%d", val);
+    return respond_alpaca (c, r, s, 0, NULL);
+}
+
+static int respond_string (struct client *c, struct request *r,
+                           const char *val)
+{
+    char *s = xasprintf ("\"%s\"", val);
+    int rc = respond_alpaca (c, r, s, 0, NULL);
+
+    free (s);
+    return rc;
+}
+
+static int respond_error (struct client *c, struct request *r,
+                          int errnum, const char *errmsg)
+{
+    return respond_alpaca (c, r, NULL, errnum, errmsg);
+}
+
+/* Refresh RA/DEC if the cached value is older than position_maxage.
+ * The cache is only updated if the position callback succeeded.
+ * Returns -1 if the position could not be read.
+ */
+static int update_position (struct alpaca *al, bool force)
+{
+    double now = ev_now (al->loop);
+
+    if (!force && al->pos_time > 0 && now - al->pos_time < position_maxage)
+        return 0;
+    al->pos_valid = false;
+    if (al->pos.cb)
+        al->pos.cb (al, al->pos.arg);
+    if (!al->pos_valid)
+        return -1;
+    point_convert_position (al->point, al->t, al->d, &al->ra, &al->dec);
+    al->pos_time = now;
+    return 0;
+}
+
+static void update_status (struct alpaca *al)
+{
+    if (al->status.cb)
+        al->status.cb (al, al->status.arg);
+}
+
+static double site_degrees (int deg, int min, double sec)
+{
+    double val = abs (deg) + min/60. + sec/3600.;
+
+    return deg < 0 ? -val : val;
+}
+
+static void guide_cb (struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct alpaca *al = w->data;
+
+    if (w == &al->guide_w[0])
+        al->guide_mask &= ~(SLEW_DEC_PLUS | SLEW_DEC_MINUS);
+    else
+        al->guide_mask &= ~(SLEW_RA_PLUS | SLEW_RA_MINUS);
+    if ((al->flags & ALPACA_DEBUG))
+        msg ("alpaca guide: 0x%x", al->guide_mask);
+    if (al->guide.cb)
+        al->guide.cb (al, al->guide.arg);
+}
+
+/* Start a guide pulse.  A new pulse on an axis replaces one in progress.
+ */
+static int pulse_guide (struct alpaca *al, int direction, int ms)
+{
+    static const int dirmask[] = {
+        [GUIDE_NORTH] = SLEW_DEC_PLUS, [GUIDE_SOUTH] = SLEW_DEC_MINUS,
+        [GUIDE_EAST] = SLEW_RA_PLUS,   [GUIDE_WEST] = SLEW_RA_MINUS,
+    };
+    int axis = (direction == GUIDE_NORTH || direction == GUIDE_SOUTH) ? 0 : 1;
+
+    if (direction < GUIDE_NORTH || direction > GUIDE_WEST
+                                || ms < 0 || ms > max_pulse_ms) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (axis == 0)
+        al->guide_mask &= ~(SLEW_DEC_PLUS | SLEW_DEC_MINUS);
+    else
+        al->guide_mask &= ~(SLEW_RA_PLUS | SLEW_RA_MINUS);
+    ev_timer_stop (al->loop, &al->guide_w[axis]);
+    if (ms > 0) {
+        al->guide_mask |= dirmask[direction];
+        ev_timer_set (&al->guide_w[axis], ms * 1E-3, 0.);
+        ev_timer_start (al->loop, &al->guide_w[axis]);
+    }
+    if ((al->flags & ALPACA_DEBUG))
+        msg ("alpaca guide: 0x%x", al->guide_mask);
+    if (al->guide.cb)
+        al->guide.cb (al, al->guide.arg);
+    return 0;
+}
+
+static void set_tracking (struct alpaca *al, bool enable)
+{
+    al->tracking_enabled = enable;
+    if (al->tracking.cb)
+        al->tracking.cb (al, al->tracking.arg);
+}
+
+static bool get_coordinates (struct request *r, double *ra, double *dec)
+{
+    return get_param_double (r, "RightAscension", ra)
+        && get_param_double (r, "Declination", dec)
+        && *ra >= 0 && *ra < 24 && *dec >= -90 && *dec <= 90;
+}
+
+static int telescope_get (struct client *c, struct request *r,
+                          const char *name)
+{
+    struct alpaca *al = c->al;
+    int deg, min;
+    double sec;
+
+    if (!strcmp (name, "rightascension")) {
+        if (update_position (al, false) < 0)
+            return respond_error (c, r, ERR_UNSPECIFIED, "position unknown");
+        return respond_double (c, r, al->ra / 15.);
+    }
+    else if (!strcmp (name, "declination")) {
+        if (update_position (al, false) < 0)
+            return respond_error (c, r, ERR_UNSPECIFIED, "position unknown");
+        return respond_double (c, r, al->dec);
+    }
+    else if (!strcmp (name, "tracking")) {
+        update_status (al);
+        return respond_bool (c, r, al->tracking_enabled);
+    }
+    else if (!strcmp (name, "slewing")) {
+        update_status (al);
+        return respond_bool (c, r, al->slewing);
+    }
+    else if (!strcmp (name, "ispulseguiding"))
+        return respond_bool (c, r, al->guide_mask != 0);
+    else if (!strcmp (name, "targetrightascension")) {
+        if (!al->target_isset)
+            return respond_error (c, r, ERR_VALUE_NOT_SET, "target not set");
+        return respond_double (c, r, al->target_ra);
+    }
+    else if (!strcmp (name, "targetdeclination")) {
+        if (!al->target_isset)
+            return respond_error (c, r, ERR_VALUE_NOT_SET, "target not set");
+        return respond_double (c, r, al->target_dec);
+    }
+    else if (!strcmp (name, "sitelatitude")) {
+        point_get_latitude (al->point, &deg, &min, &sec);
+        return respond_double (c, r, site_degrees (deg, min, sec));
+    }
+    else if (!strcmp (name, "sitelongitude")) {
+        point_get_longitude (al->point, &deg, &min, &sec);
+        return respond_double (c, r, site_degrees (deg, min, sec));
+    }
+    else if (!strcmp (name, "connected")
+            || !strcmp (name, "canslew")
+            || !strcmp (name, "canslewasync")
+            || !strcmp (name, "cansync")
+            || !strcmp (name, "canpulseguide")
+            || !strcmp (name, "cansettracking"))
+        return respond_bool (c, r, true);
+    else if (!strcmp (name, "atpark")
+            || !strcmp (name, "athome")
+            || !strcmp (name, "canpark")
+            || !strcmp (name, "canunpark")
+            || !strcmp (name, "canfindhome")
+            || !strcmp (name, "cansetpark")
+            || !strcmp (name, "canslewaltaz")
+            || !strcmp (name, "canslewaltazasync")
+            || !strcmp (name, "cansyncaltaz")
+            || !strcmp (name, "cansetguiderates")
+            || !strcmp (name, "cansetpierside")
+            || !strcmp (name, "cansetrightascensionrate")
+            || !strcmp (name, "cansetdeclinationrate")
+            || !strcmp (name, "doesrefraction"))
+        return respond_bool (c, r, false);
+    else if (!strcmp (name, "canmoveaxis"))
+        return respond_bool (c, r, false);
+    else if (!strcmp (name, "alignmentmode"))
+        return respond_int (c, r, 2); // algGermanPolar
+    else if (!strcmp (name, "equatorialsystem"))
+        return respond_int (c, r, point_get_epoch (al->point)
+                                  == POINT_EPOCH_JNOW ? 1 : 2);
+    else if (!strcmp (name, "trackingrate"))
+        return respond_int (c, r, 0); // driveSidereal
+    else if (!strcmp (name, "trackingrates"))
+        return respond_alpaca (c, r, "[0]", 0, NULL);
+    else if (!strcmp (name, "interfaceversion"))
+        return respond_int (c, r, 3);
+    else if (!strcmp (name, "name"))
+        return respond_string (c, r, "gem-controld");
+    else if (!strcmp (name, "description"))
+        return respond_string (c, r, "German equatorial mount");
+    else if (!strcmp (name, "driverinfo"))
+        return respond_string (c, r, "gem-controld Alpaca telescope");
+    else if (!strcmp (name, "driverversion"))
+        return respond_string (c, r, "1.0");
+    else if (!strcmp (name, "supportedactions"))
+        return respond_alpaca (c, r, "[]", 0, NULL);
+    return respond_error (c, r, ERR_NOT_IMPLEMENTED, "not implemented");
+}
+
+static int telescope_put (struct client *c, struct request *r,
+                          const char *name)
+{
+    struct alpaca *al = c->al;
+    double ra, dec;
+    bool enable;
+    int direction, duration;
+
+    if (!strcmp (name, "slewtocoordinatesasync")
+            || !strcmp (name, "slewtocoordinates")) {
+        if (!get_coordinates (r, &ra, &dec))
+            return respond_error (c, r, ERR_INVALID_VALUE, "bad coordinates");
+        al->target_ra = ra;
+        al->target_dec = dec;
+        al->target_isset = true;
+        point_set_target (al->point, ra * 15., dec);
+        al->goto_error = NULL;
+        if (al->gto.cb)
+            al->gto.cb (al, al->gto.arg);
+        al->pos_time = 0;
+        if (al->goto_error)
+            return respond_error (c, r, ERR_INVALID_OPERATION,
+                                  al->goto_error);
+    }
+    else if (!strcmp (name, "synctocoordinates")) {
+        if (!get_coordinates (r, &ra, &dec))
+            return respond_error (c, r, ERR_INVALID_VALUE, "bad coordinates");
+        al->target_ra = ra;
+        al->target_dec = dec;
+        al->target_isset = true;
+        point_set_target (al->point, ra * 15., dec);
+        if (update_position (al, true) < 0)
+            return respond_error (c, r, ERR_UNSPECIFIED, "position unknown");
+        point_set_position_ha (al->point, al->t);
+        point_set_position_dec (al->point, al->d);
+        point_sync_target (al->point);
+        al->pos_time = 0;
+    }
+    else if (!strcmp (name, "tracking")) {
+        if (!get_param_bool (r, "Tracking", &enable))
+            return respond_error (c, r, ERR_INVALID_VALUE, "bad Tracking");
+        set_tracking (al, enable);
+    }
+    else if (!strcmp (name, "pulseguide")) {
+        if (!get_param_int (r, "Direction", &direction)
+                || !get_param_int (r, "Duration", &duration)
+                || pulse_guide (al, direction, duration) < 0)
+            return respond_error (c, r, ERR_INVALID_VALUE, "bad pulse");
+    }
+    else if (!strcmp (name, "abortslew")) {
+        if (al->stop.cb)
+            al->stop.cb (al, al->stop.arg);
+    }
+    else if (!strcmp (name, "connected")) {
+        if (!get_param_bool (r, "Connected", &enable))
+            return respond_error (c, r, ERR_INVALID_VALUE, "bad Connected");
+    }
+    else
+        return respond_error (c, r, ERR_NOT_IMPLEMENTED, "not implemented");
+    return respond_alpaca (c, r, NULL, 0, NULL);
+}
+
+static int management_get (struct client *c, struct request *r,
+                           const char *path)
+{
+    if (!strcmp (path, "/management/apiversions"))
+        return respond_alpaca (c, r, "[1]", 0, NULL);
+    else if (!strcmp (path, "/management/v1/description"))
+        return respond_alpaca (c, r, "{\"ServerName\":\"gem-controld\","
+                               "\"Manufacturer\":\"gem-controld\","
+                               "\"ManufacturerVersion\":\"1.0\","
+                               "\"Location\":\"\"}", 0, NULL);
+    else if (!strcmp (path, "/management/v1/configureddevices"))
+        return respond_alpaca (c, r, "[{\"DeviceName\":\"gem-controld\","
+                               "\"DeviceType\":\"Telescope\","
+                               "\"DeviceNumber\":0,"
+                               "\"UniqueID\":\"gem-controld-telescope-0\"}]",
+                               0, NULL);
+    return respond (c, r, 404, "text/plain", "not found");
+}
+
+static int process_request (struct client *c, struct request *r)
+{
+    const char *name;
+    char *p;
+
+    if ((c->al->flags & ALPACA_DEBUG))
+        msg ("client[%d]: > %s %s %s", c->num, r->method, r->path, r->params);
+
+    for (p = r->path; *p; p++)
+        *p = tolower (*p);
+    if (!strncmp (r->path, DEVICE_PREFIX, strlen (DEVICE_PREFIX))) {
+        name = r->path + strlen (DEVICE_PREFIX);
+        if (!strcmp (r->method, "GET"))
+            return telescope_get (c, r, name);
+        else if (!strcmp (r->method, "PUT"))
+            return telescope_put (c, r, name);
+    }
+    else if (!strncmp (r->path, "/management/", 12)) {
+        if (!strcmp (r->method, "GET"))
+            return management_get (c, r, r->path);
+    }
+    else
+        return respond (c, r, 404, "text/plain", "not found");
+    return respond (c, r, 400, "text/plain", "unsupported method");
+}
+
+/* Parse one HTTP request from the client buffer.
+ * Return the number of bytes consumed, 0 if incomplete, -1 if malformed.
+ * A complete request whose path or parameters don't fit is consumed
+ * with r->error set.
+ */
+static int parse_request (struct client *c, struct request *r)
+{
+    char hdr[MAX_BUF];
+    char *hdr_end, *line, *eol, *query;
+    char version[16];
+    int hdr_len, body_len = 0;
+    char target[sizeof (r->path) + sizeof (r->params)];
+
+    if (!(hdr_end = memmem (c->buf, c->len, "\r\n\r\n", 4)))
+        return 0;
+    hdr_len = hdr_end + 4 - c->buf;
+    snprintf (hdr, sizeof (hdr), "%.*s", hdr_len - 2, c->buf);
+
+    memset (r, 0, sizeof (*r));
+    if (sscanf (hdr, "%7s %2047s %15s", r->method, target, version) != 3)
+        return -1;
+    r->keepalive = !strcmp (version, "HTTP/1.1");
+
+    line = strstr (hdr, "\r\n");
+    while (line && *line) {
+        line += 2;
+        if ((eol = strstr (line, "\r\n")))
+            *eol = '\0';
+        if (!strncasecmp (line, "Content-Length:", 15))
+            body_len = strtoul (line + 15, NULL, 10);
+        else if (!strncasecmp (line, "Connection:", 11)) {
+            const char *val = line + 11;
+            while (isspace (*val))
+                val++;
+            if (!strcasecmp (val, "close"))
+                r->keepalive = false;
+            else if (!strcasecmp (val, "keep-alive"))
+                r->keepalive = true;
+        }
+        line = eol;
+    }
+    if (body_len < 0 || hdr_len + body_len > sizeof (c->buf) - 1)
+        return -1;
+    if (c->len < hdr_len + body_len)
+        return 0;
+
+    if ((query = strchr (target, '?')))
+        *query++ = '\0';
+    if (strlen (target) >= sizeof (r->path)) {
+        r->error = 414;
+        return hdr_len + body_len;
+    }
+    strcpy (r->path, target);
+    if (query) {
+        int len = strlen (query);
+        if (len + 1 + body_len >= sizeof (r->params)) {
+            r->error = 413;
+            return hdr_len + body_len;
+        }
+        memcpy (r->params, query, len);
+        if (body_len > 0)
+            r->params[len++] = '&';
+        memcpy (r->params + len, c->buf + hdr_len, body_len);
+    }
+    else {
+        if (body_len >= sizeof (r->params)) {
+            r->error = 413;
+            return hdr_len + body_len;
+        }
+        memcpy (r->params, c->buf + hdr_len, body_len);
+    }
+    return hdr_len + body_len;
+}
+
+static void client_cb (struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct client *c = (struct client *)((char *)w
+                        - offsetof (struct client, w));
+    struct request r;
+    int n;
+
+    n = read (c->fd, c->buf + c->len, sizeof (c->buf) - c->len - 1);
+    if (n < 0) {
+        if (errno == EWOULDBLOCK || errno == EAGAIN)
+            goto out;
+        goto disconnect;
+    }
+    if (n == 0) // EOF
+        goto disconnect;
+    c->len += n;
+    c->buf[c->len] = '\0';
+
+    while ((n = parse_request (c, &r)) > 0) {
+        if (r.error) {
+            r.keepalive = false;
+            (void)respond (c, &r, r.error, "text/plain", "request too large");
+            goto disconnect;
+        }
+        if (process_request (c, &r) < 0 || !r.keepalive)
+            goto disconnect;
+        memmove (c->buf, c->buf + n, c->len -= n);
+        c->buf[c->len] = '\0';
+    }
+    if (n < 0 || c->len == sizeof (c->buf) - 1) {
+        if ((c->al->flags & ALPACA_DEBUG))
+            msg ("client[%d]: malformed request", c->num);
+        goto disconnect;
+    }
+out:
+    return;
+disconnect:
+    client_free (c);
+}
+
+static void client_free (struct client *c)
+{
+    if (c->fd != -1) {
+        close (c->fd);
+        c->fd = -1;
+        ev_io_stop (c->al->loop, &c->w);
+    }
+}
+
+static struct client *client_alloc (struct alpaca *al, int fd)
+{
+    int i;
+    struct client *c;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (al->clients[i].fd == -1)
+            break;
+    }
+    if (i == MAX_CLIENTS)
+        return NULL; // no client slot
+    c = &al->clients[i];
+    c->fd = fd;
+    c->len = 0;
+    ev_io_init (&c->w, client_cb, c->fd, EV_READ);
+    ev_io_start (c->al->loop, &c->w);
+    return c;
+}
+
+/* Accept a connection and allocate client slot.
+ */
+static void listen_cb (struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct alpaca *al = (struct alpaca *)((char *)w
+                        - offsetof (struct alpaca, listen_w));
+
+    if ((revents & EV_READ)) {
+        int cfd;
+        struct client *c;
+        if ((cfd = accept4 (al->fd, NULL, NULL, SOCK_CLOEXEC)) < 0)
+            return;
+        if (!(c = client_alloc (al, cfd))) { // too many open connections
+            close (cfd);
+            return;
+        }
+    }
+}
+
+int alpaca_get_guide_direction (struct alpaca *al)
+{
+    return al->guide_mask;
+}
+
+bool alpaca_get_tracking (struct alpaca *al)
+{
+    return al->tracking_enabled;
+}
+
+void alpaca_set_position (struct alpaca *al, double t, double d)
+{
+    al->t = t;
+    al->d = d;
+    al->pos_valid = true;
+}
+
+void alpaca_set_status (struct alpaca *al, bool slewing, bool tracking)
+{
+    al->slewing = slewing;
+    al->tracking_enabled = tracking;
+}
+
+void alpaca_get_target (struct alpaca *al, double *t, double *d)
+{
+    point_get_target (al->point, t, d);
+}
+
+void alpaca_set_position_cb (struct alpaca *al, alpaca_cb_f cb, void *arg)
+{
+    al->pos.cb = cb;
+    al->pos.arg = arg;
+}
+
+void alpaca_set_status_cb (struct alpaca *al, alpaca_cb_f cb, void *arg)
+{
+    al->status.cb = cb;
+    al->status.arg = arg;
+}
+
+void alpaca_set_guide_cb (struct alpaca *al, alpaca_cb_f cb, void *arg)
+{
+    al->guide.cb = cb;
+    al->guide.arg = arg;
+}
+
+void alpaca_set_goto_cb (struct alpaca *al, alpaca_cb_f cb, void *arg)
+{
+    al->gto.cb = cb;
+    al->gto.arg = arg;
+}
+
+void alpaca_set_goto_error (struct alpaca *al, const char *reason)
+{
+    al->goto_error = reason;
+}
+
+void alpaca_set_stop_cb (struct alpaca *al, alpaca_cb_f cb, void *arg)
+{
+    al->stop.cb = cb;
+    al->stop.arg = arg;
+}
+
+void alpaca_set_tracking_cb (struct alpaca *al, alpaca_cb_f cb, void *arg)
+{
+    al->tracking.cb = cb;
+    al->tracking.arg = arg;
+}
+
+int alpaca_init (struct alpaca *al, int port, struct point *point, int flags)
+{
+    struct sockaddr_in addr;
+    int i;
+
+    al->flags = flags;
+    al->point = point;
+
+    al->fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (al->fd < 0)
+        return -1;
+    memset (&addr, 0, sizeof (struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons (port);
+    if (bind (al->fd, (struct sockaddr *)&addr, sizeof (addr)) < 0)
+        return -1;
+    if (listen (al->fd, LISTEN_BACKLOG) < 0)
+        return -1;
+
+    ev_io_init (&al->listen_w, listen_cb, al->fd, EV_READ);
+    for (i = 0; i < 2; i++) {
+        ev_timer_init (&al->guide_w[i], guide_cb, 0., 0.);
+        al->guide_w[i].data = al;
+    }
+
+    if ((al->flags & ALPACA_DEBUG))
+        msg ("listening on port %d", port);
+
+    return 0;
+}
+
+void alpaca_start (struct ev_loop *loop, struct alpaca *al)
+{
+    int i;
+
+    al->loop = loop;
+    ev_io_start (loop, &al->listen_w);
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (al->clients[i].fd != -1)
+            ev_io_start (loop, &al->clients[i].w);
+    }
+}
+
+void alpaca_stop (struct ev_loop *loop, struct alpaca *al)
+{
+    int i;
+
+    ev_io_stop (loop, &al->listen_w);
+    for (i = 0; i < 2; i++)
+        ev_timer_stop (loop, &al->guide_w[i]);
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (al->clients[i].fd != -1)
+            ev_io_stop (loop, &al->clients[i].w);
+    }
+}
+
+struct alpaca *alpaca_new (void)
+{
+    struct alpaca *al = xzmalloc (sizeof (*al));
+    int i;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        al->clients[i].fd = -1;
+        al->clients[i].al = al;
+        al->clients[i].num = i;
+    }
+    al->fd = -1;
+
+    return al;
+}
+
+void alpaca_destroy (struct alpaca *al)
+{
+    int i;
+
+    if (al) {
+        for (i = 0; i < MAX_CLIENTS; i++)
+            client_free (&al->clients[i]);
+        if (al->fd != -1)
+            close (al->fd);
+        free (al);
+    }
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,82 @@
+#include <ev.h>
+#include <stdbool.h>
+
+#define DEFAULT_ALPACA_PORT  11111
+
+enum {
+    ALPACA_DEBUG = 1,
+};
+
+/* Implement the ASCOM Alpaca Telescope REST API (device 0) over HTTP/1.1.
+ * Clients poll aggressively, so position is answered from a short-lived
+ * cache rather than querying the mount for every request.
+ */
+
+struct alpaca;
+struct point;
+typedef void (*alpaca_cb_f)(struct alpaca *al, void *arg);
+
+struct alpaca *alpaca_new (void);
+void alpaca_destroy (struct alpaca *al);
+
+/* The pointing model 'point' is shared with the caller and other protocols.
+ */
+int alpaca_init (struct alpaca *al, int port, struct point *point, int flags);
+
+/* Register callback that is triggered when the cached position is stale.
+ * Callback should call alpaca_set_position().
+ */
+void alpaca_set_position_cb (struct alpaca *al, alpaca_cb_f cb, void *arg);
+
+/* Register callback that is triggered when the protocol needs
+ * a status update.  Callback should call alpaca_set_status().
+ */
+void alpaca_set_status_cb (struct alpaca *al, alpaca_cb_f cb, void *arg);
+
+/* Register callback that is triggered when a guide pulse starts or ends.
+ * Callback should call alpaca_get_guide_direction() and move at guide rate.
+ */
+void alpaca_set_guide_cb (struct alpaca *al, alpaca_cb_f cb, void *arg);
+
+/* Register callback that is triggered when protocol wants to goto
+ * the target object.  Callback should call alpaca_get_target ()
+ * and then move to those coordinates.
+ */
+void alpaca_set_goto_cb (struct alpaca *al, alpaca_cb_f cb, void *arg);
+
+/* Called from the goto callback to refuse the target with a short
+ * reason, returned to the client as an InvalidOperation error.
+ * The reason string must remain valid until the callback returns.
+ */
+void alpaca_set_goto_error (struct alpaca *al, const char *reason);
+
+/* Register callback that is triggered when protocol wants to stop all motion.
+ */
+void alpaca_set_stop_cb (struct alpaca *al, alpaca_cb_f cb, void *arg);
+
+/* Register callback that is triggered when protocol turns tracking
+ * on or off.  Callback should call alpaca_get_tracking().
+ */
+void alpaca_set_tracking_cb (struct alpaca *al, alpaca_cb_f cb, void *arg);
+
+/* Set t,d position in degrees.
+ */
+void alpaca_set_position (struct alpaca *al, double t, double d);
+
+/* Set slewing (including goto) and RA tracking status.
+ */
+void alpaca_set_status (struct alpaca *al, bool slewing, bool tracking);
+
+/* Get mask of guide directions (slew.h) with a pulse in progress.
+ */
+int alpaca_get_guide_direction (struct alpaca *al);
+bool alpaca_get_tracking (struct alpaca *al);
+
+void alpaca_get_target (struct alpaca *al, double *t, double *d);
+
+void alpaca_start (struct ev_loop *loop, struct alpaca *al);
+void alpaca_stop (struct ev_loop *loop, struct alpaca *al);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,198 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* Compare the cost and agreement of point_batch_convert(), which converts
+ * an array of catalog positions in one pass, against converting each one
+ * with point_set_target_j2000() and point_get_target().  Positions are
+ * random J2000 coordinates; the site is left at the default.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "log.h"
+#include "xzmalloc.h"
+#include "point.h"
+
+#define OPTIONS "+n:r:h"
+static const struct option longopts[] = {
+    {"count",                required_argument, 0, 'n'},
+    {"runs",                 required_argument, 0, 'r'},
+    {"help",                 no_argument,       0, 'h'},
+    {0, 0, 0, 0},
+};
+
+static void usage (void)
+{
+    fprintf (stderr,
+"Usage: bench-convert [OPTIONS]\n"
+"    -n,--count N        positions per run (default 10000)\n"
+"    -r,--runs N         timing runs (default 10)\n"
+);
+    exit (1);
+}
+
+static double monotime (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+/* Return average cost of converting one position with the scalar path,
+ * in nanoseconds, leaving results in (t,d).
+ */
+static double time_scalar (struct point *p, int n, int runs,
+                           const double *ra, const double *dec,
+                           double *t, double *d)
+{
+    double t0;
+    int i, r;
+
+    t0 = monotime ();
+    for (r = 0; r < runs; r++) {
+        for (i = 0; i < n; i++) {
+            point_set_target_j2000 (p, ra[i], dec[i]);
+            point_get_target (p, &t[i], &d[i]);
+        }
+    }
+    return (monotime () - t0) * 1E9 / ((double)n * runs);
+}
+
+/* Return average cost of converting one position with the batch path,
+ * in nanoseconds, leaving results in (t,d).
+ */
+static double time_batch (struct point *p, int n, int runs,
+                          const double *ra, const double *dec,
+                          double *ha, double *hdec, double *t, double *d)
+{
+    double t0;
+    int r;
+
+    t0 = monotime ();
+    for (r = 0; r < runs; r++)
+        point_batch_convert (p, POINT_EPOCH_J2000, n, ra, dec, ha, hdec, t, d);
+    return (monotime () - t0) * 1E9 / ((double)n * runs);
+}
+
+/* Return the worst angular difference between two sets of axis
+ * positions, in arcseconds.
+ */
+static double max_error (int n, const double *t1, const double *d1,
+                         const double *t2, const double *d2)
+{
+    double worst = 0.;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        double dt = fabs (fmod (t1[i] - t2[i], 360.));
+        double dd = fabs (d1[i] - d2[i]);
+        if (dt > 180.)
+            dt = 360. - dt;
+        if (dt > worst)
+            worst = dt;
+        if (dd > worst)
+            worst = dd;
+    }
+    return worst * 3600.;
+}
+
+int main (int argc, char *argv[])
+{
+    int ch;
+    char *prog;
+    int count = 10000;
+    int runs = 10;
+    struct point *p;
+    double *ra, *dec, *ha, *hdec, *t1, *d1, *t2, *d2;
+    double scalar, batch;
+    int i;
+
+    prog = basename (argv[0]);
+    log_init (prog);
+
+    while ((ch = getopt_long (argc, argv, OPTIONS, longopts, NULL)) != -1) {
+        switch (ch) {
+            case 'n':   /* --count N */
+                count = strtoul (optarg, NULL, 10);
+                break;
+            case 'r':   /* --runs N */
+                runs = strtoul (optarg, NULL, 10);
+                break;
+            case 'h':   /* --help */
+            default:
+                usage ();
+        }
+    }
+    if (optind < argc || count <= 0 || runs <= 0)
+        usage ();
+
+    if (!(p = point_new ()))
+        err_exit ("point_new");
+
+    ra = xzmalloc (count * sizeof (double));
+    dec = xzmalloc (count * sizeof (double));
+    ha = xzmalloc (count * sizeof (double));
+    hdec = xzmalloc (count * sizeof (double));
+    t1 = xzmalloc (count * sizeof (double));
+    d1 = xzmalloc (count * sizeof (double));
+    t2 = xzmalloc (count * sizeof (double));
+    d2 = xzmalloc (count * sizeof (double));
+
+    srand48 (time (NULL));
+    for (i = 0; i < count; i++) {
+        ra[i] = drand48 () * 360.;
+        dec[i] = asin (drand48 () * 2. - 1.) * 180. / M_PI;
+    }
+
+    scalar = time_scalar (p, count, runs, ra, dec, t1, d1);
+    batch = time_batch (p, count, runs, ra, dec, ha, hdec, t2, d2);
+
+    msg ("scalar:   %.1f ns/object", scalar);
+    msg ("batch:    %.1f ns/object (%.1fx)", batch, scalar / batch);
+    msg ("max difference over %d objects: %.4f arcsec",
+         count, max_error (count, t1, d1, t2, d2));
+
+    point_destroy (p);
+    free (ra);
+    free (dec);
+    free (ha);
+    free (hdec);
+    free (t1);
+    free (d1);
+    free (t2);
+    free (d2);
+
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
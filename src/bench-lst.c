@@ -0,0 +1,164 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* Compare the cost and accuracy of point_get_lst(), which extrapolates
+ * sidereal time between full calculations, against calling libnova
+ * directly for every query.  Longitude is left at zero so that the
+ * reference is simply the apparent Greenwich sidereal time.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <libnova/libnova.h>
+
+#include "log.h"
+#include "point.h"
+
+#define OPTIONS "+n:i:t:h"
+static const struct option longopts[] = {
+    {"count",                required_argument, 0, 'n'},
+    {"interval",             required_argument, 0, 'i'},
+    {"time",                 required_argument, 0, 't'},
+    {"help",                 no_argument,       0, 'h'},
+    {0, 0, 0, 0},
+};
+
+static void usage (void)
+{
+    fprintf (stderr,
+"Usage: bench-lst [OPTIONS]\n"
+"    -n,--count N        queries per timing run (default 100000)\n"
+"    -i,--interval SEC   full LST calculation interval (default 60)\n"
+"    -t,--time SEC       duration of accuracy run (default 10)\n"
+);
+    exit (1);
+}
+
+static double monotime (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static double reference_lst (void)
+{
+    double gast = ln_get_apparent_sidereal_time (ln_get_julian_from_sys ());
+
+    return fmod (gast, 24.) * 15.;
+}
+
+/* Return average cost of one point_get_lst() call, in nanoseconds.
+ */
+static double time_queries (struct point *p, int count)
+{
+    volatile double sink = 0;
+    double t0;
+    int i;
+
+    (void)point_get_lst (p); // prime the cache
+    t0 = monotime ();
+    for (i = 0; i < count; i++)
+        sink += point_get_lst (p);
+    return (monotime () - t0) * 1E9 / count;
+}
+
+/* Return the worst difference between point_get_lst() and libnova,
+ * in arcseconds, sampled every 10ms over 'seconds'.
+ */
+static double max_error (struct point *p, double seconds)
+{
+    double t0 = monotime ();
+    double worst = 0.;
+
+    while (monotime () - t0 < seconds) {
+        double err = fabs (point_get_lst (p) - reference_lst ());
+        if (err > 180.)
+            err = 360. - err;
+        if (err > worst)
+            worst = err;
+        usleep (10000);
+    }
+    return worst * 3600.;
+}
+
+int main (int argc, char *argv[])
+{
+    int ch;
+    char *prog;
+    int count = 100000;
+    double interval = 60.;
+    double seconds = 10.;
+    struct point *p;
+    double full, cached;
+
+    prog = basename (argv[0]);
+    log_init (prog);
+
+    while ((ch = getopt_long (argc, argv, OPTIONS, longopts, NULL)) != -1) {
+        switch (ch) {
+            case 'n':   /* --count N */
+                count = strtoul (optarg, NULL, 10);
+                break;
+            case 'i':   /* --interval SEC */
+                interval = strtod (optarg, NULL);
+                break;
+            case 't':   /* --time SEC */
+                seconds = strtod (optarg, NULL);
+                break;
+            case 'h':   /* --help */
+            default:
+                usage ();
+        }
+    }
+    if (optind < argc || count <= 0)
+        usage ();
+
+    if (!(p = point_new ()))
+        err_exit ("point_new");
+
+    point_set_lst_interval (p, 0.);
+    full = time_queries (p, count);
+    point_set_lst_interval (p, interval);
+    cached = time_queries (p, count);
+
+    msg ("libnova:  %.1f ns/query", full);
+    msg ("cached:   %.1f ns/query (%.1fx)", cached, full / cached);
+    msg ("max error over %.0fs with %.0fs interval: %.4f arcsec",
+         seconds, interval, max_error (p, seconds));
+
+    point_destroy (p);
+
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,284 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "catalog.h"
+
+#define CATALOG_MAGIC "gemcat1"
+
+#define NBANDS  36      // equal sin(dec) bands
+#define NCELLS  72      // RA cells per band (5 degrees)
+
+struct catalog_header {
+    char magic[8];
+    uint32_t nbands;
+    uint32_t ncells;    // per band
+    uint32_t nstars;
+    uint32_t reserved;
+    // uint32_t start[nbands * ncells + 1], index of each cell's first star
+    // struct catalog_star stars[nstars]
+};
+
+struct catalog {
+    void *map;
+    size_t size;
+    const struct catalog_header *hdr;
+    const uint32_t *start;
+    const struct catalog_star *stars;
+};
+
+static double rad (double deg)
+{
+    return deg * M_PI / 180.;
+}
+
+static int band_index (double dec)
+{
+    int b = (int)floor ((sin (rad (dec)) + 1.) / 2. * NBANDS);
+
+    return b < 0 ? 0 : b >= NBANDS ? NBANDS - 1 : b;
+}
+
+static int ra_index (double ra)
+{
+    double a = fmod (ra, 360.);
+
+    if (a < 0.)
+        a += 360.;
+    return (int)(a / 360. * NCELLS) % NCELLS;
+}
+
+static int cell_index (double ra, double dec)
+{
+    return band_index (dec) * NCELLS + ra_index (ra);
+}
+
+/* Insert star into 'out' (sorted by magnitude, 'n' entries, capacity 'max').
+ * Returns the new count.
+ */
+static int insert_star (struct catalog_star *out, int n, int max,
+                        const struct catalog_star *s)
+{
+    int i;
+
+    if (n == max && s->mag >= out[n - 1].mag)
+        return n;
+    if (n < max)
+        n++;
+    for (i = n - 1; i > 0 && out[i - 1].mag > s->mag; i--)
+        out[i] = out[i - 1];
+    out[i] = *s;
+    return n;
+}
+
+int catalog_query (struct catalog *cat, double lst, double lat,
+                   double ha, double dec, double radius, double min_alt,
+                   struct catalog_star *out, int max)
+{
+    double ra = lst - ha;
+    double cos_radius = cos (rad (radius));
+    double sin_min_alt = sin (rad (min_alt));
+    double slat = sin (rad (lat)), clat = cos (rad (lat));
+    double sd = sin (rad (dec)), cd = cos (rad (dec));
+    double dlo = dec - radius, dhi = dec + radius;
+    double edge, span;
+    int b, n = 0;
+
+    if (max <= 0)
+        return 0;
+
+    /* RA half-width of the search cap, over the whole declination range.
+     */
+    edge = fmax (fabs (fmax (dlo, -90.)), fabs (fmin (dhi, 90.)));
+    if (dlo <= -90. || dhi >= 90. || sin (rad (radius)) >= cos (rad (edge)))
+        span = 180.;
+    else
+        span = asin (sin (rad (radius)) / cos (rad (edge))) * 180. / M_PI;
+
+    for (b = band_index (fmax (dlo, -90.)); b <= band_index (fmin (dhi, 90.));
+                                            b++) {
+        int first = span >= 180. ? 0 : (int)floor ((ra - span) / 360. * NCELLS);
+        int last = span >= 180. ? NCELLS - 1
+                                : (int)floor ((ra + span) / 360. * NCELLS);
+        int c;
+
+        if (last - first >= NCELLS)
+            last = first + NCELLS - 1;
+        for (c = first; c <= last; c++) {
+            int cell = b * NCELLS + ((c % NCELLS) + NCELLS) % NCELLS;
+            uint32_t i;
+
+            for (i = cat->start[cell]; i < cat->start[cell + 1]; i++) {
+                const struct catalog_star *s = &cat->stars[i];
+                double sds, cds, dra, h;
+
+                if (n == max && s->mag >= out[n - 1].mag)
+                    break; // rest of cell is fainter
+                sds = sin (rad (s->dec));
+                cds = cos (rad (s->dec));
+                dra = rad (s->ra - ra);
+                if (sd * sds + cd * cds * cos (dra) <= cos_radius)
+                    continue;
+                h = rad (lst - s->ra);
+                if (slat * sds + clat * cds * cos (h) <= sin_min_alt)
+                    continue;
+                n = insert_star (out, n, max, s);
+            }
+        }
+    }
+    return n;
+}
+
+int catalog_get_count (struct catalog *cat)
+{
+    return cat->hdr->nstars;
+}
+
+struct catalog *catalog_open (const char *path)
+{
+    struct catalog *cat;
+    struct stat sb;
+    size_t ncells = NBANDS * NCELLS;
+    size_t need, c;
+    int fd;
+    int saved_errno;
+
+    if (!(cat = calloc (1, sizeof (*cat))))
+        return NULL;
+    cat->map = MAP_FAILED;
+    if ((fd = open (path, O_RDONLY | O_CLOEXEC)) < 0)
+        goto error;
+    if (fstat (fd, &sb) < 0)
+        goto error_close;
+    if (sb.st_size < sizeof (*cat->hdr)) {
+        errno = EPROTO;
+        goto error_close;
+    }
+    cat->size = sb.st_size;
+    cat->map = mmap (NULL, cat->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (cat->map == MAP_FAILED)
+        goto error_close;
+    close (fd);
+
+    cat->hdr = cat->map;
+    cat->start = (const uint32_t *)(cat->hdr + 1);
+    cat->stars = (const struct catalog_star *)(cat->start + ncells + 1);
+    need = sizeof (*cat->hdr) + (ncells + 1) * sizeof (uint32_t)
+         + (size_t)cat->hdr->nstars * sizeof (struct catalog_star);
+    if (memcmp (cat->hdr->magic, CATALOG_MAGIC, sizeof (cat->hdr->magic))
+            || cat->hdr->nbands != NBANDS || cat->hdr->ncells != NCELLS
+            || cat->size != need
+            || cat->start[ncells] != cat->hdr->nstars) {
+        errno = EPROTO;
+        goto error;
+    }
+    /* catalog_query() trusts each cell's range, so check them all.
+     */
+    for (c = 0; c < ncells; c++) {
+        if (cat->start[c] > cat->start[c + 1]) {
+            errno = EPROTO;
+            goto error;
+        }
+    }
+    return cat;
+error_close:
+    saved_errno = errno;
+    close (fd);
+    errno = saved_errno;
+error:
+    saved_errno = errno;
+    catalog_close (cat);
+    errno = saved_errno;
+    return NULL;
+}
+
+void catalog_close (struct catalog *cat)
+{
+    if (cat) {
+        if (cat->map != MAP_FAILED)
+            munmap (cat->map, cat->size);
+        free (cat);
+    }
+}
+
+static int compare_stars (const void *a, const void *b)
+{
+    const struct catalog_star *s1 = a;
+    const struct catalog_star *s2 = b;
+    int c1 = cell_index (s1->ra, s1->dec);
+    int c2 = cell_index (s2->ra, s2->dec);
+
+    if (c1 != c2)
+        return c1 < c2 ? -1 : 1;
+    if (s1->mag != s2->mag)
+        return s1->mag < s2->mag ? -1 : 1;
+    return 0;
+}
+
+int catalog_write (const char *path, struct catalog_star *stars, int n)
+{
+    struct catalog_header hdr;
+    uint32_t start[NBANDS * NCELLS + 1];
+    FILE *f;
+    int i, c;
+
+    qsort (stars, n, sizeof (*stars), compare_stars);
+    for (c = 0, i = 0; c < NBANDS * NCELLS; c++) {
+        start[c] = i;
+        while (i < n && cell_index (stars[i].ra, stars[i].dec) == c)
+            i++;
+    }
+    start[c] = n;
+
+    memset (&hdr, 0, sizeof (hdr));
+    memcpy (hdr.magic, CATALOG_MAGIC, sizeof (hdr.magic));
+    hdr.nbands = NBANDS;
+    hdr.ncells = NCELLS;
+    hdr.nstars = n;
+
+    if (!(f = fopen (path, "w")))
+        return -1;
+    if (fwrite (&hdr, sizeof (hdr), 1, f) != 1
+            || fwrite (start, sizeof (start), 1, f) != 1
+            || (n > 0 && fwrite (stars, sizeof (*stars), n, f) != n)) {
+        fclose (f);
+        return -1;
+    }
+    return fclose (f);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,49 @@
+/* Binary star catalog
+ *
+ * The file is generated by mkcatalog from an ASCII source and mapped
+ * read-only, so loading costs nothing and pages are shared.  Stars are
+ * bucketed into an equal-area sky grid: declination bands of equal width
+ * in sin(dec), each split into the same number of RA cells.  Within a
+ * cell, stars are sorted brightest first so a query can stop scanning a
+ * cell as soon as its result list is full of brighter stars.
+ *
+ * Catalog positions are J2000.  Queries are by apparent (ha,dec); the
+ * difference (under a degree for decades) is small compared to a search
+ * radius, and callers needing exact positions can convert the results
+ * with point_batch_convert().
+ */
+
+#include <stdint.h>
+
+struct catalog;
+
+struct catalog_star {
+    uint32_t id;        // catalog number from source
+    float ra, dec;      // J2000 (degrees)
+    float mag;          // visual magnitude
+};
+
+/* Map catalog file 'path'.  Returns NULL with errno set on failure.
+ */
+struct catalog *catalog_open (const char *path);
+void catalog_close (struct catalog *cat);
+
+int catalog_get_count (struct catalog *cat);
+
+/* Find up to 'max' stars within 'radius' degrees of (ha,dec), with
+ * altitude above 'min_alt' degrees, for local sidereal time 'lst' and
+ * latitude 'lat' (degrees).  Results are sorted brightest first.
+ * Returns the number of stars placed in 'out'.
+ */
+int catalog_query (struct catalog *cat, double lst, double lat,
+                   double ha, double dec, double radius, double min_alt,
+                   struct catalog_star *out, int max);
+
+/* Write 'n' stars to a new catalog file at 'path' (used by mkcatalog).
+ * The 'stars' array is reordered.  Returns 0 on success, -1 on failure.
+ */
+int catalog_write (const char *path, struct catalog_star *stars, int n);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
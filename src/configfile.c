@@ -25,12 +25,14 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "libini/ini.h"
 
 #include "xzmalloc.h"
 #include "log.h"
 #include "configfile.h"
+#include "point.h"
 
 static int config_cb (void *user, const char *section, const char *name,
                       const char *value);
@@ -73,6 +75,12 @@ static int config_axis (struct config_axis *a, const char *name, const char *val
         a->fast = strtod (value, NULL);
     else if (!strcmp (name, "sidereal"))
         a->sidereal = strtod (value, NULL);
+    else if (!strcmp (name, "backlash"))
+        a->backlash = strtod (value, NULL);
+    else if (!strcmp (name, "approach"))
+        a->approach = strtod (value, NULL);
+    else if (!strcmp (name, "worm"))
+        a->worm = strtoul (value, NULL, 10);
     else if (!strcmp (name, "ihold"))
         a->ihold = strtoul (value, NULL, 10);
     else if (!strcmp (name, "irun"))
@@ -110,6 +118,49 @@ static int config_cb (void *user, const char *section, const char *name,
             opt->guide_gpio = xstrdup (value);
         } else if (!strcmp (name, "debounce"))
             opt->guide_debounce = strtod (value, NULL);
+        else if (!strcmp (name, "stats_file")) {
+            if (opt->guide_stats_file)
+                free (opt->guide_stats_file);
+            opt->guide_stats_file = xstrdup (value);
+        } else if (!strcmp (name, "stats_records"))
+            opt->guide_stats_records = strtoul (value, NULL, 10);
+        else if (!strcmp (name, "drift_interval"))
+            opt->guide_drift_interval = strtod (value, NULL);
+    } else if (!strcmp (section, "envelope")) {
+        if (!strcmp (name, "keepout")) {
+            if (opt->keepout)
+                free (opt->keepout);
+            opt->keepout = xstrdup (value);
+        } else if (!strcmp (name, "lookahead"))
+            opt->envelope_lookahead = strtod (value, NULL);
+    } else if (!strcmp (section, "point")) {
+        if (!strcmp (name, "lst_interval"))
+            opt->lst_interval = strtod (value, NULL);
+        else if (!strcmp (name, "track_interval"))
+            opt->track_interval = strtod (value, NULL);
+        else if (!strcmp (name, "state_file")) {
+            if (opt->state_file)
+                free (opt->state_file);
+            opt->state_file = xstrdup (value);
+        }
+        else if (!strcmp (name, "object_library")) {
+            if (opt->object_library)
+                free (opt->object_library);
+            opt->object_library = xstrdup (value);
+        }
+        else if (!strcmp (name, "horizon")) {
+            if (opt->horizon)
+                free (opt->horizon);
+            opt->horizon = xstrdup (value);
+        }
+        else if (!strcmp (name, "epoch")) {
+            if (!strcasecmp (value, "J2000"))
+                opt->epoch = POINT_EPOCH_J2000;
+            else if (!strcasecmp (value, "JNow"))
+                opt->epoch = POINT_EPOCH_JNOW;
+            else
+                rc = 0;
+        }
     }
     return rc;
 }
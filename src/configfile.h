@@ -16,6 +16,9 @@ struct config_axis {
     double medium;
     double fast;
     double sidereal;
+    double backlash;
+    double approach;
+    int worm;
 };
 
 struct config {
@@ -27,6 +30,17 @@ struct config {
     double hpad_debounce;
     char *guide_gpio;
     double guide_debounce;
+    char *guide_stats_file;
+    int guide_stats_records;
+    double guide_drift_interval;
+    double lst_interval;
+    double track_interval;
+    int epoch;
+    char *state_file;
+    char *object_library;
+    char *horizon;
+    char *keepout;
+    double envelope_lookahead;
 } opt_t;
 
 void configfile_init (const char *filename, struct config *opt);
@@ -25,15 +25,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <libgen.h>
 #include <getopt.h>
 #include <errno.h>
 #include <string.h>
+#include <strings.h>
 #include <pwd.h>
 #include <ev.h>
 #include <math.h>
 #include <assert.h>
+#include <time.h>
 
 #include "log.h"
 #include "xzmalloc.h"
@@ -41,52 +44,226 @@
 #include "configfile.h"
 #include "motion.h"
 #include "slew.h"
-#include "hpad.h"
-#include "guide.h"
+#include "input.h"
+#include "guidestat.h"
 #include "bbox.h"
 #include "lx200.h"
+#include "objlib.h"
+#include "stream.h"
+#include "stellarium.h"
+#include "nexstar.h"
+#include "indi.h"
+#include "alpaca.h"
+#include "point.h"
+#include "envelope.h"
 
 char *prog = "";
 
+/* Axis position extrapolated from the last controller reading and the
+ * commanded constant velocity since, for the envelope monitor.
+ */
+struct estimate {
+    double pos;             // degrees at 'time'
+    double vel;             // commanded velocity (degrees/sec)
+    double time;            // ev_now() of 'pos', 0 = unknown
+    double until;           // ev_now() when a goto arrives, 0 = none
+};
+
+/* Timing of the guide pulse on one axis, for reproducing its
+ * duration (see guide_update()).  Times are CLOCK_MONOTONIC (sec).
+ */
+struct guide_pulse {
+    double edge;            // time of pulse start edge
+    double effect;          // estimated time the correction took effect
+    double hold;            // keep the correction applied until, 0 = none
+};
+
+/* Guide correction on one axis, applied as a velocity offset on top of
+ * the axis base rate.  Times are CLOCK_MONOTONIC (sec).
+ */
+struct guide_offset {
+    double dps;             // current offset (degrees/sec)
+    double since;           // time the current offset took effect
+    double total;           // correction applied so far (degrees)
+};
+
+/* Backlash compensation for one axis.  On a reversal, the axis is
+ * driven at slow rate on top of the requested velocity just long
+ * enough to take up 'backlash' degrees.  A goto with an 'approach'
+ * configured ends with a relative move, so it always arrives from
+ * the same direction.
+ */
+struct backlash {
+    int dir;                // last direction driven: +1, -1, 0 = unknown
+    double dps;             // velocity to resume after take-up
+    double approach;        // final approach move pending (steps), 0 = none
+    ev_timer w;             // take-up timer
+};
+
+/* Tracking on one axis.  The controller runs only at whole velocity
+ * units, and not at all in a gap around zero, which is coarse next to
+ * drift rates (a unit of RA velocity can be a few percent of sidereal).
+ * So each update interval the axis runs at the commandable velocity
+ * above the tracking rate for just long enough to make up the average,
+ * then at the one below.  A high phase too short to command is carried
+ * over, so a slow DEC rate is applied as an occasional short burst.
+ */
+struct track {
+    double dps;             // tracking rate (degrees/sec)
+    double applied;         // velocity commanded by tracking, NAN = none
+    double start;           // ev_now() the current schedule began
+    double rate;            // tracking rate it was made for
+    double hi, lo;          // velocities in the high phase and after
+    double high;            // duration of the high phase (sec)
+    double owed;            // motion carried over (degrees)
+    ev_timer w;             // end of the high phase
+};
+
+/* DEC guide correction accumulated since 'start' while tracking
+ * undisturbed, to observe the drift due to polar misalignment.
+ * Times are CLOCK_MONOTONIC (sec).
+ */
+struct drift {
+    double start;           // 0 = not started
+    double last;            // time 'tracked' was last advanced
+    double tracked;         // DEC tracking motion since start (degrees)
+    double guided;          // DEC guide total at start (degrees)
+    unsigned long pulses;   // DEC guide pulses at start
+    double t, d;            // axis position at start (degrees)
+};
+
 struct prog_context {
     struct config opt;
-    struct hpad *hpad;
-    struct guide *guide;
+    struct input *input;
     struct bbox *bbox;
     struct lx200 *lx200;
+    struct objlib *objlib;
+    struct stream *stream;
+    struct stellarium *stellarium;
+    struct nexstar *nexstar;
+    struct indi *indi;
+    struct alpaca *alpaca;
+    struct point *point;
     struct motion *t;
     struct motion *d;
     struct ev_loop *loop;
     bool t_tracking;
     int slew;
     bool west;
+    bool t_goto, d_goto;    // goto in progress
+    double t_pos, d_pos;    // cached axis positions (degrees)
+    double pos_time;        // time of cached positions, 0 = invalid
+    struct envelope *envelope;
+    ev_timer envelope_w;
+    struct estimate t_est, d_est;
+    int guide_port;         // guide port directions
+    int guide_lx200;        // lx200 pulse guide directions
+    int guide_alpaca;       // alpaca pulse guide directions
+    int guide_mask;         // union of the above
+    int guide_applied;      // guide directions applied to motion
+    struct guide_pulse guide_pulse[2]; // t, d
+    struct guide_offset guide_offset[2]; // t, d
+    struct guidestat *guidestat;
+    bool guide_debug;
+    double guide_rtt;       // smoothed guide command round trip (sec)
+    ev_timer guide_w;
+    struct backlash t_backlash, d_backlash;
+    bool motion_debug;
+    struct track track[2];  // t, d
+    ev_timer track_w;
+    struct drift drift;
 };
 
+/* Positions read from the motion controllers are shared by all protocol
+ * clients for this long (sec), so polling clients don't multiply serial
+ * traffic.
+ */
+static const double position_maxage = 0.05;
+
+/* The mechanical envelope is checked this often (sec), and this far
+ * ahead (sec) unless configured otherwise.
+ */
+static const double envelope_period = 0.1;
+static const double default_envelope_lookahead = 2.;
+
+/* Guide corrections are binned at this interval (sec) for the spectrum,
+ * which then spans GUIDESTAT_SAMPLES bins (about 8.5 min, two RA worm
+ * periods).  The ring file keeps this many pulses unless configured.
+ */
+static const double guidestat_interval = 2.;
+static const int default_guidestat_records = 65536;
+
+/* Tracking rates are recomputed from the pointing model this often (sec)
+ * unless configured otherwise, costing a position query and at most two
+ * velocity commands per axis.  A dither phase shorter than
+ * track_min_phase (sec) is dropped.  DEC drift is observed over
+ * default_drift_interval (sec), and only used if guiding corrected it
+ * with at least drift_min_pulses pulses.
+ */
+static const double default_track_interval = 10.;
+static const double track_min_phase = 0.05;
+static const double default_drift_interval = 600.;
+static const unsigned long drift_min_pulses = 10;
+
 struct motion *init_axis (struct config_axis *a, const char *name, int flags,
                           bool ccw);
 
-void hpad_cb (struct hpad *h, void *arg);
-void guide_cb (struct guide *g, void *arg);
+void input_cb (struct input *in, void *arg);
+void guide_timer_cb (struct ev_loop *loop, ev_timer *w, int revents);
 void bbox_cb (struct bbox *bb, void *arg);
 void motion_cb (struct motion *m, void *arg);
+void envelope_cb (struct ev_loop *loop, ev_timer *w, int revents);
+void backlash_cb (struct ev_loop *loop, ev_timer *w, int revents);
+void track_cb (struct ev_loop *loop, ev_timer *w, int revents);
+void track_timer_cb (struct ev_loop *loop, ev_timer *w, int revents);
 void lx200_pos_ha_cb (struct lx200 *lx, void *arg);
 void lx200_pos_dec_cb (struct lx200 *lx, void *arg);
 void lx200_slew_cb (struct lx200 *lx, void *arg);
+void lx200_guide_cb (struct lx200 *lx, void *arg);
 void lx200_goto_cb (struct lx200 *lx, void *arg);
 void lx200_stop_cb (struct lx200 *lx, void *arg);
 void lx200_tracking_cb (struct lx200 *lx, void *arg);
+void stream_cb (struct stream *st, void *arg);
+void stellarium_pos_cb (struct stellarium *st, void *arg);
+void stellarium_goto_cb (struct stellarium *st, void *arg);
+void nexstar_pos_cb (struct nexstar *nx, void *arg);
+void nexstar_status_cb (struct nexstar *nx, void *arg);
+void nexstar_slew_cb (struct nexstar *nx, void *arg);
+void nexstar_goto_cb (struct nexstar *nx, void *arg);
+void nexstar_stop_cb (struct nexstar *nx, void *arg);
+void nexstar_tracking_cb (struct nexstar *nx, void *arg);
+void indi_pos_cb (struct indi *in, void *arg);
+void indi_status_cb (struct indi *in, void *arg);
+void indi_slew_cb (struct indi *in, void *arg);
+void indi_goto_cb (struct indi *in, void *arg);
+void indi_stop_cb (struct indi *in, void *arg);
+void indi_tracking_cb (struct indi *in, void *arg);
+void alpaca_pos_cb (struct alpaca *al, void *arg);
+void alpaca_status_cb (struct alpaca *al, void *arg);
+void alpaca_guide_cb (struct alpaca *al, void *arg);
+void alpaca_goto_cb (struct alpaca *al, void *arg);
+void alpaca_stop_cb (struct alpaca *al, void *arg);
+void alpaca_tracking_cb (struct alpaca *al, void *arg);
 
 int controller_velocity (struct config_axis *axis, double degrees_persec);
+int get_position (struct prog_context *ctx, double *t_degrees,
+                  double *d_degrees);
 
-#define OPTIONS "+c:hMBLHGw"
+#define OPTIONS "+c:hMBLNIAHGSTPw"
 static const struct option longopts[] = {
     {"config",               required_argument, 0, 'c'},
     {"help",                 no_argument,       0, 'h'},
     {"debug-motion",         no_argument,       0, 'M'},
     {"debug-bbox",           no_argument,       0, 'B'},
     {"debug-lx200",          no_argument,       0, 'L'},
+    {"debug-nexstar",        no_argument,       0, 'N'},
+    {"debug-indi",           no_argument,       0, 'I'},
+    {"debug-alpaca",         no_argument,       0, 'A'},
     {"debug-hpad",           no_argument,       0, 'H'},
     {"debug-guide",          no_argument,       0, 'G'},
+    {"debug-stream",         no_argument,       0, 'S'},
+    {"debug-stellarium",     no_argument,       0, 'T'},
+    {"debug-point",          no_argument,       0, 'P'},
     {"west",                 no_argument,       0, 'w'},
     {0, 0, 0, 0},
 };
@@ -100,8 +277,14 @@ static void usage (void)
 "    -M,--debug-motion   emit motion control commands and responses to stderr\n"
 "    -B,--debug-bbox     emit bbox protocol to stderr\n"
 "    -L,--debug-lx200    emit lx200 protocol to stderr\n"
+"    -N,--debug-nexstar  emit nexstar protocol to stderr\n"
+"    -I,--debug-indi     emit indi protocol to stderr\n"
+"    -A,--debug-alpaca   emit alpaca requests to stderr\n"
 "    -H,--debug-hpad     emit hpad events to stderr\n"
 "    -G,--debug-guide    emit guide pulse events to stderr\n"
+"    -S,--debug-stream   emit position subscription events to stderr\n"
+"    -T,--debug-stellarium emit stellarium protocol to stderr\n"
+"    -P,--debug-point    emit pointing model calculations to stderr\n"
 );
     exit (1);
 }
@@ -116,6 +299,13 @@ int main (int argc, char *argv[])
     int hpad_flags = 0;
     int guide_flags = 0;
     int lx200_flags = 0;
+    int stream_flags = 0;
+    int stellarium_flags = 0;
+    int nexstar_flags = 0;
+    int indi_flags = 0;
+    int alpaca_flags = 0;
+    int point_flags = 0;
+    int i;
 
     memset (&ctx, 0, sizeof (ctx));
 
@@ -129,6 +319,7 @@ int main (int argc, char *argv[])
                 break;
             case 'M':   /* --debug-motion */
                 motion_flags |= MOTION_DEBUG;
+                ctx.motion_debug = true;
                 break;
             case 'B':   /* --debug-bbox */
                 bbox_flags |= BBOX_DEBUG;
@@ -136,15 +327,34 @@ int main (int argc, char *argv[])
             case 'L':   /* --debug-lx200 */
                 lx200_flags |= LX200_DEBUG;
                 break;
+            case 'N':   /* --debug-nexstar */
+                nexstar_flags |= NEXSTAR_DEBUG;
+                break;
+            case 'I':   /* --debug-indi */
+                indi_flags |= INDI_DEBUG;
+                break;
+            case 'A':   /* --debug-alpaca */
+                alpaca_flags |= ALPACA_DEBUG;
+                break;
             case 'H':   /* --debug-hpad */
-                hpad_flags |= HPAD_DEBUG;
+                hpad_flags |= INPUT_DEBUG;
                 break;
             case 'G':   /* --debug-guide */
-                guide_flags |= GUIDE_DEBUG;
+                guide_flags |= INPUT_DEBUG;
+                ctx.guide_debug = true;
+                break;
+            case 'S':   /* --debug-stream */
+                stream_flags |= STREAM_DEBUG;
+                break;
+            case 'T':   /* --debug-stellarium */
+                stellarium_flags |= STELLARIUM_DEBUG;
+                break;
+            case 'P':   /* --debug-point */
+                point_flags |= POINT_DEBUG;
                 break;
             case 'w':   /* --west */
                 ctx.west = true;
-                lx200_flags |= LX200_POINT_WEST; // hint for unaligned starting
+                point_flags |= POINT_WEST; // hint for unaligned starting
                 break;
             case 'h':   /* --help */
             default:
@@ -162,6 +372,11 @@ int main (int argc, char *argv[])
     if (!(ctx.loop = ev_loop_new (EVFLAG_AUTO)))
         err_exit ("ev_loop_new");
 
+    ev_timer_init (&ctx.t_backlash.w, backlash_cb, 0., 0.);
+    ctx.t_backlash.w.data = &ctx;
+    ev_timer_init (&ctx.d_backlash.w, backlash_cb, 0., 0.);
+    ctx.d_backlash.w.data = &ctx;
+
     ctx.t = init_axis (&ctx.opt.t, "t", motion_flags, true);
     motion_set_cb (ctx.t, motion_cb, &ctx);
     motion_start (ctx.loop, ctx.t);
@@ -170,17 +385,40 @@ int main (int argc, char *argv[])
     motion_set_cb (ctx.d, motion_cb, &ctx);
     motion_start (ctx.loop, ctx.d);
 
-    ctx.hpad = hpad_new ();
-    if (hpad_init (ctx.hpad, ctx.opt.hpad_gpio, ctx.opt.hpad_debounce,
-                   hpad_cb, &ctx, hpad_flags) < 0)
-        err_exit ("hpad_init");
-    hpad_start (ctx.loop, ctx.hpad);
+    ev_timer_init (&ctx.guide_w, guide_timer_cb, 0., 0.);
 
-    ctx.guide = guide_new ();
-    if (guide_init (ctx.guide, ctx.opt.guide_gpio, ctx.opt.guide_debounce,
-                   guide_cb, &ctx, guide_flags) < 0)
-        err_exit ("guide_init");
-    guide_start (ctx.loop, ctx.guide);
+    if (ctx.opt.track_interval <= 0)
+        ctx.opt.track_interval = default_track_interval;
+    if (ctx.opt.guide_drift_interval == 0)
+        ctx.opt.guide_drift_interval = default_drift_interval;
+    for (i = 0; i < 2; i++) {
+        ev_timer_init (&ctx.track[i].w, track_cb, 0., 0.);
+        ctx.track[i].w.data = &ctx;
+        ctx.track[i].applied = NAN;
+    }
+    ctx.track[0].dps = ctx.opt.t.sidereal;
+    ev_timer_init (&ctx.track_w, track_timer_cb, ctx.opt.track_interval,
+                   ctx.opt.track_interval);
+    ev_timer_start (ctx.loop, &ctx.track_w);
+    ctx.guidestat = guidestat_new (guidestat_interval);
+    if (ctx.opt.guide_stats_file) {
+        int n = ctx.opt.guide_stats_records > 0 ? ctx.opt.guide_stats_records
+                                                : default_guidestat_records;
+        if (guidestat_open_ring (ctx.guidestat, ctx.opt.guide_stats_file,
+                                 n) < 0)
+            err ("%s", ctx.opt.guide_stats_file);
+    }
+    ctx.input = input_new ();
+    if (input_add_group (ctx.input, "hpad", ctx.opt.hpad_gpio, false,
+                         ctx.opt.hpad_debounce, input_map_hpad,
+                         hpad_flags) < 0)
+        err_exit ("hpad: %s", ctx.opt.hpad_gpio);
+    if (input_add_group (ctx.input, "guide", ctx.opt.guide_gpio, true,
+                         ctx.opt.guide_debounce, input_map_guide,
+                         guide_flags) < 0)
+        err_exit ("guide: %s", ctx.opt.guide_gpio);
+    input_set_cb (ctx.input, input_cb, &ctx);
+    input_start (ctx.loop, ctx.input);
 
     ctx.bbox = bbox_new ();
     if (bbox_init (ctx.bbox, DEFAULT_BBOX_PORT, bbox_cb, &ctx, bbox_flags) < 0)
@@ -188,31 +426,132 @@ int main (int argc, char *argv[])
     bbox_set_resolution (ctx.bbox, ctx.opt.t.steps, ctx.opt.d.steps);
     bbox_start (ctx.loop, ctx.bbox);
 
+    if (!(ctx.point = point_new ()))
+        err_exit ("point_new");
+    point_set_flags (ctx.point, point_flags);
+    point_set_epoch (ctx.point, ctx.opt.epoch);
+    if (ctx.opt.lst_interval > 0)
+        point_set_lst_interval (ctx.point, ctx.opt.lst_interval);
+    if (ctx.opt.state_file) {
+        if (point_set_state_file (ctx.point, ctx.opt.state_file) < 0)
+            err ("%s: site and alignment will not be saved",
+                 ctx.opt.state_file);
+    }
+    if (ctx.opt.horizon) {
+        if (point_set_horizon (ctx.point, ctx.opt.horizon) < 0)
+            msg_exit ("error parsing horizon profile");
+    }
+
     ctx.lx200 = lx200_new ();
-    if (lx200_init (ctx.lx200, DEFAULT_LX200_PORT, lx200_flags) < 0)
-        err_exit ("bbox_init");
+    if (lx200_init (ctx.lx200, DEFAULT_LX200_PORT, ctx.point, lx200_flags) < 0)
+        err_exit ("lx200_init");
     lx200_set_position_ha_cb (ctx.lx200, lx200_pos_ha_cb, &ctx);
     lx200_set_position_dec_cb (ctx.lx200, lx200_pos_dec_cb, &ctx);
     lx200_set_slew_cb (ctx.lx200, lx200_slew_cb, &ctx);
+    lx200_set_guide_cb (ctx.lx200, lx200_guide_cb, &ctx);
     lx200_set_goto_cb (ctx.lx200, lx200_goto_cb, &ctx);
     lx200_set_stop_cb (ctx.lx200, lx200_stop_cb, &ctx);
     lx200_set_tracking_cb (ctx.lx200, lx200_tracking_cb, &ctx);
+    if (ctx.opt.object_library) {
+        if (!(ctx.objlib = objlib_open (ctx.opt.object_library)))
+            err ("%s", ctx.opt.object_library);
+        else
+            lx200_set_objlib (ctx.lx200, ctx.objlib);
+    }
     lx200_start (ctx.loop, ctx.lx200);
 
+    ctx.stream = stream_new ();
+    if (stream_init (ctx.stream, DEFAULT_STREAM_PORT, stream_cb, &ctx,
+                     stream_flags) < 0)
+        err_exit ("stream_init");
+    stream_start (ctx.loop, ctx.stream);
+
+    ctx.stellarium = stellarium_new ();
+    if (stellarium_init (ctx.stellarium, DEFAULT_STELLARIUM_PORT, ctx.point,
+                         stellarium_flags) < 0)
+        err_exit ("stellarium_init");
+    stellarium_set_position_cb (ctx.stellarium, stellarium_pos_cb, &ctx);
+    stellarium_set_goto_cb (ctx.stellarium, stellarium_goto_cb, &ctx);
+    stellarium_start (ctx.loop, ctx.stellarium);
+
+    ctx.nexstar = nexstar_new ();
+    if (nexstar_init (ctx.nexstar, DEFAULT_NEXSTAR_PORT, ctx.point,
+                      nexstar_flags) < 0)
+        err_exit ("nexstar_init");
+    nexstar_set_position_cb (ctx.nexstar, nexstar_pos_cb, &ctx);
+    nexstar_set_status_cb (ctx.nexstar, nexstar_status_cb, &ctx);
+    nexstar_set_slew_cb (ctx.nexstar, nexstar_slew_cb, &ctx);
+    nexstar_set_goto_cb (ctx.nexstar, nexstar_goto_cb, &ctx);
+    nexstar_set_stop_cb (ctx.nexstar, nexstar_stop_cb, &ctx);
+    nexstar_set_tracking_cb (ctx.nexstar, nexstar_tracking_cb, &ctx);
+    nexstar_start (ctx.loop, ctx.nexstar);
+
+    ctx.indi = indi_new ();
+    if (indi_init (ctx.indi, DEFAULT_INDI_PORT, ctx.point, indi_flags) < 0)
+        err_exit ("indi_init");
+    indi_set_position_cb (ctx.indi, indi_pos_cb, &ctx);
+    indi_set_status_cb (ctx.indi, indi_status_cb, &ctx);
+    indi_set_slew_cb (ctx.indi, indi_slew_cb, &ctx);
+    indi_set_goto_cb (ctx.indi, indi_goto_cb, &ctx);
+    indi_set_stop_cb (ctx.indi, indi_stop_cb, &ctx);
+    indi_set_tracking_cb (ctx.indi, indi_tracking_cb, &ctx);
+    indi_start (ctx.loop, ctx.indi);
+
+    ctx.alpaca = alpaca_new ();
+    if (alpaca_init (ctx.alpaca, DEFAULT_ALPACA_PORT, ctx.point,
+                     alpaca_flags) < 0)
+        err_exit ("alpaca_init");
+    alpaca_set_position_cb (ctx.alpaca, alpaca_pos_cb, &ctx);
+    alpaca_set_status_cb (ctx.alpaca, alpaca_status_cb, &ctx);
+    alpaca_set_guide_cb (ctx.alpaca, alpaca_guide_cb, &ctx);
+    alpaca_set_goto_cb (ctx.alpaca, alpaca_goto_cb, &ctx);
+    alpaca_set_stop_cb (ctx.alpaca, alpaca_stop_cb, &ctx);
+    alpaca_set_tracking_cb (ctx.alpaca, alpaca_tracking_cb, &ctx);
+    alpaca_start (ctx.loop, ctx.alpaca);
+
+    if (ctx.opt.keepout) {
+        if (!(ctx.envelope = envelope_new ()))
+            oom ();
+        if (envelope_add_keepout (ctx.envelope, ctx.opt.keepout) < 0)
+            msg_exit ("error parsing keep-out regions");
+        if (ctx.opt.envelope_lookahead <= 0)
+            ctx.opt.envelope_lookahead = default_envelope_lookahead;
+        ev_timer_init (&ctx.envelope_w, envelope_cb, envelope_period,
+                       envelope_period);
+        ev_timer_start (ctx.loop, &ctx.envelope_w);
+    }
+
     ev_run (ctx.loop, 0);
     ev_loop_destroy (ctx.loop);
 
+    stream_stop (ctx.loop, ctx.stream);
+    stream_destroy (ctx.stream);
+
+    stellarium_stop (ctx.loop, ctx.stellarium);
+    stellarium_destroy (ctx.stellarium);
+
+    nexstar_stop (ctx.loop, ctx.nexstar);
+    nexstar_destroy (ctx.nexstar);
+
+    indi_stop (ctx.loop, ctx.indi);
+    indi_destroy (ctx.indi);
+
+    alpaca_stop (ctx.loop, ctx.alpaca);
+    alpaca_destroy (ctx.alpaca);
+
     bbox_stop (ctx.loop, ctx.bbox);
     bbox_destroy (ctx.bbox);
 
     lx200_stop (ctx.loop, ctx.lx200);
     lx200_destroy (ctx.lx200);
+    objlib_close (ctx.objlib);
 
-    guide_stop (ctx.loop, ctx.guide);
-    guide_destroy (ctx.guide);
+    point_destroy (ctx.point);
+    envelope_destroy (ctx.envelope);
 
-    hpad_stop (ctx.loop, ctx.hpad);
-    hpad_destroy (ctx.hpad);
+    input_stop (ctx.loop, ctx.input);
+    input_destroy (ctx.input);
+    guidestat_destroy (ctx.guidestat);
 
     motion_destroy (ctx.d);
     motion_destroy (ctx.t);
@@ -251,10 +590,8 @@ struct motion *init_axis (struct config_axis *a, const char *name, int flags,
 
 /* Given 'rate' enum from slew.h, look up configured rate in degrees/sec.
  * If 'neg' is true, make the velocity negative.
- * If 'track' is true, add the sidereal rate.
  */
-double lookup_rate (struct config_axis *axis, int rate,
-                    bool neg, bool track)
+double lookup_rate (struct config_axis *axis, int rate, bool neg)
 {
     double dps;
 
@@ -277,11 +614,389 @@ double lookup_rate (struct config_axis *axis, int rate,
     }
     if (neg)
         dps *= -1.;
-    if (track)
-        dps += axis->sidereal;
     return dps;
 }
 
+static double estimate_position (struct estimate *e, double when)
+{
+    if (e->until != 0. && when > e->until)
+        when = e->until;
+    return e->pos + e->vel * (when - e->time);
+}
+
+/* Extrapolate a goto of axis 'm' from 'from' to 'to' degrees at its goto
+ * rate.  Acceleration is ignored, so the estimate leads the axis.
+ */
+static void estimate_goto (struct prog_context *ctx, struct motion *m,
+                           double from, double to)
+{
+    struct estimate *e = (m == ctx->t) ? &ctx->t_est : &ctx->d_est;
+    double dps = motion_get_goto_dps (m);
+
+    e->pos = from;
+    e->time = ev_now (ctx->loop);
+    e->vel = copysign (dps, to - from);
+    e->until = e->time + fabs (to - from) / dps;
+}
+
+/* Forget the estimate for axis 'm' when its goto ends, so the position
+ * is read from the controller again.
+ */
+static void estimate_reset (struct prog_context *ctx, struct motion *m)
+{
+    struct estimate *e = (m == ctx->t) ? &ctx->t_est : &ctx->d_est;
+
+    memset (e, 0, sizeof (*e));
+    ctx->pos_time = 0.;
+}
+
+/* Rebase the estimate for axis 'm' at the current time, then change
+ * its velocity.
+ */
+static void estimate_velocity (struct prog_context *ctx, struct motion *m,
+                               double dps)
+{
+    struct estimate *e = (m == ctx->t) ? &ctx->t_est : &ctx->d_est;
+    double now = ev_now (ctx->loop);
+
+    if (e->time != 0.) {
+        e->pos = estimate_position (e, now);
+        e->time = now;
+    }
+    e->until = 0.;
+    e->vel = dps;
+}
+
+static struct backlash *axis_backlash (struct prog_context *ctx,
+                                       struct motion *m)
+{
+    return (m == ctx->t) ? &ctx->t_backlash : &ctx->d_backlash;
+}
+
+static struct config_axis *axis_config (struct prog_context *ctx,
+                                        struct motion *m)
+{
+    return (m == ctx->t) ? &ctx->opt.t : &ctx->opt.d;
+}
+
+/* Backlash take-up is complete; resume the requested velocity.
+ */
+void backlash_cb (struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct prog_context *ctx = w->data;
+    struct motion *m = (w == &ctx->t_backlash.w) ? ctx->t : ctx->d;
+    struct backlash *b = axis_backlash (ctx, m);
+
+    if (motion_move_constant_dps (m, b->dps) < 0) {
+        err ("%s: move at v=%.1lf*/s", motion_get_name (m), b->dps);
+        return;
+    }
+    estimate_velocity (ctx, m, b->dps);
+}
+
+static void backlash_cancel (struct prog_context *ctx, struct motion *m)
+{
+    struct backlash *b = axis_backlash (ctx, m);
+
+    ev_timer_stop (ctx->loop, &b->w);
+    b->approach = 0.;
+}
+
+static void track_cancel (struct prog_context *ctx, struct motion *m)
+{
+    struct track *tr = &ctx->track[m == ctx->t ? 0 : 1];
+
+    ev_timer_stop (ctx->loop, &tr->w);
+    tr->applied = NAN;
+    tr->owed = 0.;
+}
+
+/* Wrappers for motion functions that change axis velocity, keeping
+ * the position estimates current.  A move that reverses the direction
+ * the axis was last driven starts with a backlash take-up burst.
+ */
+int axis_move (struct prog_context *ctx, struct motion *m, double dps)
+{
+    struct config_axis *cfg = axis_config (ctx, m);
+    struct backlash *b = axis_backlash (ctx, m);
+    int dir = dps > 0 ? 1 : dps < 0 ? -1 : 0;
+    double burst = 0.;
+
+    backlash_cancel (ctx, m);
+    track_cancel (ctx, m);
+    if (cfg->backlash > 0 && cfg->slow > 0 && dir != 0 && b->dir == -dir)
+        burst = dir * cfg->slow;
+    if (motion_move_constant_dps (m, dps + burst) < 0)
+        return -1;
+    estimate_velocity (ctx, m, dps + burst);
+    if (dir != 0)
+        b->dir = dir;
+    if (burst != 0.) {
+        b->dps = dps;
+        ev_timer_set (&b->w, cfg->backlash / cfg->slow, 0.);
+        ev_timer_start (ctx->loop, &b->w);
+        if (ctx->motion_debug)
+            msg ("%s: backlash take-up %+.4f* in %.3fs", motion_get_name (m),
+                 dir * cfg->backlash, cfg->backlash / cfg->slow);
+    }
+    return 0;
+}
+
+int axis_soft_stop (struct prog_context *ctx, struct motion *m)
+{
+    backlash_cancel (ctx, m);
+    track_cancel (ctx, m);
+    if (motion_soft_stop (m) < 0)
+        return -1;
+    estimate_velocity (ctx, m, 0.);
+    return 0;
+}
+
+int axis_abort (struct prog_context *ctx, struct motion *m)
+{
+    backlash_cancel (ctx, m);
+    track_cancel (ctx, m);
+    if (motion_abort (m) < 0)
+        return -1;
+    estimate_velocity (ctx, m, 0.);
+    return 0;
+}
+
+/* Goto axis 'm' to 'position' (steps).  With a final approach configured,
+ * stop short of the target so the last move is always in the approach
+ * direction and takes up any backlash; otherwise the direction the gears
+ * are loaded in afterwards is unknown.
+ */
+int axis_goto (struct prog_context *ctx, struct motion *m, double position)
+{
+    struct config_axis *cfg = axis_config (ctx, m);
+    struct backlash *b = axis_backlash (ctx, m);
+    double approach = cfg->approach / 360.0 * cfg->steps;
+
+    backlash_cancel (ctx, m);
+    track_cancel (ctx, m);
+    if (motion_goto_absolute (m, position - approach) < 0)
+        return -1;
+    b->approach = approach;
+    b->dir = approach > 0 ? 1 : approach < 0 ? -1 : 0;
+    return 0;
+}
+
+/* Tracking rate of axis 'a' (0 = t, 1 = d), zero unless tracking.
+ */
+static double track_rate (struct prog_context *ctx, int a)
+{
+    return ctx->t_tracking ? ctx->track[a].dps : 0.;
+}
+
+/* Run axis 'a' at its tracking rate plus a guide 'offset' (degrees/sec).
+ * Without an offset, the rate is dithered between the nearest commandable
+ * velocities over the next update interval; with one, the nearest is used
+ * for the duration of the guide pulse.  The motion the previous schedule
+ * fell short of (or overshot) by now is owed to this one, so guide pulses
+ * neither lose nor repeat tracking motion.  Nothing is sent if tracking
+ * already commanded the velocity.
+ */
+static int axis_track (struct prog_context *ctx, int a, double offset)
+{
+    struct track *tr = &ctx->track[a];
+    struct motion *m = (a == 0) ? ctx->t : ctx->d;
+    double interval = ctx->opt.track_interval;
+    double now = ev_now (ctx->loop);
+    double dps = track_rate (ctx, a) + offset;
+    double owed = 0.;
+    double lo, hi, high = 0.;
+
+    if (!isnan (tr->applied) && track_rate (ctx, a) != 0.) {
+        double elapsed = now - tr->start;
+        double done = tr->hi * fmin (elapsed, tr->high)
+                    + tr->lo * fmax (elapsed - tr->high, 0.);
+        owed = tr->owed + tr->rate * elapsed - done;
+    }
+    motion_bracket_dps (m, dps, &lo, &hi);
+    if (offset != 0.) {
+        if (dps - lo < hi - dps)
+            hi = lo;
+        else
+            lo = hi;
+    }
+    else if (hi > lo)
+        high = (dps * interval + owed - lo * interval) / (hi - lo);
+    if (high < track_min_phase)
+        high = 0.;
+    else if (high > interval - track_min_phase)
+        high = interval;
+    ev_timer_stop (ctx->loop, &tr->w);
+    if ((high > 0. ? hi : lo) != tr->applied) {
+        double v = (high > 0.) ? hi : lo;
+        int rc = (v != 0.) ? axis_move (ctx, m, v) : axis_soft_stop (ctx, m);
+        if (rc < 0)
+            return -1;
+        tr->applied = v;
+    }
+    tr->start = now;
+    tr->rate = dps;
+    tr->hi = hi;
+    tr->lo = lo;
+    tr->high = high;
+    tr->owed = owed;
+    if (high > 0. && high < interval) {
+        ev_timer_set (&tr->w, high, 0.);
+        ev_timer_start (ctx->loop, &tr->w);
+    }
+    return 0;
+}
+
+/* The high phase of a tracking interval is over.  The move would end
+ * the schedule, so it is kept across it.
+ */
+void track_cb (struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct prog_context *ctx = w->data;
+    int a = (w == &ctx->track[0].w) ? 0 : 1;
+    struct motion *m = (a == 0) ? ctx->t : ctx->d;
+    struct track *tr = &ctx->track[a];
+    double lo = tr->lo;
+    double owed = tr->owed;
+    int rc;
+
+    rc = (lo != 0.) ? axis_move (ctx, m, lo) : axis_soft_stop (ctx, m);
+    if (rc < 0) {
+        err ("%s: track at v=%.5lf*/s", motion_get_name (m), lo);
+        return;
+    }
+    tr->applied = lo;
+    tr->owed = owed;
+}
+
+static const int guide_axis_mask[2] = {
+    SLEW_RA_PLUS | SLEW_RA_MINUS,
+    SLEW_DEC_PLUS | SLEW_DEC_MINUS,
+};
+
+static double monotime (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+/* Publish guide statistics to stream subscribers.
+ */
+static void guide_stats_update (struct prog_context *ctx)
+{
+    struct stream_guide g[2];
+    struct guidestat_axis a;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        guidestat_get (ctx->guidestat, i, &a);
+        g[i].count = a.count;
+        g[i].duration = a.duration;
+        g[i].net = a.net;
+        g[i].rms = a.rms;
+        g[i].period = a.period;
+        g[i].amplitude = a.amplitude;
+    }
+    stream_set_guide (ctx->stream, g);
+}
+
+/* Get axis 'a' position (degrees) at the start of the guide pulse
+ * ending now, from the extrapolated position, or NAN if it is unknown.
+ * The controllers are not queried on the guide path.
+ */
+static double guide_pulse_position (struct prog_context *ctx, int a,
+                                    double duration)
+{
+    struct estimate *e = (a == 0) ? &ctx->t_est : &ctx->d_est;
+
+    if (ctx->t_goto || ctx->d_goto || e->time == 0.)
+        return NAN;
+    return estimate_position (e, ev_now (ctx->loop))
+         - (track_rate (ctx, a) + ctx->guide_offset[a].dps) * duration;
+}
+
+/* Add the correction applied by the current guide offset on axis 'a'
+ * up to 'now', and if a pulse ended, add it to the statistics.
+ */
+static void guide_tally (struct prog_context *ctx, int a, double now)
+{
+    struct guide_offset *o = &ctx->guide_offset[a];
+
+    if (o->dps != 0.) {
+        double duration = now - o->since;
+        double correction = o->dps * duration;
+
+        o->total += correction;
+        guidestat_pulse (ctx->guidestat, a, o->since,
+                         guide_pulse_position (ctx, a, duration),
+                         duration, correction);
+        guide_stats_update (ctx);
+    }
+    o->since = now;
+}
+
+/* Drop the guide offset on axis 'a' without commanding motion, because
+ * the caller is about to take over the axis.  A guide pulse still in
+ * progress is re-applied on its next change.
+ */
+static void guide_cancel (struct prog_context *ctx, int a)
+{
+    struct guide_offset *o = &ctx->guide_offset[a];
+
+    guide_tally (ctx, a, monotime ());
+    o->dps = 0.;
+    ctx->guide_applied &= ~guide_axis_mask[a];
+    ctx->guide_pulse[a].hold = 0.;
+}
+
+/* Set the guide offset on axis 'a' (0 = t, 1 = d) for directions 'bits'.
+ * The axis moves at its tracking rate (zero if not tracking) plus the
+ * offset, so neither axis leaves the tracking path, and a command is
+ * sent only when the axis velocity actually changes.
+ * The command round trip is timed; the offset is assumed to take effect
+ * at its midpoint, which is when the previous offset is tallied.
+ * Returns 0 on success, -1 on failure (offset unchanged).
+ */
+static int guide_offset_set (struct prog_context *ctx, int a, int bits)
+{
+    struct guide_offset *o = &ctx->guide_offset[a];
+    struct config_axis *cfg = (a == 0) ? &ctx->opt.t : &ctx->opt.d;
+    double base = track_rate (ctx, a);
+    double dps = 0.;
+    double t0, t1, rtt;
+    int rc;
+
+    if (bits)
+        dps = lookup_rate (cfg, SLEW_RATE_GUIDE,
+                           (bits & (SLEW_RA_MINUS | SLEW_DEC_MINUS)));
+    if (dps == o->dps)
+        return 0;
+    t0 = monotime ();
+    rc = axis_track (ctx, a, dps);
+    t1 = monotime ();
+    if (rc < 0) {
+        err ("%s: guide at v=%.5lf*/s", a == 0 ? "t" : "d", base + dps);
+        return -1;
+    }
+    rtt = t1 - t0;
+    ctx->guide_rtt = ctx->guide_rtt == 0. ? rtt
+                   : 0.8 * ctx->guide_rtt + 0.2 * rtt;
+    guide_tally (ctx, a, (t0 + t1) / 2.);
+    if (dps != 0.)
+        ctx->guide_pulse[a].effect = (t0 + t1) / 2.;
+    else if (ctx->guide_debug) {
+        struct guidestat_axis st;
+        guidestat_get (ctx->guidestat, a, &st);
+        msg ("%s: guide correction total %+.2f\" pulses %lu rms %.2f\""
+             " peak %.1f\" at %.0fs", a == 0 ? "t" : "d", o->total * 3600.,
+             st.count, st.rms, st.amplitude, st.period);
+    }
+    o->dps = dps;
+    return 0;
+}
+
 /* A new slew "key press" event ignores a slew in progress on the
  * same axis and blindly sets the velocity.  The motion controllers can
  * handle this, even if direction is reversed.  The "key release" cancels
@@ -293,46 +1008,57 @@ double lookup_rate (struct config_axis *axis, int rate,
 void slew_update (struct prog_context *ctx, int newmask, int rate)
 {
     double dps;
+    int a;
 
     if ((newmask & SLEW_RA_PLUS) && (newmask & SLEW_RA_MINUS))
         newmask &= ~(SLEW_RA_PLUS + SLEW_RA_MINUS);
     if ((newmask & SLEW_DEC_PLUS) && (newmask & SLEW_DEC_MINUS))
         newmask &= ~(SLEW_DEC_PLUS + SLEW_DEC_MINUS);
 
+    for (a = 0; a < 2; a++) {
+        if (((newmask | ctx->slew) & guide_axis_mask[a]))
+            guide_cancel (ctx, a);
+    }
+    if ((newmask | ctx->slew))
+        ctx->drift.start = 0.;
     if ((newmask & SLEW_RA_PLUS) || (newmask & SLEW_RA_MINUS)) {
-        dps = lookup_rate (&ctx->opt.t, rate, (newmask & SLEW_RA_MINUS),
-                           ctx->t_tracking);
-        if (motion_move_constant_dps (ctx->t, dps) < 0)
+        dps = lookup_rate (&ctx->opt.t, rate, (newmask & SLEW_RA_MINUS))
+            + track_rate (ctx, 0);
+        if (axis_move (ctx, ctx->t, dps) < 0)
             err ("t: move at v=%.1lf*/s", dps);
     }
     else {
         if ((ctx->slew & SLEW_RA_PLUS) || (ctx->slew & SLEW_RA_MINUS)) {
             if (ctx->t_tracking) {
-                dps = lookup_rate (&ctx->opt.t, 0, false, ctx->t_tracking);
-                if (motion_move_constant_dps (ctx->t, dps) < 0)
-                    err ("t: move at v=%.1lf*/s", dps);
+                if (axis_track (ctx, 0, 0.) < 0)
+                    err ("t: track");
             }
             else {
-                if (motion_soft_stop (ctx->t) < 0) {
+                if (axis_soft_stop (ctx, ctx->t) < 0) {
                     err ("t: stop");
-                    if (motion_abort (ctx->t) < 0)
+                    if (axis_abort (ctx, ctx->t) < 0)
                         err ("t: abort");
                 }
             }
         }
     }
     if ((newmask & SLEW_DEC_PLUS) || (newmask & SLEW_DEC_MINUS)) {
-        dps = lookup_rate (&ctx->opt.d, rate, (newmask & SLEW_DEC_MINUS),
-                           false);
-        if (motion_move_constant_dps (ctx->d, dps) < 0)
+        dps = lookup_rate (&ctx->opt.d, rate, (newmask & SLEW_DEC_MINUS));
+        if (axis_move (ctx, ctx->d, dps) < 0)
             err ("d: move at v=%.1lf*/s", dps);
     }
     else {
         if ((ctx->slew & SLEW_DEC_PLUS) || (ctx->slew & SLEW_DEC_MINUS)) {
-            if (motion_soft_stop (ctx->d) < 0) {
-                err ("d: stop");
-                if (motion_abort (ctx->d) < 0)
-                    err ("d: abort");
+            if (ctx->t_tracking) {
+                if (axis_track (ctx, 1, 0.) < 0)
+                    err ("d: track");
+            }
+            else {
+                if (axis_soft_stop (ctx, ctx->d) < 0) {
+                    err ("d: stop");
+                    if (axis_abort (ctx, ctx->d) < 0)
+                        err ("d: abort");
+                }
             }
         }
     }
@@ -340,52 +1066,177 @@ void slew_update (struct prog_context *ctx, int newmask, int rate)
 }
 
 /* After toggling t_tracking, or completion of a goto,
- * ensure that motion has (re-)enabled or disabled RA tracking
- * as appropraite.
+ * ensure that motion has (re-)enabled or disabled tracking on both
+ * axes as appropriate.  A guide offset in progress is kept; an axis
+ * in a goto or manual slew is left to resume tracking when it ends.
  */
 void update_tracking (struct prog_context *ctx)
 {
-    double dps;
+    int a;
 
-    if (ctx->t_tracking) {
-        dps = lookup_rate (&ctx->opt.t, SLEW_RATE_NONE, false, true);
-        if (motion_move_constant_dps (ctx->t, dps) < 0)
-            err ("t: move at v=%.1lf*/s", dps);
+    ctx->drift.start = 0.;
+    for (a = 0; a < 2; a++) {
+        struct motion *m = (a == 0) ? ctx->t : ctx->d;
+        double dps = track_rate (ctx, a) + ctx->guide_offset[a].dps;
+
+        if ((a == 0 ? ctx->t_goto : ctx->d_goto)
+                                || (ctx->slew & guide_axis_mask[a]))
+            continue;
+        if (axis_track (ctx, a, ctx->guide_offset[a].dps) < 0)
+            err ("%s: track at v=%.5lf*/s", motion_get_name (m), dps);
     }
-    else {
-         if (motion_soft_stop (ctx->t) < 0)
-            err ("t: stop");
+}
+
+/* Observe the DEC drift that guiding corrected while tracking
+ * undisturbed, and once per drift interval add it to the pointing
+ * model, which refines the tracking rates.  Call before the rates
+ * change: the tracking motion so far is at the old rate.
+ */
+static void drift_update (struct prog_context *ctx, double now,
+                          double t, double d)
+{
+    struct drift *dr = &ctx->drift;
+    struct guidestat_axis st;
+    double elapsed;
+
+    guidestat_get (ctx->guidestat, 1, &st);
+    if (dr->start != 0.) {
+        dr->tracked += ctx->track[1].dps * (now - dr->last);
+        dr->last = now;
+        elapsed = now - dr->start;
+        if (elapsed < ctx->opt.guide_drift_interval)
+            return;
+        if (st.count - dr->pulses >= drift_min_pulses) {
+            double guided = ctx->guide_offset[1].total - dr->guided;
+            double rate = (dr->tracked + guided)
+                        / (elapsed * ctx->opt.t.sidereal);
+
+            if (ctx->guide_debug)
+                msg ("drift: d %+.2f\" tracked %+.2f\" guided over %.0fs",
+                     dr->tracked * 3600., guided * 3600., elapsed);
+            point_add_drift (ctx->point, (dr->t + t) / 2., (dr->d + d) / 2.,
+                             rate);
+        }
     }
+    dr->start = dr->last = now;
+    dr->tracked = 0.;
+    dr->guided = ctx->guide_offset[1].total;
+    dr->pulses = st.count;
+    dr->t = t;
+    dr->d = d;
 }
 
-void hpad_cb (struct hpad *h, void *arg)
+/* Periodically recompute tracking rates from the pointing model at the
+ * current position, so the axes follow the drift due to polar
+ * misalignment and the other terms, and apply them to any axis that is
+ * only tracking.  The autoguider is left with the residual.
+ */
+void track_timer_cb (struct ev_loop *loop, ev_timer *w, int revents)
 {
-    struct prog_context *ctx = arg;
-    int dir = hpad_get_slew_direction (h);
-    int rate = hpad_get_slew_rate (h);
-    int ctrl = hpad_get_control (h);
+    struct prog_context *ctx = (struct prog_context *)((char *)w
+                            - offsetof (struct prog_context, track_w));
+    double t, d, t_rate, d_rate;
+    int a;
+
+    if (!ctx->t_tracking || ctx->t_goto || ctx->d_goto || ctx->slew
+                         || get_position (ctx, &t, &d) < 0) {
+        ctx->drift.start = 0.;
+        return;
+    }
+    if (ctx->opt.guide_drift_interval > 0)
+        drift_update (ctx, monotime (), t, d);
+    point_get_rates (ctx->point, t, d, &t_rate, &d_rate);
+    ctx->track[0].dps = ctx->opt.t.sidereal * t_rate;
+    ctx->track[1].dps = ctx->opt.t.sidereal * d_rate;
+    if (ctx->motion_debug)
+        msg ("track: t %.6f*/s d %+.3e*/s", ctx->track[0].dps,
+             ctx->track[1].dps);
+
+    for (a = 0; a < 2; a++) {
+        struct motion *m = (a == 0) ? ctx->t : ctx->d;
+
+        if (ctx->guide_offset[a].dps != 0.
+                        || ev_is_active (&axis_backlash (ctx, m)->w))
+            continue;
+        if (axis_track (ctx, a, 0.) < 0)
+            err ("%s: track at v=%.5lf*/s", motion_get_name (m),
+                 ctx->track[a].dps);
+    }
+}
+
+/* Get t,d axis positions in degrees.  The motion controllers are only
+ * queried if the cached positions are older than position_maxage.
+ */
+int get_position (struct prog_context *ctx, double *t_degrees,
+                  double *d_degrees)
+{
+    double now = ev_now (ctx->loop);
+    double t, d;
+
+    if (ctx->pos_time == 0. || now - ctx->pos_time > position_maxage) {
+        if (motion_get_position (ctx->t, &t) < 0) {
+            err ("%s: error reading t position", __FUNCTION__);
+            return -1;
+        }
+        if (motion_get_position (ctx->d, &d) < 0) {
+            err ("%s: error reading d position", __FUNCTION__);
+            return -1;
+        }
+        ctx->t_pos = 360.0 * (t / ctx->opt.t.steps);
+        ctx->d_pos = 360.0 * (d / ctx->opt.d.steps);
+        ctx->pos_time = now;
+        if (!ctx->t_goto) {
+            ctx->t_est.pos = ctx->t_pos;
+            ctx->t_est.time = now;
+            ctx->t_est.until = 0.;
+        }
+        if (!ctx->d_goto) {
+            ctx->d_est.pos = ctx->d_pos;
+            ctx->d_est.time = now;
+            ctx->d_est.until = 0.;
+        }
+    }
+    *t_degrees = ctx->t_pos;
+    *d_degrees = ctx->d_pos;
+    return 0;
+}
+
+/* Handpad keys changed.
+ */
+static void hpad_update (struct prog_context *ctx, int events)
+{
+    int dir = events & INPUT_SLEW_MASK;
+    int rate = (events & INPUT_FAST) ? SLEW_RATE_FAST : SLEW_RATE_MEDIUM;
 
     /* M1 - emergency stop
      */
-    if ((ctrl & HPAD_CONTROL_M1)) {
+    if ((events & INPUT_M1)) {
         msg ("emergency stop");
-        if (motion_abort (ctx->t) < 0) {
+        if (axis_abort (ctx, ctx->t) < 0) {
             err ("t: motion_abort");
-            if (motion_abort (ctx->t) < 0) // one retry
+            if (axis_abort (ctx, ctx->t) < 0) // one retry
                 err ("t: motion_abort");
         }
-        if (motion_abort (ctx->d) < 0) {
+        if (axis_abort (ctx, ctx->d) < 0) {
             err ("d: motion_abort");
-            if (motion_abort (ctx->d) < 0) // one retry
+            if (axis_abort (ctx, ctx->d) < 0) // one retry
                 err ("t: motion_abort");
         }
         ctx->t_tracking = false;
         ctx->slew = 0;
+        if (ctx->t_goto)
+            estimate_reset (ctx, ctx->t);
+        if (ctx->d_goto)
+            estimate_reset (ctx, ctx->d);
+        ctx->t_goto = false;
+        ctx->d_goto = false;
+        guide_cancel (ctx, 0);
+        guide_cancel (ctx, 1);
         return;
     }
     /* M2 - toggle tracking
      */
-    if ((ctrl & HPAD_CONTROL_M2)) {
+    if ((events & INPUT_M2)) {
         ctx->t_tracking = !ctx->t_tracking;
         update_tracking (ctx);
         return;
@@ -395,16 +1246,122 @@ void hpad_cb (struct hpad *h, void *arg)
     slew_update (ctx, dir, rate);
 }
 
-void guide_cb (struct guide *g, void *arg)
+/* Apply guide directions to motion, except that an axis whose
+ * pulse has ended stays applied until its hold time.  RA and DEC are
+ * independent offsets, so a change on one axis never resends the other,
+ * and opposing directions on one axis cancel.  An axis being slewed
+ * manually is left alone.
+ */
+static void guide_apply (struct prog_context *ctx)
+{
+    double now = monotime ();
+    double next = 0.;
+    int mask = ctx->guide_mask;
+    int a;
+
+    for (a = 0; a < 2; a++) {
+        struct guide_pulse *p = &ctx->guide_pulse[a];
+        if (p->hold > now) {
+            mask = (mask & ~guide_axis_mask[a])
+                 | (ctx->guide_applied & guide_axis_mask[a]);
+            if (next == 0. || p->hold < next)
+                next = p->hold;
+        }
+        else
+            p->hold = 0.;
+    }
+    for (a = 0; a < 2; a++) {
+        int bits = mask & guide_axis_mask[a];
+
+        if (bits == guide_axis_mask[a])
+            bits = 0;
+        if (bits == (ctx->guide_applied & guide_axis_mask[a]))
+            continue;
+        if ((ctx->slew & guide_axis_mask[a]))
+            continue;
+        if (guide_offset_set (ctx, a, bits) < 0)
+            continue;
+        ctx->guide_applied = (ctx->guide_applied & ~guide_axis_mask[a]) | bits;
+    }
+    ev_timer_stop (ctx->loop, &ctx->guide_w);
+    if (next != 0.) {
+        ev_timer_set (&ctx->guide_w, next - now, 0.);
+        ev_timer_start (ctx->loop, &ctx->guide_w);
+    }
+}
+
+void guide_timer_cb (struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct prog_context *ctx = (struct prog_context *)((char *)w
+                            - offsetof (struct prog_context, guide_w));
+    guide_apply (ctx);
+}
+
+/* Guide directions from 'source' changed to 'dir', where edge[i] is
+ * the time of the last change of direction bit i.  The pulse duration is
+ * taken from the edge times, and the correction is held for that long
+ * after it took effect, less the expected latency of the stop command,
+ * so short pulses are reproduced even if both edges are read together.
+ */
+static void guide_update (struct prog_context *ctx, int *source, int dir,
+                          const double edge[4])
+{
+    int mask, a;
+
+    *source = dir;
+    mask = ctx->guide_port | ctx->guide_lx200 | ctx->guide_alpaca;
+    for (a = 0; a < 2; a++) {
+        struct guide_pulse *p = &ctx->guide_pulse[a];
+        int old = ctx->guide_mask & guide_axis_mask[a];
+        int new = mask & guide_axis_mask[a];
+
+        if (old == new)
+            continue;
+        if (new) {
+            p->edge = edge[ffs (new) - 1];
+            p->hold = 0.;
+        }
+        else {
+            double duration = edge[ffs (old) - 1] - p->edge;
+            p->hold = p->effect + duration - ctx->guide_rtt / 2.;
+        }
+    }
+    ctx->guide_mask = mask;
+    guide_apply (ctx);
+}
+
+/* GPIO inputs changed: handpad keys and/or guide port directions.
+ */
+void input_cb (struct input *in, void *arg)
 {
     struct prog_context *ctx = arg;
-    int dir;
+    int events = input_get_events (in);
+    int changed = input_get_changed (in);
 
-    if ((dir = guide_get_slew_direction (g)) < 0) {
-        err ("guide_get_slew_direction");
-        return;
+    if ((changed & (INPUT_SLEW_MASK | INPUT_FAST | INPUT_M1 | INPUT_M2)))
+        hpad_update (ctx, events);
+    if ((changed & INPUT_GUIDE_MASK)) {
+        double edge[4];
+        int i;
+
+        for (i = 0; i < 4; i++)
+            edge[i] = input_get_edge_time (in, INPUT_GUIDE (1<<i));
+        guide_update (ctx, &ctx->guide_port,
+                      (events & INPUT_GUIDE_MASK) >> 4, edge);
     }
-    slew_update (ctx, dir, SLEW_RATE_GUIDE);
+}
+
+/* LX200 protocol notifies us that a pulse guide command started or a
+ * pulse ended.  The pulses are timed on the event loop, so edges are now.
+ */
+void lx200_guide_cb (struct lx200 *lx, void *arg)
+{
+    struct prog_context *ctx = arg;
+    double now = monotime ();
+    double edge[4] = { now, now, now, now };
+
+    guide_update (ctx, &ctx->guide_lx200, lx200_get_guide_direction (lx),
+                  edge);
 }
 
 /* LX200 protocol notifies us that slew "button" events
@@ -419,22 +1376,52 @@ void lx200_slew_cb (struct lx200 *lx, void *arg)
     slew_update (ctx, dir, rate);
 }
 
+/* NexStar protocol notifies us that slew "button" events
+ * have occurred.
+ */
+void nexstar_slew_cb (struct nexstar *nx, void *arg)
+{
+    struct prog_context *ctx = arg;
+    int dir = nexstar_get_slew_direction (nx);
+    int rate = nexstar_get_slew_rate (nx);
+
+    slew_update (ctx, dir, rate);
+}
+
+/* INDI protocol notifies us that motion switches have changed.
+ */
+void indi_slew_cb (struct indi *in, void *arg)
+{
+    struct prog_context *ctx = arg;
+    int dir = indi_get_slew_direction (in);
+    int rate = indi_get_slew_rate (in);
+
+    slew_update (ctx, dir, rate);
+}
+
+/* Alpaca protocol notifies us that a guide pulse started or ended.
+ */
+void alpaca_guide_cb (struct alpaca *al, void *arg)
+{
+    struct prog_context *ctx = arg;
+    double now = monotime ();
+    double edge[4] = { now, now, now, now };
+
+    guide_update (ctx, &ctx->guide_alpaca, alpaca_get_guide_direction (al),
+                  edge);
+}
+
 /* Bbox protocol requests that we update "encoder" position.
  */
 void bbox_cb (struct bbox *bb, void *arg)
 {
     struct prog_context *ctx = arg;
-    double t, d;
+    double t_degrees, d_degrees;
 
-    if (motion_get_position (ctx->t, &t) < 0) {
-        err ("%s: error reading t position", __FUNCTION__);
-        return;
-    }
-    if (motion_get_position (ctx->d, &d) < 0) {
-        err ("%s: error reading d position", __FUNCTION__);
+    if (get_position (ctx, &t_degrees, &d_degrees) < 0)
         return;
-    }
-    bbox_set_position (bb, t, d);
+    bbox_set_position (bb, t_degrees / 360.0 * ctx->opt.t.steps,
+                           d_degrees / 360.0 * ctx->opt.d.steps);
 }
 
 /* LX200 protocol requests that we update position.
@@ -442,100 +1429,445 @@ void bbox_cb (struct bbox *bb, void *arg)
 void lx200_pos_ha_cb (struct lx200 *lx, void *arg)
 {
     struct prog_context *ctx = arg;
-    double t;
-    double t_degrees;
+    double t_degrees, d_degrees;
 
-    if (motion_get_position (ctx->t, &t) < 0) {
-        err ("%s: error reading t position", __FUNCTION__);
+    if (get_position (ctx, &t_degrees, &d_degrees) < 0)
         return;
-    }
-    t_degrees = 360.0 * (t / ctx->opt.t.steps);
     lx200_set_position_ha (lx, t_degrees);
 }
 
 void lx200_pos_dec_cb (struct lx200 *lx, void *arg)
 {
     struct prog_context *ctx = arg;
-    double d;
-    double d_degrees;
+    double t_degrees, d_degrees;
 
-    if (motion_get_position (ctx->d, &d) < 0) {
-        err ("%s: error reading d position", __FUNCTION__);
+    if (get_position (ctx, &t_degrees, &d_degrees) < 0)
         return;
-    }
-    d_degrees = 360.0 * (d / ctx->opt.d.steps);
     lx200_set_position_dec (lx, d_degrees);
 }
 
-/* LX200 protocol notifies us that we should retrieve goto target
- * coordinates and slew there.
+/* Stellarium protocol requests that we update position.
  */
-void lx200_goto_cb (struct lx200 *lx, void *arg)
+void stellarium_pos_cb (struct stellarium *st, void *arg)
 {
     struct prog_context *ctx = arg;
     double t_degrees, d_degrees;
-    double t, d;
 
-    lx200_get_target (lx, &t_degrees, &d_degrees);
+    if (get_position (ctx, &t_degrees, &d_degrees) < 0)
+        return;
+    stellarium_set_position (st, t_degrees, d_degrees);
+}
+
+/* NexStar protocol requests that we update position.
+ */
+void nexstar_pos_cb (struct nexstar *nx, void *arg)
+{
+    struct prog_context *ctx = arg;
+    double t_degrees, d_degrees;
+
+    if (get_position (ctx, &t_degrees, &d_degrees) < 0)
+        return;
+    nexstar_set_position (nx, t_degrees, d_degrees);
+}
+
+/* INDI protocol requests that we update position.
+ */
+void indi_pos_cb (struct indi *in, void *arg)
+{
+    struct prog_context *ctx = arg;
+    double t_degrees, d_degrees;
+
+    if (get_position (ctx, &t_degrees, &d_degrees) < 0)
+        return;
+    indi_set_position (in, t_degrees, d_degrees);
+}
+
+/* Alpaca protocol's cached position is stale.
+ */
+void alpaca_pos_cb (struct alpaca *al, void *arg)
+{
+    struct prog_context *ctx = arg;
+    double t_degrees, d_degrees;
+
+    if (get_position (ctx, &t_degrees, &d_degrees) < 0)
+        return;
+    alpaca_set_position (al, t_degrees, d_degrees);
+}
+
+/* Subscription protocol requests a position and status update,
+ * to be pushed to all subscribers that are due for a frame.
+ */
+void stream_cb (struct stream *st, void *arg)
+{
+    struct prog_context *ctx = arg;
+    double t_degrees, d_degrees;
+    int status = 0;
+
+    if (get_position (ctx, &t_degrees, &d_degrees) < 0)
+        return;
+    stream_set_position (st, t_degrees, d_degrees, ctx->pos_time);
+    if (ctx->t_tracking)
+        status |= STREAM_STATUS_TRACKING;
+    if (ctx->slew)
+        status |= STREAM_STATUS_SLEWING;
+    if (ctx->t_goto || ctx->d_goto)
+        status |= STREAM_STATUS_GOTO;
+    stream_set_status (st, status);
+}
+
+/* Slew to t,d axis position in degrees.
+ * This is shared by all protocols that can initiate a goto.
+ * They all take t,d from the shared point target register, so the
+ * target is also checked against the local horizon.
+ * Returns NULL if the goto was started, else the reason it was refused.
+ */
+const char *goto_position (struct prog_context *ctx, double t_degrees,
+                           double d_degrees)
+{
+    double t, d;
 
     msg ("goto %.1f*, %.1f*", t_degrees, d_degrees);
 
+    if (!point_target_visible (ctx->point)) {
+        msg ("goto below horizon");
+        return "Object Below Horizon";
+    }
+
     if (t_degrees < -120 || t_degrees > 120
                          || d_degrees < -120 || d_degrees > 120) {
         msg ("goto out of range");
-        return;
+        return "Object Out Of Range";
+    }
+
+    /* With an envelope, positions are extrapolated during the goto so the
+     * monitor can watch it; otherwise they are unknown until read again.
+     */
+    if (ctx->envelope) {
+        double t_dps = motion_get_goto_dps (ctx->t);
+        double d_dps = motion_get_goto_dps (ctx->d);
+        double ta = t_degrees - ctx->opt.t.approach; // see axis_goto()
+        double da = d_degrees - ctx->opt.d.approach;
+        double t0, d0;
+        if (get_position (ctx, &t0, &d0) < 0)
+            return "Position Unknown";
+        if (!envelope_check_path (ctx->envelope, t0, d0, ta, da,
+                                  t_dps, d_dps)
+                || !envelope_check_path (ctx->envelope, ta, da,
+                                         t_degrees, d_degrees,
+                                         t_dps, d_dps)) {
+            msg ("goto path crosses keep-out region");
+            return "Path Crosses Keep-Out Region";
+        }
+        estimate_goto (ctx, ctx->t, t0, t_degrees);
+        estimate_goto (ctx, ctx->d, d0, d_degrees);
+    }
+    else {
+        memset (&ctx->t_est, 0, sizeof (ctx->t_est));
+        memset (&ctx->d_est, 0, sizeof (ctx->d_est));
     }
 
     t = t_degrees/360.0 * ctx->opt.t.steps;
     d = d_degrees/360.0 * ctx->opt.d.steps;
 
-    if (motion_goto_absolute (ctx->t, t) < 0)
+    guide_cancel (ctx, 0);
+    guide_cancel (ctx, 1);
+    ctx->drift.start = 0.;
+
+    if (axis_goto (ctx, ctx->t, t) < 0)
         err ("t: set position");
-    if (motion_goto_absolute (ctx->d, d) < 0)
+    else
+        ctx->t_goto = true;
+    if (axis_goto (ctx, ctx->d, d) < 0)
         err ("d: set position");
+    else
+        ctx->d_goto = true;
+    return NULL;
 }
 
-/* LX200 protocol wants to stop all motion (abort a goto).
- * Tracking should continue.
+/* LX200 protocol notifies us that we should retrieve goto target
+ * coordinates and slew there.
  */
-void lx200_stop_cb (struct lx200 *lx, void *arg)
+void lx200_goto_cb (struct lx200 *lx, void *arg)
+{
+    struct prog_context *ctx = arg;
+    double t_degrees, d_degrees;
+
+    lx200_get_target (lx, &t_degrees, &d_degrees);
+    lx200_set_goto_error (lx, goto_position (ctx, t_degrees, d_degrees));
+}
+
+/* Stellarium protocol notifies us that we should retrieve goto target
+ * coordinates and slew there.  The protocol has no reply to a goto, so
+ * a refusal is only logged.
+ */
+void stellarium_goto_cb (struct stellarium *st, void *arg)
 {
     struct prog_context *ctx = arg;
+    double t_degrees, d_degrees;
 
-    if (motion_soft_stop (ctx->t) < 0) {
+    stellarium_get_target (st, &t_degrees, &d_degrees);
+    (void)goto_position (ctx, t_degrees, d_degrees);
+}
+
+/* NexStar protocol notifies us that we should retrieve goto target
+ * coordinates and slew there.  The protocol's goto reply carries no
+ * status, so a refusal is only logged.
+ */
+void nexstar_goto_cb (struct nexstar *nx, void *arg)
+{
+    struct prog_context *ctx = arg;
+    double t_degrees, d_degrees;
+
+    nexstar_get_target (nx, &t_degrees, &d_degrees);
+    (void)goto_position (ctx, t_degrees, d_degrees);
+}
+
+/* INDI protocol notifies us that we should retrieve goto target
+ * coordinates and slew there.
+ */
+void indi_goto_cb (struct indi *in, void *arg)
+{
+    struct prog_context *ctx = arg;
+    double t_degrees, d_degrees;
+
+    indi_get_target (in, &t_degrees, &d_degrees);
+    indi_set_goto_error (in, goto_position (ctx, t_degrees, d_degrees));
+}
+
+/* Alpaca protocol notifies us that we should retrieve goto target
+ * coordinates and slew there.
+ */
+void alpaca_goto_cb (struct alpaca *al, void *arg)
+{
+    struct prog_context *ctx = arg;
+    double t_degrees, d_degrees;
+
+    alpaca_get_target (al, &t_degrees, &d_degrees);
+    alpaca_set_goto_error (al, goto_position (ctx, t_degrees, d_degrees));
+}
+
+/* Stop all motion (abort a goto).
+ * Tracking should continue.  A goto is over once the stop is commanded,
+ * not when the controllers are next polled.
+ */
+void stop_motion (struct prog_context *ctx)
+{
+    if (axis_soft_stop (ctx, ctx->t) < 0) {
         err ("t: soft stop");
-        if (motion_abort (ctx->t) < 0)
+        if (axis_abort (ctx, ctx->t) < 0)
             err ("t: abort");
     }
-    if (motion_soft_stop (ctx->d) < 0) {
+    if (axis_soft_stop (ctx, ctx->d) < 0) {
         err ("d: soft stop");
-        if (motion_abort (ctx->d) < 0)
+        if (axis_abort (ctx, ctx->d) < 0)
             err ("t: abort");
     }
+    if (ctx->t_goto)
+        estimate_reset (ctx, ctx->t);
+    if (ctx->d_goto)
+        estimate_reset (ctx, ctx->d);
+    ctx->t_goto = false;
+    ctx->d_goto = false;
     if (ctx->t_tracking)
         update_tracking (ctx);
 }
 
+/* LX200 protocol wants to stop all motion (abort a goto).
+ */
+void lx200_stop_cb (struct lx200 *lx, void *arg)
+{
+    struct prog_context *ctx = arg;
+
+    stop_motion (ctx);
+}
+
+/* NexStar protocol wants to stop all motion (cancel goto).
+ */
+void nexstar_stop_cb (struct nexstar *nx, void *arg)
+{
+    struct prog_context *ctx = arg;
+
+    stop_motion (ctx);
+}
+
+/* NexStar protocol turned RA tracking on or off.
+ */
+void nexstar_tracking_cb (struct nexstar *nx, void *arg)
+{
+    struct prog_context *ctx = arg;
+    bool tracking = nexstar_get_tracking (nx);
+
+    if (tracking != ctx->t_tracking) {
+        ctx->t_tracking = tracking;
+        update_tracking (ctx);
+    }
+}
+
+/* NexStar protocol wants to know goto and tracking status.
+ */
+void nexstar_status_cb (struct nexstar *nx, void *arg)
+{
+    struct prog_context *ctx = arg;
+
+    nexstar_set_status (nx, ctx->t_goto || ctx->d_goto, ctx->t_tracking);
+}
+
+/* INDI protocol wants to abort motion.
+ */
+void indi_stop_cb (struct indi *in, void *arg)
+{
+    struct prog_context *ctx = arg;
+
+    stop_motion (ctx);
+}
+
+/* INDI protocol turned RA tracking on or off.
+ */
+void indi_tracking_cb (struct indi *in, void *arg)
+{
+    struct prog_context *ctx = arg;
+    bool tracking = indi_get_tracking (in);
+
+    if (tracking != ctx->t_tracking) {
+        ctx->t_tracking = tracking;
+        update_tracking (ctx);
+    }
+}
+
+/* INDI protocol wants to know goto and tracking status.
+ */
+void indi_status_cb (struct indi *in, void *arg)
+{
+    struct prog_context *ctx = arg;
+
+    indi_set_status (in, ctx->t_goto || ctx->d_goto, ctx->t_tracking);
+}
+
+/* Alpaca protocol wants to abort a slew.
+ */
+void alpaca_stop_cb (struct alpaca *al, void *arg)
+{
+    struct prog_context *ctx = arg;
+
+    stop_motion (ctx);
+}
+
+/* Alpaca protocol turned RA tracking on or off.
+ */
+void alpaca_tracking_cb (struct alpaca *al, void *arg)
+{
+    struct prog_context *ctx = arg;
+    bool tracking = alpaca_get_tracking (al);
+
+    if (tracking != ctx->t_tracking) {
+        ctx->t_tracking = tracking;
+        update_tracking (ctx);
+    }
+}
+
+/* Alpaca protocol wants to know slewing and tracking status.
+ */
+void alpaca_status_cb (struct alpaca *al, void *arg)
+{
+    struct prog_context *ctx = arg;
+
+    alpaca_set_status (al, ctx->t_goto || ctx->d_goto || ctx->slew != 0,
+                       ctx->t_tracking);
+}
+
 /* LX200 protocol wants to know current RA tracking rate.
+ * This is the rate from the pointing model, not nominal sidereal.
  */
 void lx200_tracking_cb (struct lx200 *lx, void *arg)
 {
     struct prog_context *ctx = arg;
-    lx200_set_tracking_rate (lx, ctx->t_tracking ? ctx->opt.t.sidereal : 0);
+    lx200_set_tracking_rate (lx, track_rate (ctx, 0));
 }
 
 /* Motion axis informs us that goto has completed.
- * Goto cancels the constant velocity motion of RA tracking,
+ * Goto cancels the constant velocity motion of tracking,
  * so resume it here if enabled.
  * FIXME: need to account for lost tracking for the duration of the goto.
  */
 void motion_cb (struct motion *m, void *arg)
 {
     struct prog_context *ctx = arg;
+    struct backlash *b = axis_backlash (ctx, m);
 
+    if (b->approach != 0.) {
+        double offset = b->approach;
+
+        b->approach = 0.;
+        if (ctx->motion_debug)
+            msg ("%s: final approach %+.2f steps", motion_get_name (m), offset);
+        if (motion_goto_relative (m, offset) == 0)
+            return;
+        err ("%s: final approach", motion_get_name (m));
+    }
     msg ("%s: goto end", motion_get_name (m));
-    if (m == ctx->t && ctx->t_tracking)
+    estimate_reset (ctx, m);
+    if (m == ctx->t)
+        ctx->t_goto = false;
+    else
+        ctx->d_goto = false;
+    if (ctx->t_tracking)
+        update_tracking (ctx);
+}
+
+/* Check extrapolated axis positions against the mechanical envelope.
+ * The controllers are only queried when an estimate is unknown; gotos,
+ * also checked before they start, are extrapolated at the goto rates.
+ * If the position 'lookahead' seconds out would enter a keep-out region,
+ * or, from inside one, would be deeper in it, a goto or slew is stopped
+ * (resuming tracking), then on a later check, tracking.  Only motion
+ * that backs out of a region is allowed to continue inside it.
+ */
+void envelope_cb (struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct prog_context *ctx = (struct prog_context *)((char *)w
+                            - offsetof (struct prog_context, envelope_w));
+    double now = ev_now (loop);
+    double t, d, t1, d1, depth, lookahead;
+
+    if (ctx->t_est.time == 0. || ctx->d_est.time == 0.) {
+        if (get_position (ctx, &t, &d) < 0)
+            return;
+        if (ctx->t_est.time == 0. || ctx->d_est.time == 0.)
+            return; // goto axis without an estimate
+    }
+    if (ctx->t_est.vel == 0. && ctx->d_est.vel == 0.)
+        return;
+    t = estimate_position (&ctx->t_est, now);
+    d = estimate_position (&ctx->d_est, now);
+    lookahead = ctx->opt.envelope_lookahead;
+    t1 = estimate_position (&ctx->t_est, now + lookahead);
+    d1 = estimate_position (&ctx->d_est, now + lookahead);
+    depth = envelope_depth (ctx->envelope, t, d);
+    if (depth == 0.) {
+        if (envelope_check (ctx->envelope, t1, d1))
+            return;
+    }
+    else if (envelope_depth (ctx->envelope, t1, d1) <= depth)
+        return; // not going deeper
+
+    if (ctx->t_goto || ctx->d_goto) {
+        msg ("envelope: stopping goto at %.1f*, %.1f*", t, d);
+        stop_motion (ctx);
+    }
+    else if (ctx->slew) {
+        msg ("envelope: stopping slew at %.1f*, %.1f*", t, d);
+        slew_update (ctx, 0, SLEW_RATE_NONE);
+    }
+    else {
+        msg ("envelope: stopping tracking at %.1f*, %.1f*", t, d);
+        ctx->t_tracking = false;
         update_tracking (ctx);
+        if (ctx->d_est.vel != 0. && axis_soft_stop (ctx, ctx->d) < 0) {
+            err ("d: stop");
+            if (axis_abort (ctx, ctx->d) < 0)
+                err ("d: abort");
+        }
+    }
 }
 
 /*
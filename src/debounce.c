@@ -0,0 +1,220 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "xzmalloc.h"
+#include "debounce.h"
+
+/* The settle time never drops below this (sec), and is set to this
+ * multiple of the longest recent bounce, which decays by 'bounce_decay'
+ * on each clean change so a pin that stops bouncing speeds up again.
+ */
+static const double settle_min = 1E-3;
+static const double settle_margin = 2.;
+static const double bounce_decay = 0.9;
+
+struct pin {
+    int val;                // accepted level
+    double edge;            // time of first edge of the change to 'val'
+    int raw;                // raw level after the last edge
+    double t;               // time the integral was last advanced
+    double acc;             // time integrated away from 'val' (sec)
+    double peak;            // peak of 'acc' in the current burst
+    double start;           // first edge of the current burst, 0 = none
+    double last;            // last edge of the current burst
+    double bounce;          // decaying longest bounce or glitch (sec)
+    struct debounce_stats stats;
+};
+
+struct debounce {
+    int n;
+    double max;
+    struct pin *pins;
+};
+
+static void pin_adapt (struct debounce *d, struct pin *p, double span)
+{
+    p->bounce = fmax (span, p->bounce * bounce_decay);
+    if (span > p->stats.bounce)
+        p->stats.bounce = span;
+    p->stats.settle = fmin (fmax (settle_margin * p->bounce, settle_min),
+                            d->max);
+}
+
+/* Advance the integral of pin 'p' to 'time', accepting a change if the
+ * integral reaches the settle time on the way.
+ */
+static int pin_advance (struct debounce *d, struct pin *p, double time)
+{
+    double dt = time - p->t;
+    int changed = 0;
+
+    if (dt < 0.)
+        return 0;
+    if (p->raw != p->val) {
+        if (p->acc + dt >= p->stats.settle - 1E-9) {
+            p->val = p->raw;
+            p->edge = p->start;
+            p->stats.changes++;
+            pin_adapt (d, p, p->last - p->start);
+            p->acc = 0.;
+            p->start = 0.;
+            changed = 1;
+        }
+        else {
+            p->acc += dt;
+            if (p->acc > p->peak)
+                p->peak = p->acc;
+        }
+    }
+    else if (p->start != 0.) {
+        p->acc = fmax (p->acc - dt, 0.);
+        if (time - p->last >= p->stats.settle) {
+            p->stats.glitches++;
+            pin_adapt (d, p, p->peak);
+            p->acc = 0.;
+            p->start = 0.;
+        }
+    }
+    p->t = time;
+    return changed;
+}
+
+struct debounce *debounce_new (int n, double max)
+{
+    struct debounce *d = xzmalloc (sizeof (*d));
+    int i;
+
+    d->n = n;
+    d->max = fmax (max, 0.);
+    d->pins = xzmalloc (n * sizeof (d->pins[0]));
+    for (i = 0; i < n; i++)
+        debounce_reset (d, i, 0, 0.);
+    return d;
+}
+
+void debounce_destroy (struct debounce *d)
+{
+    if (d) {
+        free (d->pins);
+        free (d);
+    }
+}
+
+void debounce_reset (struct debounce *d, int i, int val, double time)
+{
+    struct pin *p = &d->pins[i];
+
+    p->val = p->raw = val;
+    p->edge = p->t = time;
+    p->acc = p->peak = 0.;
+    p->start = p->last = 0.;
+    p->bounce = d->max / settle_margin;
+    p->stats.settle = d->max;
+}
+
+void debounce_edge (struct debounce *d, int i, int val, double time)
+{
+    struct pin *p = &d->pins[i];
+
+    pin_advance (d, p, time);
+    if (val == p->raw)
+        return;
+    p->raw = val;
+    p->stats.edges++;
+    if (p->start == 0. && val != p->val) {
+        p->start = time;
+        p->peak = 0.;
+    }
+    p->last = time;
+    pin_advance (d, p, time); // accept now if settle time is zero
+}
+
+int debounce_update (struct debounce *d, double now)
+{
+    int i, mask = 0;
+
+    for (i = 0; i < d->n; i++) {
+        if (pin_advance (d, &d->pins[i], now))
+            mask |= (1<<i);
+    }
+    return mask;
+}
+
+int debounce_get (struct debounce *d, int i, double *edge)
+{
+    if (edge)
+        *edge = d->pins[i].edge;
+    return d->pins[i].val;
+}
+
+int debounce_get_mask (struct debounce *d)
+{
+    int i, mask = 0;
+
+    for (i = 0; i < d->n; i++) {
+        if (d->pins[i].val)
+            mask |= (1<<i);
+    }
+    return mask;
+}
+
+int debounce_get_pending (struct debounce *d)
+{
+    int i, mask = 0;
+
+    for (i = 0; i < d->n; i++) {
+        if (d->pins[i].raw != d->pins[i].val)
+            mask |= (1<<i);
+    }
+    return mask;
+}
+
+double debounce_next (struct debounce *d)
+{
+    double next = 0.;
+    int i;
+
+    for (i = 0; i < d->n; i++) {
+        struct pin *p = &d->pins[i];
+        if (p->raw != p->val) {
+            double t = p->t + p->stats.settle - p->acc;
+            if (next == 0. || t < next)
+                next = t;
+        }
+    }
+    return next;
+}
+
+void debounce_get_stats (struct debounce *d, int i,
+                         struct debounce_stats *st)
+{
+    *st = d->pins[i].stats;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
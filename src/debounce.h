@@ -0,0 +1,66 @@
+/* Integrating debounce of timestamped input edges
+ *
+ * Each pin integrates the time its raw level has spent away from the
+ * accepted level, and decays while back at it.  A change is accepted as
+ * soon as the integral reaches the pin's settle time, with the time of
+ * the first edge of the burst, so a clean edge costs only the settle
+ * time and a glitch shorter than it is rejected once the pin has been
+ * quiet for the settle time.  The settle time adapts
+ * between a floor and the configured maximum, to twice the longest
+ * recent bounce or glitch seen on that pin.  Nothing here reads a clock;
+ * callers pass CLOCK_MONOTONIC times (sec) from their edge events.
+ */
+
+struct debounce;
+
+struct debounce_stats {
+    unsigned long edges;    // raw edges seen
+    unsigned long changes;  // accepted level changes
+    unsigned long glitches; // bursts rejected without a change
+    double bounce;          // longest bounce or glitch seen (sec)
+    double settle;          // current settle time (sec)
+};
+
+/* Create debounce state for 'n' pins, with settle time at most 'max'.
+ */
+struct debounce *debounce_new (int n, double max);
+void debounce_destroy (struct debounce *d);
+
+/* Set pin 'i' to level 'val' at 'time' with no change pending.
+ */
+void debounce_reset (struct debounce *d, int i, int val, double time);
+
+/* Feed a raw edge to level 'val' on pin 'i' at 'time'.
+ * Edges on a pin must be fed in time order.
+ */
+void debounce_edge (struct debounce *d, int i, int val, double time);
+
+/* Accept any changes confirmed by 'now'.  Returns a mask of the pins
+ * whose accepted level changed.
+ */
+int debounce_update (struct debounce *d, double now);
+
+/* Get accepted level of pin 'i', and if 'edge' is non-NULL, the time
+ * of the first edge of the burst that set it.
+ */
+int debounce_get (struct debounce *d, int i, double *edge);
+
+/* Get accepted levels of all pins as a mask.
+ */
+int debounce_get_mask (struct debounce *d);
+
+/* Get mask of pins with a change pending.
+ */
+int debounce_get_pending (struct debounce *d);
+
+/* Get the earliest time a pending change could be accepted,
+ * or 0 if none is pending.
+ */
+double debounce_next (struct debounce *d);
+
+void debounce_get_stats (struct debounce *d, int i,
+                         struct debounce_stats *st);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,187 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "envelope.h"
+
+#define CELLS_PER_DEGREE    2
+#define CELLS               (360 * CELLS_PER_DEGREE)  // per axis
+
+struct envelope {
+    uint8_t map[CELLS * CELLS / 8]; // bit set = keep out, t major
+};
+
+static int wrap_index (int i)
+{
+    return ((i % CELLS) + CELLS) % CELLS;
+}
+
+static int cell_index (double deg)
+{
+    return wrap_index ((int)floor ((deg + 180.) * CELLS_PER_DEGREE));
+}
+
+static bool test_cell (struct envelope *e, int ti, int di)
+{
+    int bit = ti * CELLS + di;
+
+    return (e->map[bit >> 3] & (1 << (bit & 7))) != 0;
+}
+
+static void set_cell (struct envelope *e, int ti, int di)
+{
+    int bit = ti * CELLS + di;
+
+    e->map[bit >> 3] |= 1 << (bit & 7);
+}
+
+static void add_rect (struct envelope *e, double tmin, double tmax,
+                      double dmin, double dmax)
+{
+    int t0 = (int)floor ((tmin + 180.) * CELLS_PER_DEGREE);
+    int t1 = (int)ceil ((tmax + 180.) * CELLS_PER_DEGREE);
+    int d0 = (int)floor ((dmin + 180.) * CELLS_PER_DEGREE);
+    int d1 = (int)ceil ((dmax + 180.) * CELLS_PER_DEGREE);
+    int ti, di;
+
+    for (ti = t0; ti < t1 && ti < CELLS; ti++)
+        for (di = d0; di < d1 && di < CELLS; di++)
+            set_cell (e, ti, di);
+}
+
+int envelope_add_keepout (struct envelope *e, const char *spec)
+{
+    const char *s = spec + strspn (spec, " \t");
+
+    while (*s != '\0') {
+        double tmin, tmax, dmin, dmax;
+        int len = 0;
+
+        if (sscanf (s, "%lf:%lf/%lf:%lf%n", &tmin, &tmax, &dmin, &dmax,
+                    &len) != 4 || len == 0
+                || tmin < -180. || tmax > 180. || tmin >= tmax
+                || dmin < -180. || dmax > 180. || dmin >= dmax)
+            return -1;
+        add_rect (e, tmin, tmax, dmin, dmax);
+        s += len;
+        if (*s != '\0' && !strchr (" \t", *s))
+            return -1;
+        s += strspn (s, " \t");
+    }
+    return 0;
+}
+
+bool envelope_check (struct envelope *e, double t, double d)
+{
+    return !test_cell (e, cell_index (t), cell_index (d));
+}
+
+/* Distance, in cells, from (x,y) to the nearest point of cell (ti,di).
+ */
+static double cell_distance (double x, double y, int ti, int di)
+{
+    double dx = fmax (fmax (ti - x, x - (ti + 1)), 0.);
+    double dy = fmax (fmax (di - y, y - (di + 1)), 0.);
+
+    return hypot (dx, dy);
+}
+
+/* Search square rings of cells around the one containing the point.
+ * Every cell on ring r is at least r - 1 cells away, so the search
+ * stops once that exceeds the nearest free cell found.
+ */
+double envelope_depth (struct envelope *e, double t, double d)
+{
+    double x = (t + 180.) * CELLS_PER_DEGREE;
+    double y = (d + 180.) * CELLS_PER_DEGREE;
+    int xi = (int)floor (x), yi = (int)floor (y);
+    double best = HUGE_VAL;
+    int r, i;
+
+    if (!test_cell (e, wrap_index (xi), wrap_index (yi)))
+        return 0.;
+    for (r = 1; r <= CELLS / 2 && r - 1 < best; r++) {
+        for (i = -r; i <= r; i++) {
+            int ti[4] = { xi + i, xi + i, xi - r, xi + r };
+            int di[4] = { yi - r, yi + r, yi + i, yi + i };
+            int k;
+
+            for (k = 0; k < 4; k++) {
+                if (k >= 2 && (i == -r || i == r))
+                    continue; // corners were done by the rows
+                if (!test_cell (e, wrap_index (ti[k]), wrap_index (di[k])))
+                    best = fmin (best, cell_distance (x, y, ti[k], di[k]));
+            }
+        }
+    }
+    return best / CELLS_PER_DEGREE;
+}
+
+/* Sample the segment at half cell intervals.
+ */
+static bool check_segment (struct envelope *e, double t0, double d0,
+                           double t1, double d1)
+{
+    double len = fmax (fabs (t1 - t0), fabs (d1 - d0));
+    int i, n = (int)ceil (len * CELLS_PER_DEGREE * 2);
+
+    for (i = 0; i <= n; i++) {
+        double f = n > 0 ? (double)i / n : 0.;
+        if (!envelope_check (e, t0 + f * (t1 - t0), d0 + f * (d1 - d0)))
+            return false;
+    }
+    return true;
+}
+
+bool envelope_check_path (struct envelope *e, double t0, double d0,
+                          double t1, double d1, double t_dps, double d_dps)
+{
+    double dt = t1 - t0, dd = d1 - d0;
+    double m = fmin (fabs (dt) / t_dps, fabs (dd) / d_dps); // first arrival
+    double tk = t0 + copysign (fmin (fabs (dt), m * t_dps), dt);
+    double dk = d0 + copysign (fmin (fabs (dd), m * d_dps), dd);
+
+    return check_segment (e, t0, d0, tk, dk)
+        && check_segment (e, tk, dk, t1, d1);
+}
+
+struct envelope *envelope_new (void)
+{
+    return calloc (1, sizeof (struct envelope));
+}
+
+void envelope_destroy (struct envelope *e)
+{
+    free (e);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
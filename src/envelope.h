@@ -0,0 +1,44 @@
+/* Mechanical safety envelope
+ *
+ * Keep-out regions are rectangles in axis coordinates (t,d degrees, as
+ * sent to the motion controllers), e.g. where the tube would strike the
+ * pier.  They are rasterized into a bitmap over the whole axis space at
+ * 0.5 degree resolution, rounding outward, so a check is a shift and a
+ * mask and can run at a high rate against extrapolated positions.
+ */
+
+#include <stdbool.h>
+
+struct envelope;
+
+struct envelope *envelope_new (void);
+void envelope_destroy (struct envelope *e);
+
+/* Add keep-out rectangles from a white space separated list of
+ * "tmin:tmax/dmin:dmax" in degrees, within [-180,180].
+ * Returns 0 on success, -1 on parse error (earlier rectangles are kept).
+ */
+int envelope_add_keepout (struct envelope *e, const char *spec);
+
+/* Return true if axis position (t,d) is outside all keep-out regions.
+ */
+bool envelope_check (struct envelope *e, double t, double d);
+
+/* Return how far (degrees) axis position (t,d) is inside a keep-out
+ * region, i.e. the distance to the nearest point outside all of them,
+ * or 0 if it is outside.
+ */
+double envelope_depth (struct envelope *e, double t, double d);
+
+/* Return true if a goto from (t0,d0) to (t1,d1) stays outside all
+ * keep-out regions.  The axes move independently at their goto rates
+ * (t_dps,d_dps), so the path is checked as both axes moving until the
+ * first arrives, then the other alone.  Acceleration is not modeled;
+ * keep-out regions should include some margin for it.
+ */
+bool envelope_check_path (struct envelope *e, double t0, double d0,
+                          double t1, double d1, double t_dps, double d_dps);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
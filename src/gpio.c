@@ -30,6 +30,12 @@
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <linux/gpio.h>
 
 #include "gpio.h"
 
@@ -37,6 +43,21 @@
 #define PATH_MAX    1024
 #endif
 #define INTBUFLEN   16
+#define GROUP_MAX   32
+
+struct gpio_group {
+    int n;
+    int pins[GROUP_MAX];
+    bool active_low;
+    bool chardev;
+    int fd;                 // chardev line request, or sysfs epoll fd
+    uint32_t offsets[GROUP_MAX]; // chardev line offsets
+    int vfd[GROUP_MAX];     // sysfs value fds
+    int last;               // sysfs levels at last event
+    struct gpio_event pending[GROUP_MAX]; // sysfs events not yet read
+    int npending;
+    int next;
+};
 
 int gpio_set_export (int pin, bool val)
 {
@@ -181,6 +202,362 @@ int gpio_open (int pin, int mode)
     return open (path, mode);
 }
 
+static double monotime (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static int read_int (const char *path, int *val)
+{
+    FILE *fp;
+    int rc = -1;
+
+    if (!(fp = fopen (path, "r")))
+        goto done;
+    if (fscanf (fp, "%d", val) != 1) {
+        (void)fclose (fp);
+        errno = EINVAL;
+        goto done;
+    }
+    (void)fclose (fp);
+    rc = 0;
+done:
+    return rc;
+}
+
+/* Find the character device for sysfs gpiochip 'name' by its device link.
+ */
+static int find_chardev (const char *name, char *path, size_t len)
+{
+    char devdir[PATH_MAX];
+    DIR *d;
+    struct dirent *ent;
+    int rc = -1;
+
+    snprintf (devdir, sizeof (devdir), "/sys/class/gpio/%s/device", name);
+    if (!(d = opendir (devdir)))
+        goto done;
+    while ((ent = readdir (d))) {
+        if (!strncmp (ent->d_name, "gpiochip", 8)) {
+            snprintf (path, len, "/dev/%s", ent->d_name);
+            rc = 0;
+            break;
+        }
+    }
+    (void)closedir (d);
+    if (rc < 0)
+        errno = ENODEV;
+done:
+    return rc;
+}
+
+/* Map global pin number to character device 'path' and line 'offset',
+ * using the base and size of each gpiochip in sysfs.
+ */
+static int chip_lookup (int pin, char *path, size_t len, uint32_t *offset)
+{
+    char file[PATH_MAX];
+    DIR *d;
+    struct dirent *ent;
+    int rc = -1;
+
+    if (!(d = opendir ("/sys/class/gpio")))
+        goto done;
+    errno = ENODEV;
+    while ((ent = readdir (d))) {
+        int base, ngpio;
+        if (sscanf (ent->d_name, "gpiochip%d", &base) != 1)
+            continue;
+        snprintf (file, sizeof (file), "/sys/class/gpio/%s/ngpio",
+                  ent->d_name);
+        if (read_int (file, &ngpio) < 0)
+            continue;
+        if (pin < base || pin >= base + ngpio)
+            continue;
+        if (find_chardev (ent->d_name, path, len) == 0) {
+            *offset = pin - base;
+            rc = 0;
+        }
+        break;
+    }
+    (void)closedir (d);
+done:
+    return rc;
+}
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+static int chardev_open (struct gpio_group *g, const char *consumer)
+{
+    struct gpio_v2_line_request req;
+    char path[PATH_MAX], chip[PATH_MAX];
+    int i, fd, rc = -1;
+
+    memset (&req, 0, sizeof (req));
+    for (i = 0; i < g->n; i++) {
+        if (chip_lookup (g->pins[i], path, sizeof (path), &g->offsets[i]) < 0)
+            goto done;
+        if (i == 0)
+            snprintf (chip, sizeof (chip), "%s", path);
+        else if (strcmp (chip, path) != 0) { // one request per chip
+            errno = EXDEV;
+            goto done;
+        }
+        req.offsets[i] = g->offsets[i];
+    }
+    req.num_lines = g->n;
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT
+                     | GPIO_V2_LINE_FLAG_EDGE_RISING
+                     | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    if (g->active_low)
+        req.config.flags |= GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+    snprintf (req.consumer, sizeof (req.consumer), "%s", consumer);
+    if ((fd = open (chip, O_RDONLY | O_CLOEXEC)) < 0)
+        goto done;
+    if (ioctl (fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0) {
+        int saved_errno = errno;
+        (void)close (fd);
+        errno = saved_errno;
+        goto done;
+    }
+    (void)close (fd);
+    if (fcntl (req.fd, F_SETFL, fcntl (req.fd, F_GETFL) | O_NONBLOCK) < 0) {
+        int saved_errno = errno;
+        (void)close (req.fd);
+        errno = saved_errno;
+        goto done;
+    }
+    g->fd = req.fd;
+    g->chardev = true;
+    rc = 0;
+done:
+    return rc;
+}
+
+static int chardev_read (struct gpio_group *g, int *mask)
+{
+    struct gpio_v2_line_values v;
+
+    memset (&v, 0, sizeof (v));
+    v.mask = (1ULL << g->n) - 1;
+    if (ioctl (g->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &v) < 0)
+        return -1;
+    *mask = v.bits;
+    return 0;
+}
+
+static int chardev_read_event (struct gpio_group *g, struct gpio_event *ev)
+{
+    struct gpio_v2_line_event e;
+    int i, n;
+
+    n = read (g->fd, &e, sizeof (e));
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        return -1;
+    }
+    if (n != sizeof (e)) {
+        errno = EIO;
+        return -1;
+    }
+    for (i = 0; i < g->n; i++) {
+        if (g->offsets[i] == e.offset)
+            break;
+    }
+    if (i == g->n) {
+        errno = EIO;
+        return -1;
+    }
+    ev->line = i;
+    ev->val = (e.id == GPIO_V2_LINE_EVENT_RISING_EDGE);
+    ev->time = e.timestamp_ns * 1E-9;
+    return 1;
+}
+#else
+static int chardev_open (struct gpio_group *g, const char *consumer)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static int chardev_read (struct gpio_group *g, int *mask)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static int chardev_read_event (struct gpio_group *g, struct gpio_event *ev)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
+static int sysfs_read (struct gpio_group *g, int *mask)
+{
+    int i, val, code = 0;
+
+    for (i = 0; i < g->n; i++) {
+        if (gpio_read (g->vfd[i], &val) < 0)
+            return -1;
+        code |= (val<<i);
+    }
+    *mask = code;
+    return 0;
+}
+
+/* On failure, pins exported so far are unexported again.
+ */
+static int sysfs_open (struct gpio_group *g)
+{
+    struct epoll_event e;
+    int i, exported = 0, rc = -1;
+
+    if ((g->fd = epoll_create (g->n)) < 0) /* need this because libev */
+        goto done;                         /*   doesn't grok POLLPRI */
+    for (i = 0; i < g->n; i++) {
+        int pin = g->pins[i];
+        if (gpio_set_export (pin, true) < 0)
+            goto done;
+        exported++;
+        if (gpio_set_direction (pin, "in") < 0)
+            goto done;
+        if (gpio_set_edge (pin, "both") < 0)
+            goto done;
+        if (gpio_set_polarity (pin, !g->active_low) < 0)
+            goto done;
+        if ((g->vfd[i] = gpio_open (pin, O_RDONLY)) < 0)
+            goto done;
+        memset (&e, 0, sizeof (e));
+        e.data.fd = g->vfd[i];
+        e.events = EPOLLPRI;
+        if (epoll_ctl (g->fd, EPOLL_CTL_ADD, g->vfd[i], &e) < 0)
+            goto done;
+    }
+    if (sysfs_read (g, &g->last) < 0)
+        goto done;
+    rc = 0;
+done:
+    if (rc < 0) {
+        int saved_errno = errno;
+        for (i = 0; i < exported; i++) {
+            if (g->vfd[i] != -1) {
+                (void)close (g->vfd[i]);
+                g->vfd[i] = -1;
+            }
+            (void)gpio_set_export (g->pins[i], false);
+        }
+        if (g->fd != -1) {
+            (void)close (g->fd);
+            g->fd = -1;
+        }
+        errno = saved_errno;
+    }
+    return rc;
+}
+
+/* Drain epoll notifications, then read levels once, queueing an event
+ * for each pin that changed.
+ */
+static int sysfs_read_event (struct gpio_group *g, struct gpio_event *ev)
+{
+    struct epoll_event e[GROUP_MAX];
+    int i, mask, n;
+    double now;
+
+    if (g->next == g->npending) {
+        g->next = g->npending = 0;
+        if ((n = epoll_wait (g->fd, e, g->n, 0)) < 0)
+            return -1;
+        if (n == 0)
+            return 0;
+        if (sysfs_read (g, &mask) < 0)
+            return -1;
+        now = monotime ();
+        for (i = 0; i < g->n; i++) {
+            if (((mask ^ g->last) & (1<<i))) {
+                struct gpio_event *p = &g->pending[g->npending++];
+                p->line = i;
+                p->val = (mask >> i) & 1;
+                p->time = now;
+            }
+        }
+        g->last = mask;
+        if (g->npending == 0)
+            return 0;
+    }
+    *ev = g->pending[g->next++];
+    return 1;
+}
+
+struct gpio_group *gpio_group_open (const int *pins, int n, bool active_low,
+                                    const char *consumer)
+{
+    struct gpio_group *g;
+    int i;
+
+    if (n < 1 || n > GROUP_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!(g = calloc (1, sizeof (*g))))
+        return NULL;
+    g->n = n;
+    g->active_low = active_low;
+    g->fd = -1;
+    for (i = 0; i < n; i++) {
+        g->pins[i] = pins[i];
+        g->vfd[i] = -1;
+    }
+    if (chardev_open (g, consumer) < 0 && sysfs_open (g) < 0) {
+        int saved_errno = errno;
+        gpio_group_close (g);
+        errno = saved_errno;
+        return NULL;
+    }
+    return g;
+}
+
+void gpio_group_close (struct gpio_group *g)
+{
+    int i;
+
+    if (g) {
+        if (g->fd != -1)
+            (void)close (g->fd);
+        for (i = 0; i < g->n; i++) {
+            if (g->vfd[i] != -1) {
+                (void)close (g->vfd[i]);
+                (void)gpio_set_export (g->pins[i], false);
+            }
+        }
+        free (g);
+    }
+}
+
+int gpio_group_get_fd (struct gpio_group *g)
+{
+    return g->fd;
+}
+
+int gpio_group_read (struct gpio_group *g, int *mask)
+{
+    return g->chardev ? chardev_read (g, mask) : sysfs_read (g, mask);
+}
+
+int gpio_group_read_event (struct gpio_group *g, struct gpio_event *ev)
+{
+    return g->chardev ? chardev_read_event (g, ev) : sysfs_read_event (g, ev);
+}
+
+bool gpio_group_is_chardev (struct gpio_group *g)
+{
+    return g->chardev;
+}
+
 /*
  * vi:tabstop=4 shiftwidth=4 expandtab
  */
@@ -33,6 +33,49 @@ int gpio_read (int fd, int *val);
  */
 int gpio_write (int fd, int val);
 
+/* Input groups
+ *
+ * A group of up to 32 input pins (global sysfs numbers) with edge
+ * detection on both edges.  If the pins are on one GPIO character device
+ * (gpiochip), they are taken with a single v2 line request: all levels
+ * are read with one ioctl and edge events carry kernel timestamps.
+ * Otherwise the sysfs interface above is used and events are synthesized
+ * from level changes, timestamped when they are read.
+ */
+
+struct gpio_group;
+
+struct gpio_event {
+    int line;           // index of pin in group
+    int val;            // logical level after the edge
+    double time;        // CLOCK_MONOTONIC (sec)
+};
+
+/* Request 'n' pins as inputs.  If 'active_low', logical levels are
+ * inverted.  'consumer' labels the lines (chardev only).
+ * Returns NULL on failure with errno set.
+ */
+struct gpio_group *gpio_group_open (const int *pins, int n, bool active_low,
+                                    const char *consumer);
+void gpio_group_close (struct gpio_group *g);
+
+/* Get file descriptor that becomes readable when events are pending.
+ */
+int gpio_group_get_fd (struct gpio_group *g);
+
+/* Read all levels, bit i = pin i.
+ */
+int gpio_group_read (struct gpio_group *g, int *mask);
+
+/* Get next pending edge event.
+ * Returns 1 if 'ev' was filled in, 0 if none are pending, -1 on error.
+ */
+int gpio_group_read_event (struct gpio_group *g, struct gpio_event *ev);
+
+/* Return true if the group uses the character device (kernel timestamps).
+ */
+bool gpio_group_is_chardev (struct gpio_group *g);
+
 /*
  * vi:tabstop=4 shiftwidth=4 expandtab
  */
@@ -0,0 +1,153 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* Print the guide pulse ring file written by gem-controld ([guide]
+ * stats_file), oldest pulse first, or replay it through the guide
+ * statistics for a per-axis summary.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <libgen.h>
+#include <time.h>
+#include <math.h>
+
+#include "log.h"
+#include "guidestat.h"
+
+#define OPTIONS "+si:h"
+static const struct option longopts[] = {
+    {"summary",              no_argument,       0, 's'},
+    {"interval",             required_argument, 0, 'i'},
+    {"help",                 no_argument,       0, 'h'},
+    {0, 0, 0, 0},
+};
+
+static void usage (void)
+{
+    fprintf (stderr,
+"Usage: guidedump [OPTIONS] FILE\n"
+"    -s,--summary        print per-axis statistics instead of pulses\n"
+"    -i,--interval SEC   spectrum bin interval for --summary (default 2)\n"
+);
+    exit (1);
+}
+
+static void print_summary (struct guidestat *gs)
+{
+    struct guidestat_axis a;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        guidestat_get (gs, i, &a);
+        printf ("%s: %lu pulses, %.1fs, net %+.1f\", rms %.2f\","
+                " peak %.2f\" at %.0fs\n", i == 0 ? "t" : "d", a.count,
+                a.duration, a.net, a.rms, a.amplitude, a.period);
+    }
+}
+
+int main (int argc, char *argv[])
+{
+    int ch;
+    bool summary = false;
+    double interval = 2.;
+    struct guidestat_header hdr;
+    struct guidestat_record rec;
+    struct guidestat *gs = NULL;
+    FILE *f;
+    uint32_t i;
+
+    log_init (basename (argv[0]));
+
+    while ((ch = getopt_long (argc, argv, OPTIONS, longopts, NULL)) != -1) {
+        switch (ch) {
+            case 's':   /* --summary */
+                summary = true;
+                break;
+            case 'i':   /* --interval SEC */
+                interval = strtod (optarg, NULL);
+                break;
+            case 'h':   /* --help */
+            default:
+                usage ();
+        }
+    }
+    if (optind != argc - 1 || interval <= 0)
+        usage ();
+    if (!(f = fopen (argv[optind], "r")))
+        err_exit ("%s", argv[optind]);
+    if (fread (&hdr, sizeof (hdr), 1, f) != 1
+                || strcmp (hdr.magic, GUIDESTAT_MAGIC) != 0
+                || hdr.nrecords == 0 || hdr.next >= hdr.nrecords)
+        msg_exit ("%s: not a guide ring file", argv[optind]);
+    if (summary)
+        gs = guidestat_new (interval);
+
+    /* Oldest record is at 'next' once the ring has wrapped.
+     * Unwritten records are all zero.
+     */
+    for (i = 0; i < hdr.nrecords; i++) {
+        uint32_t idx = (hdr.next + i) % hdr.nrecords;
+        double start;
+
+        if (fseek (f, sizeof (hdr) + (long)idx * sizeof (rec), SEEK_SET) < 0
+                || fread (&rec, sizeof (rec), 1, f) != 1)
+            err_exit ("%s: read", argv[optind]);
+        if (rec.time == 0)
+            continue;
+        start = rec.time * 1E-6;
+        if (gs)
+            guidestat_pulse (gs, rec.axis, start, NAN, rec.duration * 1E-3,
+                             rec.correction / 3600E3);
+        else {
+            time_t sec = start;
+            struct tm tm;
+            char buf[32];
+            gmtime_r (&sec, &tm);
+            strftime (buf, sizeof (buf), "%Y-%m-%dT%H:%M:%S", &tm);
+            printf ("%s.%03dZ %s %5ums %+8.3f\"", buf,
+                    (int)((rec.time / 1000) % 1000),
+                    rec.axis == 0 ? "t" : "d", rec.duration,
+                    rec.correction * 1E-3);
+            if (rec.position != GUIDESTAT_NOPOS)
+                printf (" at %.6f*", rec.position * 1E-6);
+            printf ("\n");
+        }
+    }
+    (void)fclose (f);
+    if (gs) {
+        print_summary (gs);
+        guidestat_destroy (gs);
+    }
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,249 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "xzmalloc.h"
+#include "guidestat.h"
+
+#define NBINS   (GUIDESTAT_SAMPLES / 2 + 1)
+
+/* Sliding DFT: when a bin x enters and the oldest x' leaves the window,
+ * X[k] = (X[k] + x - x') * exp (2*pi*i*k/N), so each bin costs N/2
+ * complex multiply-adds.
+ */
+struct axis {
+    unsigned long count;
+    double duration;
+    double net;             // arcsec
+    double sumsq;           // arcsec^2
+    double bin;             // correction in the open bin (arcsec)
+    double x[GUIDESTAT_SAMPLES]; // closed bins, circular
+    double re[NBINS], im[NBINS];
+};
+
+struct guidestat {
+    double interval;
+    double bin_start;       // start of the open bin, 0 = not started
+    int head;               // index of the oldest closed bin
+    double cos_k[NBINS], sin_k[NBINS];
+    struct axis axes[2];
+    int fd;                 // ring file, -1 = none
+    struct guidestat_header hdr;
+};
+
+struct guidestat *guidestat_new (double interval)
+{
+    struct guidestat *gs = xzmalloc (sizeof (*gs));
+    int k;
+
+    gs->interval = interval;
+    gs->fd = -1;
+    for (k = 0; k < NBINS; k++) {
+        gs->cos_k[k] = cos (2 * M_PI * k / GUIDESTAT_SAMPLES);
+        gs->sin_k[k] = sin (2 * M_PI * k / GUIDESTAT_SAMPLES);
+    }
+    return gs;
+}
+
+void guidestat_destroy (struct guidestat *gs)
+{
+    if (gs) {
+        if (gs->fd != -1)
+            (void)close (gs->fd);
+        free (gs);
+    }
+}
+
+int guidestat_open_ring (struct guidestat *gs, const char *path,
+                         uint32_t nrecords)
+{
+    struct guidestat_header hdr;
+    int fd, saved_errno;
+
+    if (nrecords == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0)
+        return -1;
+    if (pread (fd, &hdr, sizeof (hdr), 0) != sizeof (hdr)
+                || memcmp (hdr.magic, GUIDESTAT_MAGIC, sizeof (GUIDESTAT_MAGIC))
+                || hdr.nrecords != nrecords || hdr.next >= nrecords) {
+        memset (&hdr, 0, sizeof (hdr));
+        memcpy (hdr.magic, GUIDESTAT_MAGIC, sizeof (GUIDESTAT_MAGIC));
+        hdr.nrecords = nrecords;
+        if (ftruncate (fd, 0) < 0 || ftruncate (fd, sizeof (hdr)
+                    + (off_t)nrecords * sizeof (struct guidestat_record)) < 0)
+            goto error;
+        if (pwrite (fd, &hdr, sizeof (hdr), 0) != sizeof (hdr))
+            goto error;
+    }
+    if (gs->fd != -1)
+        (void)close (gs->fd);
+    gs->fd = fd;
+    gs->hdr = hdr;
+    return 0;
+error:
+    saved_errno = errno;
+    (void)close (fd);
+    errno = saved_errno;
+    return -1;
+}
+
+/* Write a record, then the header, so a crash loses at most the record.
+ * The record carries wall clock time so the file can be matched against
+ * images and logs.
+ */
+static void ring_write (struct guidestat *gs, int axis, double start,
+                        double position, double duration, double correction)
+{
+    struct guidestat_record rec;
+    struct timespec mono, real;
+    off_t off;
+
+    clock_gettime (CLOCK_MONOTONIC, &mono);
+    clock_gettime (CLOCK_REALTIME, &real);
+    memset (&rec, 0, sizeof (rec));
+    rec.time = llrint (((real.tv_sec + real.tv_nsec * 1E-9)
+                     - (mono.tv_sec + mono.tv_nsec * 1E-9) + start) * 1E6);
+    rec.duration = lrint (fmin (duration * 1E3, UINT16_MAX));
+    rec.axis = axis;
+    rec.position = isnan (position) || fabs (position) > 2000.
+                 ? GUIDESTAT_NOPOS : lrint (position * 1E6);
+    rec.correction = lrint (correction * 3600E3);
+    off = sizeof (gs->hdr) + (off_t)gs->hdr.next * sizeof (rec);
+    if (pwrite (gs->fd, &rec, sizeof (rec), off) != sizeof (rec))
+        return;
+    gs->hdr.next = (gs->hdr.next + 1) % gs->hdr.nrecords;
+    (void)pwrite (gs->fd, &gs->hdr, sizeof (gs->hdr), 0);
+}
+
+void guidestat_pulse (struct guidestat *gs, int axis, double start,
+                      double position, double duration, double correction)
+{
+    struct axis *a = &gs->axes[axis];
+    double arcsec = correction * 3600.;
+
+    guidestat_update (gs, start + duration);
+    a->count++;
+    a->duration += duration;
+    a->net += arcsec;
+    a->sumsq += arcsec * arcsec;
+    a->bin += arcsec;
+    if (gs->fd != -1)
+        ring_write (gs, axis, start, position, duration, correction);
+}
+
+static void axis_push (struct guidestat *gs, struct axis *a, double x)
+{
+    double dx = x - a->x[gs->head];
+    int k;
+
+    a->x[gs->head] = x;
+    for (k = 0; k < NBINS; k++) {
+        double re = a->re[k] + dx;
+        double im = a->im[k];
+        a->re[k] = re * gs->cos_k[k] - im * gs->sin_k[k];
+        a->im[k] = re * gs->sin_k[k] + im * gs->cos_k[k];
+    }
+}
+
+void guidestat_update (struct guidestat *gs, double now)
+{
+    int i, n = 0;
+
+    if (gs->bin_start == 0.) {
+        gs->bin_start = now;
+        return;
+    }
+    while (now - gs->bin_start >= gs->interval) {
+        if (++n > GUIDESTAT_SAMPLES) { // idle for a full window
+            for (i = 0; i < 2; i++) {
+                struct axis *a = &gs->axes[i];
+                memset (a->x, 0, sizeof (a->x));
+                memset (a->re, 0, sizeof (a->re));
+                memset (a->im, 0, sizeof (a->im));
+            }
+            gs->bin_start = now;
+            break;
+        }
+        for (i = 0; i < 2; i++) {
+            axis_push (gs, &gs->axes[i], gs->axes[i].bin);
+            gs->axes[i].bin = 0.;
+        }
+        gs->head = (gs->head + 1) % GUIDESTAT_SAMPLES;
+        gs->bin_start += gs->interval;
+    }
+}
+
+/* A correction rate sinusoid of amplitude |X[k]|*2/N per bin, at k cycles
+ * per window, integrates to a position error of |X[k]| / (pi * k).
+ */
+static double bin_amplitude (struct axis *a, int k)
+{
+    return hypot (a->re[k], a->im[k]) / (M_PI * k);
+}
+
+void guidestat_get (struct guidestat *gs, int axis,
+                    struct guidestat_axis *out)
+{
+    struct axis *a = &gs->axes[axis];
+    int k, peak = 0;
+
+    out->count = a->count;
+    out->duration = a->duration;
+    out->net = a->net;
+    out->rms = a->count > 0 ? sqrt (a->sumsq / a->count) : 0.;
+    for (k = 1; k < NBINS; k++) {
+        if (peak == 0 || bin_amplitude (a, k) > bin_amplitude (a, peak))
+            peak = k;
+    }
+    out->period = GUIDESTAT_SAMPLES * gs->interval / peak;
+    out->amplitude = bin_amplitude (a, peak);
+}
+
+int guidestat_get_spectrum (struct guidestat *gs, int axis,
+                            double *amplitude, int n)
+{
+    int k;
+
+    for (k = 1; k < NBINS && k <= n; k++)
+        amplitude[k - 1] = bin_amplitude (&gs->axes[axis], k);
+    return k - 1;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
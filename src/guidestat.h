@@ -0,0 +1,83 @@
+/* Guide pulse statistics
+ *
+ * Completed guide pulses are aggregated per axis (0 = t, 1 = d): count,
+ * total duration, net and RMS correction.  The correction is also
+ * binned at a fixed sample interval, and a sliding DFT over the last
+ * GUIDESTAT_SAMPLES bins is kept current, so the dominant period of the
+ * correction (e.g. worm periodic error) is available at any time.
+ * Pulses can also be recorded to a fixed-size binary ring file.
+ * Times are CLOCK_MONOTONIC (sec).
+ */
+
+#include <stdint.h>
+
+#define GUIDESTAT_SAMPLES   256
+
+struct guidestat;
+
+struct guidestat_axis {
+    unsigned long count;    // pulses
+    double duration;        // total pulse duration (sec)
+    double net;             // net correction (arcsec)
+    double rms;             // RMS correction per pulse (arcsec)
+    double period;          // dominant period of the correction (sec)
+    double amplitude;       // its amplitude as position error (arcsec)
+};
+
+/* Ring file records (native byte order).
+ */
+#define GUIDESTAT_MAGIC     "gemgd2"
+
+struct guidestat_header {
+    char magic[8];
+    uint32_t nrecords;
+    uint32_t next;          // index of the next record to write
+};
+
+struct guidestat_record {
+    int64_t time;           // pulse start, microseconds since the epoch
+    int32_t position;       // axis position at start, microdegrees
+    int32_t correction;     // milliarcseconds
+    uint16_t duration;      // milliseconds
+    uint8_t axis;
+    uint8_t reserved[5];
+};
+
+#define GUIDESTAT_NOPOS     INT32_MIN   // position unknown
+
+/* Create statistics with spectrum bins of 'interval' seconds.
+ */
+struct guidestat *guidestat_new (double interval);
+void guidestat_destroy (struct guidestat *gs);
+
+/* Record pulses to ring file 'path' with room for 'nrecords'.
+ * An existing ring of the same size is appended to.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+int guidestat_open_ring (struct guidestat *gs, const char *path,
+                         uint32_t nrecords);
+
+/* Add a completed pulse on 'axis' that started at 'start' at axis
+ * 'position' (degrees, NAN if unknown) and applied 'correction' (degrees)
+ * over 'duration' (sec).
+ */
+void guidestat_pulse (struct guidestat *gs, int axis, double start,
+                      double position, double duration, double correction);
+
+/* Advance the spectrum to 'now', closing any elapsed bins.
+ */
+void guidestat_update (struct guidestat *gs, double now);
+
+void guidestat_get (struct guidestat *gs, int axis,
+                    struct guidestat_axis *out);
+
+/* Get amplitude spectrum (arcsec of position error) of 'axis' for
+ * periods GUIDESTAT_SAMPLES * interval / k, k = 1 .. n.
+ * Returns number of values stored.
+ */
+int guidestat_get_spectrum (struct guidestat *gs, int axis,
+                            double *amplitude, int n);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
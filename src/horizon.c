@@ -0,0 +1,187 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "horizon.h"
+
+#define HORIZON_STEPS   1440    // table entries (0.25 degree azimuth)
+#define MAX_POINTS      HORIZON_STEPS
+
+struct horizon {
+    float sin_alt[HORIZON_STEPS];
+};
+
+struct horizon_point {
+    double az, alt;
+};
+
+static int compare_points (const void *a, const void *b)
+{
+    const struct horizon_point *p1 = a;
+    const struct horizon_point *p2 = b;
+
+    return p1->az < p2->az ? -1 : p1->az > p2->az ? 1 : 0;
+}
+
+/* Parse profile into 'pts', sorted by azimuth.
+ * Returns the number of points, or -1 on error.
+ */
+static int parse_profile (const char *s, struct horizon_point *pts)
+{
+    char *end;
+    int n = 0;
+
+    do {
+        double az, alt = strtod (s, &end);
+
+        if (end == s)
+            return -1;
+        if (*end == ':') {
+            az = alt;
+            s = end + 1;
+            alt = strtod (s, &end);
+            if (end == s)
+                return -1;
+        }
+        else if (n == 0 && *end == '\0')
+            az = 0.; // flat horizon
+        else
+            return -1;
+        if (az < 0. || az >= 360. || alt < -90. || alt > 90.
+                                  || n == MAX_POINTS)
+            return -1;
+        pts[n].az = az;
+        pts[n].alt = alt;
+        n++;
+        s = end + strspn (end, ", ");
+    } while (*s != '\0');
+
+    qsort (pts, n, sizeof (pts[0]), compare_points);
+    return n;
+}
+
+int horizon_set_profile (struct horizon *h, const char *profile)
+{
+    struct horizon_point *pts;
+    int i, j, n;
+
+    if (!(pts = calloc (MAX_POINTS, sizeof (*pts))))
+        return -1;
+    if ((n = parse_profile (profile, pts)) < 0) {
+        free (pts);
+        return -1;
+    }
+    /* Interpolate between the points on either side of each step,
+     * wrapping from the last point to the first through north.
+     */
+    for (i = 0, j = 0; i < HORIZON_STEPS; i++) {
+        double az = i * 360. / HORIZON_STEPS;
+        struct horizon_point lo, hi;
+        double alt;
+
+        while (j < n && pts[j].az <= az)
+            j++;
+        lo = pts[(j + n - 1) % n];
+        hi = pts[j % n];
+        if (j == 0)
+            lo.az -= 360.;
+        if (j == n)
+            hi.az += 360.;
+        if (hi.az - lo.az < 1E-9)
+            alt = lo.alt;
+        else
+            alt = lo.alt + (hi.alt - lo.alt) * (az - lo.az) / (hi.az - lo.az);
+        h->sin_alt[i] = sin (alt * M_PI / 180.);
+    }
+    free (pts);
+    return 0;
+}
+
+static int az_index (double az)
+{
+    int i = (int)floor (az * HORIZON_STEPS / 360. + 0.5);
+
+    return ((i % HORIZON_STEPS) + HORIZON_STEPS) % HORIZON_STEPS;
+}
+
+double horizon_get_altitude (struct horizon *h, double az)
+{
+    return asin (h->sin_alt[az_index (az)]) * 180. / M_PI;
+}
+
+/* Azimuth (north through east) and sin(altitude) from hour angle and
+ * declination, given sin and cos of latitude.  All angles in radians.
+ */
+static inline bool visible (struct horizon *h, double slat, double clat,
+                            double ha, double dec)
+{
+    double sd = sin (dec), cd = cos (dec);
+    double ch = cos (ha);
+    double sin_alt = slat * sd + clat * cd * ch;
+    double az = atan2 (-cd * sin (ha), sd * clat - cd * ch * slat);
+
+    return sin_alt > h->sin_alt[az_index (az * 180. / M_PI)];
+}
+
+bool horizon_check (struct horizon *h, double lat, double ha, double dec)
+{
+    lat *= M_PI / 180.;
+    return visible (h, sin (lat), cos (lat), ha * M_PI / 180.,
+                                             dec * M_PI / 180.);
+}
+
+int horizon_filter (struct horizon *h, double lat, int n,
+                    const double *ha, const double *dec, bool *vis)
+{
+    double slat = sin (lat * M_PI / 180.);
+    double clat = cos (lat * M_PI / 180.);
+    int i, count = 0;
+
+    for (i = 0; i < n; i++) {
+        vis[i] = visible (h, slat, clat, ha[i] * M_PI / 180.,
+                                         dec[i] * M_PI / 180.);
+        if (vis[i])
+            count++;
+    }
+    return count;
+}
+
+struct horizon *horizon_new (void)
+{
+    return calloc (1, sizeof (struct horizon));
+}
+
+void horizon_destroy (struct horizon *h)
+{
+    free (h);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
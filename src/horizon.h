@@ -0,0 +1,39 @@
+/* Local horizon profile
+ *
+ * The profile is a list of azimuth:altitude points (degrees, azimuth
+ * from north through east), linearly interpolated with wrap-around, and
+ * precomputed into a table of sin(altitude) at fixed azimuth steps, so
+ * a visibility check is an atan2() and a table index.  A single
+ * altitude gives a flat horizon.  A new horizon is flat at 0 degrees.
+ */
+
+#include <stdbool.h>
+
+struct horizon;
+
+struct horizon *horizon_new (void);
+void horizon_destroy (struct horizon *h);
+
+/* Set profile from a string of the form "az:alt,az:alt,..." or "alt".
+ * Returns 0 on success, -1 on parse error (profile is unchanged).
+ */
+int horizon_set_profile (struct horizon *h, const char *profile);
+
+/* Get horizon altitude at azimuth 'az' (degrees).
+ */
+double horizon_get_altitude (struct horizon *h, double az);
+
+/* Return true if (ha,dec) apparent place (degrees) is above the horizon
+ * at latitude 'lat' (degrees).
+ */
+bool horizon_check (struct horizon *h, double lat, double ha, double dec);
+
+/* Set visible[i] for 'n' apparent places (ha[i],dec[i]) at latitude 'lat'.
+ * Returns the number of visible positions.
+ */
+int horizon_filter (struct horizon *h, double lat, int n,
+                    const double *ha, const double *dec, bool *visible);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,992 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* Ref: INDI: Instrument-Neutral Distributed Interface, Elwood Downey,
+ * http://www.clearskyinstitute.com/INDI/INDI.pdf
+ * Standard property names: http://indilib.org/develop/developer-manual/
+ *
+ * Only the elements a telescope driver needs are parsed: getProperties,
+ * newNumberVector, and newSwitchVector.  Anything else is ignored.
+ *
+ * Once a client has sent getProperties, it is sent a setXXXVector whenever
+ * a property value changes.  Position is sampled once per update_period
+ * regardless of the number of clients, and only pushed if the formatted
+ * value differs from what was last sent.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <ev.h>
+
+#include "log.h"
+#include "xzmalloc.h"
+#include "point.h"
+#include "slew.h"
+
+#include "indi.h"
+
+#define LISTEN_BACKLOG 5
+#define MAX_CLIENTS 16
+#define MAX_BUF 4096
+#define MAX_VALUE 64
+
+#define DEVICE "GEM"
+
+static const double update_period = 1.;     // position sample (sec)
+
+enum {
+    SV_CONNECTION,
+    SV_COORD_SET,
+    SV_MOTION_NS,
+    SV_MOTION_WE,
+    SV_ABORT,
+    SV_TRACK_STATE,
+    SV_SLEW_RATE,
+    SV_COUNT,
+};
+
+enum {
+    NV_EOD_COORD,
+    NV_GEOGRAPHIC,
+    NV_COUNT,
+};
+
+enum {
+    COORD_SET_TRACK = 0,
+    COORD_SET_SLEW = 1,
+    COORD_SET_SYNC = 2,
+};
+
+struct switch_vector {
+    const char *name;
+    const char *label;
+    const char *group;
+    const char *rule;
+    int count;
+    const char *names[4];
+    const char *labels[4];
+};
+
+struct number_vector {
+    const char *name;
+    const char *label;
+    const char *group;
+    const char *perm;
+    int count;
+    const char *names[3];
+    const char *labels[3];
+    const char *formats[3];
+    double min[3];
+    double max[3];
+};
+
+static const struct switch_vector switches[SV_COUNT] = {
+    { "CONNECTION", "Connection", "Main Control", "OneOfMany", 2,
+      { "CONNECT", "DISCONNECT" }, { "Connect", "Disconnect" } },
+    { "ON_COORD_SET", "On Set", "Main Control", "OneOfMany", 3,
+      { "TRACK", "SLEW", "SYNC" }, { "Track", "Slew", "Sync" } },
+    { "TELESCOPE_MOTION_NS", "Motion N/S", "Motion Control", "AtMostOne", 2,
+      { "MOTION_NORTH", "MOTION_SOUTH" }, { "North", "South" } },
+    { "TELESCOPE_MOTION_WE", "Motion W/E", "Motion Control", "AtMostOne", 2,
+      { "MOTION_WEST", "MOTION_EAST" }, { "West", "East" } },
+    { "TELESCOPE_ABORT_MOTION", "Abort Motion", "Main Control", "AtMostOne",
+      1, { "ABORT" }, { "Abort" } },
+    { "TELESCOPE_TRACK_STATE", "Tracking", "Main Control", "OneOfMany", 2,
+      { "TRACK_ON", "TRACK_OFF" }, { "On", "Off" } },
+    { "TELESCOPE_SLEW_RATE", "Slew Rate", "Motion Control", "OneOfMany", 4,
+      { "SLEW_GUIDE", "SLEW_CENTERING", "SLEW_FIND", "SLEW_MAX" },
+      { "Guide", "Centering", "Find", "Max" } },
+};
+
+static const struct number_vector numbers[NV_COUNT] = {
+    { "EQUATORIAL_EOD_COORD", "Eq. Coordinates", "Main Control", "rw", 2,
+      { "RA", "DEC" }, { "RA (hh:mm:ss)", "DEC (dd:mm:ss)" },
+      { "%010.6m", "%010.6m" }, { 0, -90 }, { 24, 90 } },
+    { "GEOGRAPHIC_COORD", "Location", "Site Management", "rw", 3,
+      { "LAT", "LONG", "ELEV" }, { "Lat (dd:mm:ss)", "Lon (dd:mm:ss)",
+      "Elevation (m)" }, { "%010.6m", "%010.6m", "%g" },
+      { -90, 0, -200 }, { 90, 360, 10000 } },
+};
+
+/* Switch index <-> slew.h mapping
+ */
+static const int motion_ns[2] = { SLEW_DEC_PLUS, SLEW_DEC_MINUS };
+static const int motion_we[2] = { SLEW_RA_MINUS, SLEW_RA_PLUS };
+static const int slew_rates[4] = { SLEW_RATE_GUIDE, SLEW_RATE_SLOW,
+                                   SLEW_RATE_MEDIUM, SLEW_RATE_FAST };
+
+struct client {
+    int fd;
+    ev_io w;
+    char buf[MAX_BUF];
+    int len;
+    struct indi *in;
+    int num;
+    bool ready;     // client has sent getProperties
+};
+
+struct callback {
+    indi_cb_f cb;
+    void *arg;
+};
+
+struct indi {
+    int flags;
+    int fd;
+    struct callback pos;
+    struct callback status;
+    struct callback slew;
+    struct callback gto;
+    struct callback stop;
+    struct callback tracking;
+    ev_io listen_w;
+    ev_timer update_w;
+    struct client clients[MAX_CLIENTS];
+    int nclients;
+    double t, d;    // axis angular position (degrees)
+    double ra, dec; // corrected position (degrees)
+    bool pos_valid; // t,d refreshed by the position callback
+    const char *goto_error; // reason the last goto was refused, or NULL
+    bool goto_active;
+    bool tracking_enabled;
+    int slew_mask;
+    int slew_rate;
+    int coord_set;
+    int last_switch[SV_COUNT];
+    char last_number[NV_COUNT][MAX_VALUE * 3];
+    struct point *point;
+    struct ev_loop *loop;
+};
+
+static void client_free (struct client *c);
+
+static int write_all (struct client *c, const char *buf, int len)
+{
+    int n, done = 0;
+
+    if ((c->in->flags & INDI_DEBUG))
+        msg ("client[%d]: < '%.*s'", c->num, len, buf);
+
+    while (done < len) {
+        n = write (c->fd, buf + done, len - done);
+        if (n < 0) {
+            /* The socket is non-blocking so a client that stops reading
+             * cannot stall the loop.  Part of an element may have been
+             * sent, so the client has to go.
+             */
+            if ((errno == EWOULDBLOCK || errno == EAGAIN)
+                                    && (c->in->flags & INDI_DEBUG))
+                msg ("client[%d]: not keeping up, disconnecting", c->num);
+            return -1;
+        }
+        done += n;
+    }
+    return len;
+}
+
+/* Send to one client, or if c is NULL, all clients that sent getProperties.
+ */
+static void cpf (struct indi *in, struct client *c, const char *fmt, ...)
+{
+    va_list ap;
+    char *s;
+    int i;
+
+    va_start (ap, fmt);
+    s = xvasprintf (fmt, ap);
+    va_end (ap);
+
+    if (c) {
+        if (write_all (c, s, strlen (s)) < 0)
+            client_free (c);
+    }
+    else {
+        for (i = 0; i < MAX_CLIENTS; i++) {
+            c = &in->clients[i];
+            if (c->fd != -1 && c->ready && write_all (c, s, strlen (s)) < 0)
+                client_free (c);
+        }
+    }
+    free (s);
+}
+
+/* Return mask of switches that are On in vector 'sv'.
+ */
+static int switch_mask (struct indi *in, int sv)
+{
+    int i, mask = 0;
+
+    switch (sv) {
+        case SV_CONNECTION:
+            mask = 1;
+            break;
+        case SV_COORD_SET:
+            mask = 1 << in->coord_set;
+            break;
+        case SV_MOTION_NS:
+            for (i = 0; i < 2; i++)
+                if ((in->slew_mask & motion_ns[i]))
+                    mask |= 1 << i;
+            break;
+        case SV_MOTION_WE:
+            for (i = 0; i < 2; i++)
+                if ((in->slew_mask & motion_we[i]))
+                    mask |= 1 << i;
+            break;
+        case SV_ABORT:
+            break;
+        case SV_TRACK_STATE:
+            mask = in->tracking_enabled ? 1 : 2;
+            break;
+        case SV_SLEW_RATE:
+            for (i = 0; i < 4; i++)
+                if (in->slew_rate == slew_rates[i])
+                    mask = 1 << i;
+            break;
+    }
+    return mask;
+}
+
+static const char *switch_state (struct indi *in, int sv)
+{
+    if ((sv == SV_MOTION_NS || sv == SV_MOTION_WE) && switch_mask (in, sv))
+        return "Busy";
+    return "Ok";
+}
+
+static int number_values (struct indi *in, int nv, double *val)
+{
+    int deg, min;
+    double sec;
+
+    switch (nv) {
+        case NV_EOD_COORD:
+            val[0] = in->ra / 15.;
+            val[1] = in->dec;
+            break;
+        case NV_GEOGRAPHIC:
+            point_get_latitude (in->point, &deg, &min, &sec);
+            val[0] = abs (deg) + min/60. + sec/3600.;
+            if (deg < 0)
+                val[0] *= -1;
+            point_get_longitude (in->point, &deg, &min, &sec);
+            val[1] = abs (deg) + min/60. + sec/3600.;
+            if (deg < 0)
+                val[1] = 360. - val[1];
+            val[2] = 0.;
+            break;
+    }
+    return numbers[nv].count;
+}
+
+static const char *number_state (struct indi *in, int nv)
+{
+    if (nv == NV_EOD_COORD && in->goto_error)
+        return "Alert";
+    if (nv == NV_EOD_COORD && in->goto_active)
+        return "Busy";
+    return "Ok";
+}
+
+static void send_switch (struct indi *in, struct client *c, int sv, bool def)
+{
+    const struct switch_vector *v = &switches[sv];
+    int mask = switch_mask (in, sv);
+    char *s = NULL;
+    int i;
+
+    if (def)
+        s = xasprintf ("<defSwitchVector device='%s' name='%s' label='%s'"
+                       " group='%s' state='%s' perm='rw' rule='%s'"
+                       " timeout='60'>\n", DEVICE, v->name, v->label,
+                       v->group, switch_state (in, sv), v->rule);
+    else
+        s = xasprintf ("<setSwitchVector device='%s' name='%s' state='%s'>\n",
+                       DEVICE, v->name, switch_state (in, sv));
+    for (i = 0; i < v->count; i++) {
+        char *t;
+        if (def)
+            t = xasprintf ("%s  <defSwitch name='%s' label='%s'>%s</defSwitch>\n",
+                           s, v->names[i], v->labels[i],
+                           (mask & (1 << i)) ? "On" : "Off");
+        else
+            t = xasprintf ("%s  <oneSwitch name='%s'>%s</oneSwitch>\n",
+                           s, v->names[i], (mask & (1 << i)) ? "On" : "Off");
+        free (s);
+        s = t;
+    }
+    cpf (in, c, "%s</%sSwitchVector>\n", s, def ? "def" : "set");
+    free (s);
+    if (!c)
+        in->last_switch[sv] = mask;
+}
+
+static void send_number (struct indi *in, struct client *c, int nv, bool def)
+{
+    const struct number_vector *v = &numbers[nv];
+    double val[3];
+    char *s = NULL;
+    int i, n;
+
+    n = number_values (in, nv, val);
+    if (def)
+        s = xasprintf ("<defNumberVector device='%s' name='%s' label='%s'"
+                       " group='%s' state='%s' perm='%s' timeout='60'>\n",
+                       DEVICE, v->name, v->label, v->group,
+                       number_state (in, nv), v->perm);
+    else if (nv == NV_EOD_COORD && in->goto_error)
+        s = xasprintf ("<setNumberVector device='%s' name='%s' state='%s'"
+                       " message='%s'>\n", DEVICE, v->name,
+                       number_state (in, nv), in->goto_error);
+    else
+        s = xasprintf ("<setNumberVector device='%s' name='%s' state='%s'>\n",
+                       DEVICE, v->name, number_state (in, nv));
+    for (i = 0; i < n; i++) {
+        char *t;
+        if (def)
+            t = xasprintf ("%s  <defNumber name='%s' label='%s' format='%s'"
+                           " min='%g' max='%g' step='0'>%.6f</defNumber>\n",
+                           s, v->names[i], v->labels[i], v->formats[i],
+                           v->min[i], v->max[i], val[i]);
+        else
+            t = xasprintf ("%s  <oneNumber name='%s'>%.6f</oneNumber>\n",
+                           s, v->names[i], val[i]);
+        free (s);
+        s = t;
+    }
+    cpf (in, c, "%s</%sNumberVector>\n", s, def ? "def" : "set");
+    free (s);
+}
+
+/* Format number vector state and values for change detection.
+ */
+static void number_key (struct indi *in, int nv, char *buf, int len)
+{
+    double val[3];
+    int i, n, used;
+
+    n = number_values (in, nv, val);
+    used = snprintf (buf, len, "%s", number_state (in, nv));
+    for (i = 0; i < n && used < len; i++)
+        used += snprintf (buf + used, len - used, " %.6f", val[i]);
+}
+
+/* Push any properties that changed since they were last sent.
+ */
+static void push_changes (struct indi *in)
+{
+    char key[MAX_VALUE * 3];
+    int i;
+
+    for (i = 0; i < SV_COUNT; i++) {
+        if (switch_mask (in, i) != in->last_switch[i])
+            send_switch (in, NULL, i, false);
+    }
+    for (i = 0; i < NV_COUNT; i++) {
+        number_key (in, i, key, sizeof (key));
+        if (strcmp (key, in->last_number[i]) != 0) {
+            send_number (in, NULL, i, false);
+            snprintf (in->last_number[i], sizeof (in->last_number[i]),
+                      "%s", key);
+        }
+    }
+}
+
+/* Refresh t,d from the position callback and convert them to the
+ * cached apparent place, which is left alone if the position could not
+ * be read.  Returns -1 in that case.
+ */
+static int update_position (struct indi *in)
+{
+    in->pos_valid = false;
+    if (in->pos.cb)
+        in->pos.cb (in, in->pos.arg);
+    if (!in->pos_valid)
+        return -1;
+    point_convert_position_apparent (in->point, in->t, in->d,
+                                     &in->ra, &in->dec);
+    return 0;
+}
+
+static void update_status (struct indi *in)
+{
+    if (in->status.cb)
+        in->status.cb (in, in->status.arg);
+}
+
+/* Find the value of attribute 'name' in the start tag [s, e).
+ */
+static bool xml_attr (const char *s, const char *e, const char *name,
+                      char *val, int len)
+{
+    int nlen = strlen (name);
+    const char *p = s;
+
+    while (p < e && (p = memmem (p, e - p, name, nlen))) {
+        const char *q = p + nlen;
+        if (p > s && isspace (p[-1]) && q + 1 < e && *q == '='
+                                     && (q[1] == '"' || q[1] == '\'')) {
+            char quote = q[1];
+            const char *end;
+            q += 2;
+            if (!(end = memchr (q, quote, e - q)))
+                return false;
+            snprintf (val, len, "%.*s", (int)(end - q), q);
+            return true;
+        }
+        p = q;
+    }
+    return false;
+}
+
+/* Find the next child element 'tag' in [p, e), returning its name attribute
+ * and text content (whitespace trimmed).  Return a pointer past the child,
+ * or NULL if there is none.
+ */
+static const char *xml_child (const char *p, const char *e, const char *tag,
+                              char *name, int namelen, char *val, int vallen)
+{
+    int tlen = strlen (tag);
+    const char *s, *body, *end;
+
+    while ((s = memmem (p, e - p, tag, tlen))) {
+        if (s > p && s[-1] == '<')
+            break;
+        p = s + tlen;
+    }
+    if (!s || !(body = memchr (s, '>', e - s)))
+        return NULL;
+    if (!xml_attr (s, body, "name", name, namelen))
+        name[0] = '\0';
+    body++;
+    if (!(end = memmem (body, e - body, "</", 2)))
+        return NULL;
+    while (body < end && isspace (*body))
+        body++;
+    snprintf (val, vallen, "%.*s", (int)(end - body), body);
+    while (strlen (val) > 0 && isspace (val[strlen (val) - 1]))
+        val[strlen (val) - 1] = '\0';
+    if (!(end = memchr (end, '>', e - end)))
+        return NULL;
+    return end + 1;
+}
+
+/* Locate the first complete top level element in buf, skipping leading
+ * text, comments, and XML declarations.  Set [*start, *end) to the element
+ * and return 1, or return 0 if incomplete, with *start set to the number of
+ * bytes that may be discarded.
+ */
+static int xml_element (const char *buf, int len, int *start, int *end,
+                        char *tag, int taglen)
+{
+    const char *p = buf, *e = buf + len;
+    const char *name, *q;
+
+    for (;;) {
+        *start = p - buf;
+        if (!(p = memchr (p, '<', e - p))) {
+            *start = len;
+            return 0;
+        }
+        *start = p - buf;
+        if (p + 1 < e && (p[1] == '?' || p[1] == '!')) {
+            if (!(q = memchr (p, '>', e - p)))
+                return 0;
+            p = q + 1;
+            continue;
+        }
+        break;
+    }
+    name = p + 1;
+    for (q = name; q < e && !isspace (*q) && *q != '>' && *q != '/'; q++)
+        ;
+    if (q == e)
+        return 0;
+    snprintf (tag, taglen, "%.*s", (int)(q - name), name);
+    if (!(q = memchr (q, '>', e - q)))
+        return 0;
+    if (q[-1] == '/') {
+        *end = q + 1 - buf;
+        return 1;
+    }
+    for (;;) {
+        if (!(q = memmem (q, e - q, "</", 2)))
+            return 0;
+        q += 2;
+        if (e - q > strlen (tag) && !strncmp (q, tag, strlen (tag))
+                                 && (q[strlen (tag)] == '>'
+                                 || isspace (q[strlen (tag)])))
+            break;
+    }
+    if (!(q = memchr (q, '>', e - q)))
+        return 0;
+    *end = q + 1 - buf;
+    return 1;
+}
+
+static void send_all_definitions (struct indi *in, struct client *c)
+{
+    int i;
+
+    update_position (in);
+    update_status (in);
+    for (i = 0; i < SV_COUNT; i++)
+        send_switch (in, c, i, true);
+    for (i = 0; i < NV_COUNT; i++)
+        send_number (in, c, i, true);
+}
+
+static void set_slew_mask (struct indi *in, int mask)
+{
+    if (mask != in->slew_mask) {
+        in->slew_mask = mask;
+        if (in->slew.cb)
+            in->slew.cb (in, in->slew.arg);
+    }
+}
+
+static void set_tracking (struct indi *in, bool enable)
+{
+    in->tracking_enabled = enable;
+    if (in->tracking.cb)
+        in->tracking.cb (in, in->tracking.arg);
+}
+
+static void new_switch (struct indi *in, const char *name,
+                        const char *s, const char *e)
+{
+    char sname[MAX_VALUE], val[MAX_VALUE];
+    int sv, i;
+
+    for (sv = 0; sv < SV_COUNT; sv++)
+        if (!strcmp (name, switches[sv].name))
+            break;
+    if (sv == SV_COUNT)
+        return;
+    while ((s = xml_child (s, e, "oneSwitch", sname, sizeof (sname),
+                           val, sizeof (val)))) {
+        bool on = !strcmp (val, "On");
+        for (i = 0; i < switches[sv].count; i++)
+            if (!strcmp (sname, switches[sv].names[i]))
+                break;
+        if (i == switches[sv].count)
+            continue;
+        switch (sv) {
+            case SV_COORD_SET:
+                if (on)
+                    in->coord_set = i;
+                break;
+            case SV_MOTION_NS:
+                set_slew_mask (in, on ? in->slew_mask | motion_ns[i]
+                                      : in->slew_mask & ~motion_ns[i]);
+                break;
+            case SV_MOTION_WE:
+                set_slew_mask (in, on ? in->slew_mask | motion_we[i]
+                                      : in->slew_mask & ~motion_we[i]);
+                break;
+            case SV_ABORT:
+                if (on && in->stop.cb) {
+                    in->stop.cb (in, in->stop.arg);
+                    in->slew_mask = 0; // avoid redundant stop command
+                }
+                break;
+            case SV_TRACK_STATE:
+                if (on)
+                    set_tracking (in, i == 0);
+                break;
+            case SV_SLEW_RATE:
+                if (on)
+                    in->slew_rate = slew_rates[i];
+                break;
+        }
+    }
+    update_status (in);
+    send_switch (in, NULL, sv, false); // acknowledge even if unchanged
+}
+
+static void new_number (struct indi *in, const char *name,
+                        const char *s, const char *e)
+{
+    char nname[MAX_VALUE], val[MAX_VALUE];
+    int nv;
+    double v[3];
+
+    for (nv = 0; nv < NV_COUNT; nv++)
+        if (!strcmp (name, numbers[nv].name))
+            break;
+    if (nv == NV_COUNT)
+        return;
+    number_values (in, nv, v);
+    while ((s = xml_child (s, e, "oneNumber", nname, sizeof (nname),
+                           val, sizeof (val)))) {
+        int i;
+        for (i = 0; i < numbers[nv].count; i++)
+            if (!strcmp (nname, numbers[nv].names[i]))
+                v[i] = strtod (val, NULL);
+    }
+    switch (nv) {
+        case NV_EOD_COORD:
+            point_set_target_apparent (in->point, v[0] * 15., v[1]);
+            in->goto_error = NULL;
+            if (in->coord_set == COORD_SET_SYNC) {
+                if (update_position (in) == 0) {
+                    point_set_position_ha (in->point, in->t);
+                    point_set_position_dec (in->point, in->d);
+                    point_sync_target (in->point);
+                }
+            }
+            else {
+                if (in->gto.cb)
+                    in->gto.cb (in, in->gto.arg);
+                if (in->coord_set == COORD_SET_TRACK && !in->tracking_enabled)
+                    set_tracking (in, true);
+            }
+            update_position (in);
+            break;
+        case NV_GEOGRAPHIC: {
+            double lat = fabs (v[0]);
+            double lng = v[1] > 180. ? 360. - v[1] : v[1];
+            point_set_latitude (in->point, (int)lat * (v[0] < 0 ? -1 : 1),
+                                (int)(lat * 60.) % 60, fmod (lat * 3600., 60.));
+            point_set_longitude (in->point, (int)lng, (int)(lng * 60.) % 60,
+                                 fmod (lng * 3600., 60.));
+            point_set_longitude_neg (in->point, v[1] > 180. ? 1 : 0);
+            break;
+        }
+    }
+    update_status (in);
+    send_number (in, NULL, nv, false); // acknowledge even if unchanged
+}
+
+static void process_element (struct client *c, const char *tag,
+                             const char *s, const char *e)
+{
+    struct indi *in = c->in;
+    const char *stag_end = memchr (s, '>', e - s);
+    char device[MAX_VALUE], name[MAX_VALUE];
+
+    if ((in->flags & INDI_DEBUG))
+        msg ("client[%d]: > '%.*s'", c->num, (int)(e - s), s);
+
+    if (xml_attr (s, stag_end, "device", device, sizeof (device))
+                                        && strcmp (device, DEVICE) != 0)
+        return;
+    if (!xml_attr (s, stag_end, "name", name, sizeof (name)))
+        name[0] = '\0';
+
+    if (!strcmp (tag, "getProperties")) {
+        c->ready = true;
+        send_all_definitions (in, c);
+    }
+    else if (!strcmp (tag, "newSwitchVector"))
+        new_switch (in, name, stag_end, e);
+    else if (!strcmp (tag, "newNumberVector"))
+        new_number (in, name, stag_end, e);
+    push_changes (in);
+}
+
+static void client_cb (struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct client *c = (struct client *)((char *)w
+                        - offsetof (struct client, w));
+    char tag[MAX_VALUE];
+    int n, start, end;
+
+    n = read (c->fd, c->buf + c->len, sizeof (c->buf) - c->len);
+    if (n < 0) {
+        if (errno == EWOULDBLOCK || errno == EAGAIN)
+            goto out;
+        goto disconnect;
+    }
+    if (n == 0) // EOF
+        goto disconnect;
+    c->len += n;
+
+    while (xml_element (c->buf, c->len, &start, &end, tag, sizeof (tag))) {
+        process_element (c, tag, c->buf + start, c->buf + end);
+        if (c->fd == -1) // disconnected during a write
+            return;
+        memmove (c->buf, c->buf + end, c->len -= end);
+    }
+    memmove (c->buf, c->buf + start, c->len -= start);
+    if (c->len == sizeof (c->buf)) {
+        if ((c->in->flags & INDI_DEBUG))
+            msg ("client[%d]: element too large", c->num);
+        goto disconnect;
+    }
+out:
+    return;
+disconnect:
+    client_free (c);
+}
+
+static void update_cb (struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct indi *in = (struct indi *)((char *)w
+                        - offsetof (struct indi, update_w));
+
+    update_position (in);
+    update_status (in);
+    push_changes (in);
+}
+
+static void client_free (struct client *c)
+{
+    if (c->fd != -1) {
+        close (c->fd);
+        c->fd = -1;
+        c->ready = false;
+        ev_io_stop (c->in->loop, &c->w);
+        if (--c->in->nclients == 0)
+            ev_timer_stop (c->in->loop, &c->in->update_w);
+    }
+}
+
+static struct client *client_alloc (struct indi *in, int fd)
+{
+    int i;
+    struct client *c;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (in->clients[i].fd == -1)
+            break;
+    }
+    if (i == MAX_CLIENTS)
+        return NULL; // no client slot
+    c = &in->clients[i];
+    c->fd = fd;
+    c->len = 0;
+    c->ready = false;
+    ev_io_init (&c->w, client_cb, c->fd, EV_READ);
+    ev_io_start (c->in->loop, &c->w);
+    if (in->nclients++ == 0)
+        ev_timer_again (in->loop, &in->update_w);
+    return c;
+}
+
+/* Accept a connection and allocate client slot.
+ */
+static void listen_cb (struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct indi *in = (struct indi *)((char *)w
+                        - offsetof (struct indi, listen_w));
+
+    if ((revents & EV_READ)) {
+        int cfd;
+        struct client *c;
+        if ((cfd = accept4 (in->fd, NULL, NULL,
+                            SOCK_CLOEXEC | SOCK_NONBLOCK)) < 0)
+            return;
+        if (!(c = client_alloc (in, cfd))) { // too many open connections
+            close (cfd);
+            return;
+        }
+    }
+}
+
+static void slew_dump (int val)
+{
+    msg ("indi slew: (0x%x) %sN %sS %sE %sW", val,
+         (val & SLEW_DEC_PLUS) ? "*" : " ",
+         (val & SLEW_DEC_MINUS) ? "*" : " ",
+         (val & SLEW_RA_PLUS) ? "*" : " ",
+         (val & SLEW_RA_MINUS) ? "*" : " ");
+}
+
+int indi_get_slew_direction (struct indi *in)
+{
+    if ((in->flags & INDI_DEBUG))
+        slew_dump (in->slew_mask);
+    return in->slew_mask;
+}
+
+int indi_get_slew_rate (struct indi *in)
+{
+    if ((in->flags & INDI_DEBUG))
+        msg ("indi slew rate: %d", in->slew_rate);
+    return in->slew_rate;
+}
+
+bool indi_get_tracking (struct indi *in)
+{
+    return in->tracking_enabled;
+}
+
+void indi_set_position (struct indi *in, double t, double d)
+{
+    in->t = t;
+    in->d = d;
+    in->pos_valid = true;
+}
+
+void indi_set_status (struct indi *in, bool goto_active, bool tracking)
+{
+    in->goto_active = goto_active;
+    in->tracking_enabled = tracking;
+}
+
+void indi_get_target (struct indi *in, double *t, double *d)
+{
+    point_get_target (in->point, t, d);
+}
+
+void indi_set_position_cb (struct indi *in, indi_cb_f cb, void *arg)
+{
+    in->pos.cb = cb;
+    in->pos.arg = arg;
+}
+
+void indi_set_status_cb (struct indi *in, indi_cb_f cb, void *arg)
+{
+    in->status.cb = cb;
+    in->status.arg = arg;
+}
+
+void indi_set_slew_cb (struct indi *in, indi_cb_f cb, void *arg)
+{
+    in->slew.cb = cb;
+    in->slew.arg = arg;
+}
+
+void indi_set_goto_cb (struct indi *in, indi_cb_f cb, void *arg)
+{
+    in->gto.cb = cb;
+    in->gto.arg = arg;
+}
+
+void indi_set_goto_error (struct indi *in, const char *reason)
+{
+    in->goto_error = reason;
+}
+
+void indi_set_stop_cb (struct indi *in, indi_cb_f cb, void *arg)
+{
+    in->stop.cb = cb;
+    in->stop.arg = arg;
+}
+
+void indi_set_tracking_cb (struct indi *in, indi_cb_f cb, void *arg)
+{
+    in->tracking.cb = cb;
+    in->tracking.arg = arg;
+}
+
+int indi_init (struct indi *in, int port, struct point *point, int flags)
+{
+    struct sockaddr_in addr;
+
+    in->flags = flags;
+    in->point = point;
+
+    in->fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (in->fd < 0)
+        return -1;
+    memset (&addr, 0, sizeof (struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons (port);
+    if (bind (in->fd, (struct sockaddr *)&addr, sizeof (addr)) < 0)
+        return -1;
+    if (listen (in->fd, LISTEN_BACKLOG) < 0)
+        return -1;
+
+    ev_io_init (&in->listen_w, listen_cb, in->fd, EV_READ);
+    ev_timer_init (&in->update_w, update_cb, 0., update_period);
+
+    if ((in->flags & INDI_DEBUG))
+        msg ("listening on port %d", port);
+
+    return 0;
+}
+
+void indi_start (struct ev_loop *loop, struct indi *in)
+{
+    int i;
+
+    in->loop = loop;
+    ev_io_start (loop, &in->listen_w);
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (in->clients[i].fd != -1)
+            ev_io_start (loop, &in->clients[i].w);
+    }
+    if (in->nclients > 0)
+        ev_timer_again (loop, &in->update_w);
+}
+
+void indi_stop (struct ev_loop *loop, struct indi *in)
+{
+    int i;
+
+    ev_io_stop (loop, &in->listen_w);
+    ev_timer_stop (loop, &in->update_w);
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (in->clients[i].fd != -1)
+            ev_io_stop (loop, &in->clients[i].w);
+    }
+}
+
+struct indi *indi_new (void)
+{
+    struct indi *in = xzmalloc (sizeof (*in));
+    int i;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        in->clients[i].fd = -1;
+        in->clients[i].in = in;
+        in->clients[i].num = i;
+    }
+    in->fd = -1;
+    in->slew_rate = SLEW_RATE_MEDIUM;
+    in->coord_set = COORD_SET_TRACK;
+
+    return in;
+}
+
+void indi_destroy (struct indi *in)
+{
+    int i;
+
+    if (in) {
+        for (i = 0; i < MAX_CLIENTS; i++)
+            client_free (&in->clients[i]);
+        if (in->fd != -1)
+            close (in->fd);
+        free (in);
+    }
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,82 @@
+#include <ev.h>
+#include <stdbool.h>
+
+#define DEFAULT_INDI_PORT  7624
+
+enum {
+    INDI_DEBUG = 1,
+};
+
+/* Implement a minimal INDI telescope driver, speaking INDI XML directly
+ * to clients.  Properties are pushed to clients when they change.
+ */
+
+struct indi;
+struct point;
+typedef void (*indi_cb_f)(struct indi *in, void *arg);
+
+struct indi *indi_new (void);
+void indi_destroy (struct indi *in);
+
+/* The pointing model 'point' is shared with the caller and other protocols.
+ */
+int indi_init (struct indi *in, int port, struct point *point, int flags);
+
+/* Register callback that is triggered when the driver needs
+ * a position update.  Callback should call indi_set_position().
+ */
+void indi_set_position_cb (struct indi *in, indi_cb_f cb, void *arg);
+
+/* Register callback that is triggered when the driver needs
+ * a status update.  Callback should call indi_set_status().
+ */
+void indi_set_status_cb (struct indi *in, indi_cb_f cb, void *arg);
+
+/* Register callback that is triggered when slew (virtual) buttons
+ * are pressed or released.  Callback should call indi_get_slew_direction()
+ * and indi_get_slew_rate(), then make appropriate movement.
+ */
+void indi_set_slew_cb (struct indi *in, indi_cb_f cb, void *arg);
+
+/* Register callback that is triggered when protocol wants to goto
+ * the target object.  Callback should call indi_get_target ()
+ * and then move to those coordinates.
+ */
+void indi_set_goto_cb (struct indi *in, indi_cb_f cb, void *arg);
+
+/* Called from the goto callback to refuse the target with a short
+ * reason.  EQUATORIAL_EOD_COORD is then in Alert state, with the reason
+ * as its message, until new coordinates are set.  The reason must be
+ * a string constant.
+ */
+void indi_set_goto_error (struct indi *in, const char *reason);
+
+/* Register callback that is triggered when protocol wants to stop all motion.
+ */
+void indi_set_stop_cb (struct indi *in, indi_cb_f cb, void *arg);
+
+/* Register callback that is triggered when protocol turns tracking
+ * on or off.  Callback should call indi_get_tracking().
+ */
+void indi_set_tracking_cb (struct indi *in, indi_cb_f cb, void *arg);
+
+/* Set t,d position in degrees.
+ */
+void indi_set_position (struct indi *in, double t, double d);
+
+/* Set goto in progress and RA tracking status.
+ */
+void indi_set_status (struct indi *in, bool goto_active, bool tracking);
+
+int indi_get_slew_direction (struct indi *in);
+int indi_get_slew_rate (struct indi *in);
+bool indi_get_tracking (struct indi *in);
+
+void indi_get_target (struct indi *in, double *t, double *d);
+
+void indi_start (struct ev_loop *loop, struct indi *in);
+void indi_stop (struct ev_loop *loop, struct indi *in);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
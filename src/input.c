@@ -0,0 +1,357 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/epoll.h>
+#include <ev.h>
+
+#include "log.h"
+#include "xzmalloc.h"
+#include "gpio.h"
+#include "debounce.h"
+#include "slew.h"
+
+#include "input.h"
+
+#define GROUP_MAX   8
+#define PIN_MAX     16
+#define MAP_MAX     16
+
+/* Bartels stepper controller handpad returns a key code on bits 0-2,
+ * and the fast switch on bit 3.
+ */
+const struct input_map input_map_hpad[] = {
+    { 0x7, 1, INPUT_SLEW (SLEW_DEC_PLUS) },     // north
+    { 0x7, 2, INPUT_SLEW (SLEW_DEC_MINUS) },    // south
+    { 0x7, 3, INPUT_SLEW (SLEW_RA_MINUS) },     // west
+    { 0x7, 4, INPUT_SLEW (SLEW_RA_PLUS) },      // east
+    { 0x7, 5, INPUT_M1 },
+    { 0x7, 6, INPUT_M2 },
+    { 0x7, 7, INPUT_M1 | INPUT_M2 },
+    { 0x8, 8, INPUT_FAST },
+    { 0, 0, 0 },
+};
+
+const struct input_map input_map_guide[] = {
+    { 0x1, 0x1, INPUT_GUIDE (SLEW_DEC_PLUS) },
+    { 0x2, 0x2, INPUT_GUIDE (SLEW_DEC_MINUS) },
+    { 0x4, 0x4, INPUT_GUIDE (SLEW_RA_PLUS) },
+    { 0x8, 0x8, INPUT_GUIDE (SLEW_RA_MINUS) },
+    { 0, 0, 0 },
+};
+
+struct group {
+    char *name;
+    int flags;
+    int npins;
+    struct gpio_group *grp;
+    struct debounce *db;
+    struct input_map map[MAP_MAX];
+    bool active[MAP_MAX];   // map entry asserted
+    int nmap;
+};
+
+struct input {
+    int fd;                 // epoll fd shared by all groups
+    struct group groups[GROUP_MAX];
+    int ngroups;
+    int events;
+    int changed;
+    input_cb_f cb;
+    void *cb_arg;
+    ev_io io_w;
+    ev_timer timer_w;
+};
+
+struct input *input_new (void)
+{
+    struct input *in = xzmalloc (sizeof (*in));
+
+    if ((in->fd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+        err_exit ("epoll_create1");
+    return in;
+}
+
+void input_destroy (struct input *in)
+{
+    int i;
+
+    if (in) {
+        for (i = 0; i < in->ngroups; i++) {
+            struct group *g = &in->groups[i];
+            gpio_group_close (g->grp);
+            debounce_destroy (g->db);
+            free (g->name);
+        }
+        (void)close (in->fd);
+        free (in);
+    }
+}
+
+static double monotime (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+/* Re-evaluate map entries of group 'g' whose pins have all settled,
+ * since a key press may change several pins of a code, and return the
+ * events the group asserts.
+ */
+static int group_decode (struct group *g)
+{
+    int pending = debounce_get_pending (g->db);
+    int val = debounce_get_mask (g->db);
+    int i, events = 0;
+
+    for (i = 0; i < g->nmap; i++) {
+        struct input_map *m = &g->map[i];
+        if (!(pending & m->mask))
+            g->active[i] = ((val & m->mask) == m->code);
+        if (g->active[i])
+            events |= m->event;
+    }
+    return events;
+}
+
+static void group_dump (struct group *g, int events, double now)
+{
+    int i;
+
+    msg ("%s: (0x%x) events 0x%x", g->name, debounce_get_mask (g->db),
+         events);
+    for (i = 0; i < g->npins; i++) {
+        struct debounce_stats st;
+        double edge;
+        int val = debounce_get (g->db, i, &edge);
+
+        debounce_get_stats (g->db, i, &st);
+        msg ("%s: pin %d %s since %.6f (+%.1fms) settle %.1fms glitches %lu",
+             g->name, i, val ? "on" : "off", edge, (now - edge) * 1E3,
+             st.settle * 1E3, st.glitches);
+    }
+}
+
+/* Accept debounced changes confirmed by now, decode events and notify
+ * if they changed, then arm the timer for the next change that could be
+ * confirmed in any group.
+ */
+static void input_update (struct ev_loop *loop, struct input *in)
+{
+    double now = monotime ();
+    double next = 0.;
+    int i, events = 0;
+
+    for (i = 0; i < in->ngroups; i++) {
+        struct group *g = &in->groups[i];
+        double t;
+        int e;
+
+        debounce_update (g->db, now);
+        e = group_decode (g);
+        if ((g->flags & INPUT_DEBUG)) {
+            int mine = 0, j;
+            for (j = 0; j < g->nmap; j++)
+                mine |= g->map[j].event;
+            if (((in->events ^ e) & mine))
+                group_dump (g, e, now);
+        }
+        events |= e;
+        if ((t = debounce_next (g->db)) != 0. && (next == 0. || t < next))
+            next = t;
+    }
+    ev_timer_stop (loop, &in->timer_w);
+    if (next != 0.) {
+        ev_timer_set (&in->timer_w, fmax (next - now, 0.), 0.);
+        ev_timer_start (loop, &in->timer_w);
+    }
+    if (events != in->events) {
+        in->changed = events ^ in->events;
+        in->events = events;
+        if (in->cb)
+            in->cb (in, in->cb_arg);
+    }
+}
+
+static void timer_cb (struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct input *in = (struct input *)((char *)w
+                     - offsetof (struct input, timer_w));
+    input_update (loop, in);
+}
+
+/* Drain edge events from each group that epoll reports ready.
+ */
+static void io_cb (struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct input *in = (struct input *)((char *)w
+                     - offsetof (struct input, io_w));
+    struct epoll_event e[GROUP_MAX];
+    struct gpio_event ev;
+    int i, n;
+
+    if ((n = epoll_wait (in->fd, e, GROUP_MAX, 0)) < 0) {
+        err ("epoll_wait");
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        struct group *g = &in->groups[e[i].data.u32];
+        int rc;
+        while ((rc = gpio_group_read_event (g->grp, &ev)) > 0)
+            debounce_edge (g->db, ev.line, ev.val, ev.time);
+        if (rc < 0)
+            err ("%s: read", g->name);
+    }
+    input_update (loop, in);
+}
+
+int input_add_group (struct input *in, const char *name, const char *pins,
+                     bool active_low, double debounce,
+                     const struct input_map *map, int flags)
+{
+    struct group *g = &in->groups[in->ngroups];
+    struct epoll_event e;
+    int pin[PIN_MAX];
+    char *tok, *cpy = NULL;
+    double now = monotime ();
+    int i, val, rc = -1;
+
+    memset (g, 0, sizeof (*g));
+    if (!pins || in->ngroups == GROUP_MAX) {
+        errno = EINVAL;
+        goto done;
+    }
+    cpy = xstrdup (pins);
+    for (tok = strtok (cpy, ","); tok; tok = strtok (NULL, ",")) {
+        if (g->npins == PIN_MAX) {
+            errno = EINVAL;
+            goto done;
+        }
+        pin[g->npins++] = strtoul (tok, NULL, 10);
+    }
+    for (g->nmap = 0; map[g->nmap].mask != 0; g->nmap++) {
+        if (g->nmap == MAP_MAX || (map[g->nmap].mask >> g->npins) != 0) {
+            errno = EINVAL;
+            goto done;
+        }
+        g->map[g->nmap] = map[g->nmap];
+    }
+    if (!(g->grp = gpio_group_open (pin, g->npins, active_low, name)))
+        goto done;
+    memset (&e, 0, sizeof (e));
+    e.events = EPOLLIN;
+    e.data.u32 = in->ngroups;
+    if (epoll_ctl (in->fd, EPOLL_CTL_ADD, gpio_group_get_fd (g->grp), &e) < 0)
+        goto done;
+    if (gpio_group_read (g->grp, &val) < 0)
+        goto done;
+    g->db = debounce_new (g->npins, debounce);
+    for (i = 0; i < g->npins; i++)
+        debounce_reset (g->db, i, (val >> i) & 1, now);
+    g->name = xstrdup (name);
+    g->flags = flags;
+    in->events |= group_decode (g);
+    if ((g->flags & INPUT_DEBUG))
+        msg ("%s: configured gpio %s (%s)", name, pins,
+             gpio_group_is_chardev (g->grp) ? "chardev" : "sysfs");
+    in->ngroups++;
+    rc = 0;
+done:
+    if (rc < 0 && g->grp) {
+        int saved_errno = errno;
+        gpio_group_close (g->grp);
+        errno = saved_errno;
+    }
+    if (cpy)
+        free (cpy);
+    return rc;
+}
+
+void input_set_cb (struct input *in, input_cb_f cb, void *arg)
+{
+    in->cb = cb;
+    in->cb_arg = arg;
+}
+
+int input_get_events (struct input *in)
+{
+    return in->events;
+}
+
+int input_get_changed (struct input *in)
+{
+    return in->changed;
+}
+
+/* An event's code changed when the last of its pins did.
+ */
+double input_get_edge_time (struct input *in, int event)
+{
+    double latest = 0.;
+    int i, j, k;
+
+    for (i = 0; i < in->ngroups; i++) {
+        struct group *g = &in->groups[i];
+        for (j = 0; j < g->nmap; j++) {
+            if (!(g->map[j].event & event))
+                continue;
+            for (k = 0; k < g->npins; k++) {
+                double edge;
+                if (!(g->map[j].mask & (1<<k)))
+                    continue;
+                debounce_get (g->db, k, &edge);
+                if (edge > latest)
+                    latest = edge;
+            }
+        }
+    }
+    return latest;
+}
+
+void input_start (struct ev_loop *loop, struct input *in)
+{
+    ev_io_init (&in->io_w, io_cb, in->fd, EV_READ);
+    ev_timer_init (&in->timer_w, timer_cb, 0., 0.);
+    ev_io_start (loop, &in->io_w);
+}
+
+void input_stop (struct ev_loop *loop, struct input *in)
+{
+    ev_io_stop (loop, &in->io_w);
+    ev_timer_stop (loop, &in->timer_w);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,77 @@
+#include <ev.h>
+#include <stdbool.h>
+
+/* GPIO input subsystem
+ *
+ * Groups of input pins (handpad, guide port, ...) share one epoll fd,
+ * one libev io watcher and one debounce timer.  Each group is debounced
+ * (see debounce.h), then decoded by a table that maps pin codes to
+ * semantic events, so a new kind of input only needs a new table.
+ */
+
+enum {
+    INPUT_DEBUG = 1,
+};
+
+/* Semantic events.  Slew and guide directions are slew.h bits.
+ */
+#define INPUT_SLEW(dir)     ((dir) << 0)
+#define INPUT_GUIDE(dir)    ((dir) << 4)
+enum {
+    INPUT_SLEW_MASK = 0x00f,
+    INPUT_GUIDE_MASK = 0x0f0,
+    INPUT_FAST = 0x100,
+    INPUT_M1 = 0x200,
+    INPUT_M2 = 0x400,
+};
+
+/* Event 'event' is asserted while the pins of the group in 'mask' read
+ * 'code'.  It is only re-evaluated once all of those pins have settled.
+ * Tables end with a zero entry.
+ */
+struct input_map {
+    int mask;
+    int code;
+    int event;
+};
+
+/* Bartels handpad (pins are code bits 0-3) and ST-4 guide port
+ * (pins in slew.h bit order, active low).
+ */
+extern const struct input_map input_map_hpad[];
+extern const struct input_map input_map_guide[];
+
+struct input;
+typedef void (*input_cb_f)(struct input *in, void *arg);
+
+struct input *input_new (void);
+void input_destroy (struct input *in);
+
+/* Add group 'name' of 'pins' (comma separated gpio numbers), debounced
+ * with a settle time of at most 'debounce' (sec) and decoded by 'map'.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+int input_add_group (struct input *in, const char *name, const char *pins,
+                     bool active_low, double debounce,
+                     const struct input_map *map, int flags);
+
+/* Register callback that is triggered when events change.
+ * Callback should call input_get_events() and input_get_changed().
+ */
+void input_set_cb (struct input *in, input_cb_f cb, void *arg);
+
+int input_get_events (struct input *in);
+int input_get_changed (struct input *in);
+
+/* Get the CLOCK_MONOTONIC time (sec) of the edge that last changed
+ * 'event' (one bit).  With the GPIO character device this is the
+ * kernel timestamp of the edge.
+ */
+double input_get_edge_time (struct input *in, int event);
+
+void input_start (struct ev_loop *loop, struct input *in);
+void input_stop (struct ev_loop *loop, struct input *in);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
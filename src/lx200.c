@@ -42,6 +42,7 @@
 #include "log.h"
 #include "xzmalloc.h"
 #include "point.h"
+#include "objlib.h"
 #include "slew.h"
 
 #include "lx200.h"
@@ -49,6 +50,7 @@
 #define LISTEN_BACKLOG 5
 #define MAX_CLIENTS 16
 #define MAX_COMMAND_BYTES 64
+#define MAX_PULSE_MS 9999
 
 struct client {
     int fd;
@@ -74,13 +76,19 @@ struct lx200 {
     struct callback gto;
     struct callback stop;
     struct callback tracking;
+    struct callback guide;
     ev_io listen_w;
+    ev_timer guide_w[2];    // [0] = DEC (N/S), [1] = RA (E/W)
+    int guide_mask;
     struct client clients[MAX_CLIENTS];
     double t, d; // axis angular position (degrees)
     int slew_mask;
     int slew_rate;
     double tracking_rate; // RA degrees/sec
     struct point *point;
+    struct objlib *objlib;
+    const struct objlib_entry *object; // selected library object
+    const char *goto_error; // reason goto callback refused the target
     struct ev_loop *loop;
 };
 
@@ -116,6 +124,43 @@ static int wpf (struct client *c, const char *fmt, ...)
     return write_all (c, buf, strlen (buf));
 }
 
+static void guide_cb (struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct lx200 *lx = w->data;
+
+    if (w == &lx->guide_w[0])
+        lx->guide_mask &= ~(SLEW_DEC_PLUS | SLEW_DEC_MINUS);
+    else
+        lx->guide_mask &= ~(SLEW_RA_PLUS | SLEW_RA_MINUS);
+    if ((lx->flags & LX200_DEBUG))
+        msg ("lx200 guide: 0x%x", lx->guide_mask);
+    if (lx->guide.cb)
+        lx->guide.cb (lx, lx->guide.arg);
+}
+
+/* Start a guide pulse in direction 'dir' (one slew.h bit).
+ * A new pulse on an axis replaces one in progress.
+ */
+static void pulse_guide (struct lx200 *lx, int dir, int ms)
+{
+    int axis = (dir & (SLEW_DEC_PLUS | SLEW_DEC_MINUS)) ? 0 : 1;
+
+    if (axis == 0)
+        lx->guide_mask &= ~(SLEW_DEC_PLUS | SLEW_DEC_MINUS);
+    else
+        lx->guide_mask &= ~(SLEW_RA_PLUS | SLEW_RA_MINUS);
+    ev_timer_stop (lx->loop, &lx->guide_w[axis]);
+    if (ms > 0) {
+        lx->guide_mask |= dir;
+        ev_timer_set (&lx->guide_w[axis], ms * 1E-3, 0.);
+        ev_timer_start (lx->loop, &lx->guide_w[axis]);
+    }
+    if ((lx->flags & LX200_DEBUG))
+        msg ("lx200 guide: 0x%x", lx->guide_mask);
+    if (lx->guide.cb)
+        lx->guide.cb (lx, lx->guide.arg);
+}
+
 /* Return 0 on success, -1 on error.
  * Returning -1 causes a disconnect, so don't do it when error can
  * be returned in the command response to the client.
@@ -282,6 +327,25 @@ static int process_command (struct client *c, const char *cmd)
         point_get_position_dec (c->lx->point, &deg, &min, &sec);
         rc = wpf (c, "%+.2d*%.2d'%.2d#", deg, min, (int)sec);
     }
+    /* :MgnDDDD#, :MgsDDDD#, :MgeDDDD#, or :MgwDDDD# - guide north, south,
+     * east, or west at guide rate for DDDD milliseconds (no response)
+     */
+    else if (!strncmp (cmd, ":Mg", 3)) {
+        int ms;
+        int dir = cmd[3] == 'n' ? SLEW_DEC_PLUS
+                : cmd[3] == 's' ? SLEW_DEC_MINUS
+                : cmd[3] == 'e' ? SLEW_RA_PLUS
+                : cmd[3] == 'w' ? SLEW_RA_MINUS : 0;
+        if (dir && sscanf (cmd + 4, "%d#", &ms) == 1
+                && ms >= 0 && ms <= MAX_PULSE_MS)
+            pulse_guide (c->lx, dir, ms);
+    }
+    /* :D# - get distance bars (returns a bar while a guide pulse is
+     * in progress, otherwise an empty string)
+     */
+    else if (!strcmp (cmd, ":D#")) {
+        rc = wpf (c, "%s#", c->lx->guide_mask ? "\x7f" : "");
+    }
     /* :Me#, :Mw#, :Mn#, or :Ms# - slew east, west, north, or south
      * :Qe#, :Qw#, :Qn#, or :Qs# - stop slew in specified direction
      * :Q# - stop all slewing
@@ -340,6 +404,36 @@ static int process_command (struct client *c, const char *cmd)
         else
             rc = write_all (c, "0", 1);
     }
+    /* :LMNNNN#, :LCNNNN#, or :LSNNNN# - select Messier, NGC, or star
+     * object NNNN from the library as target object (no response)
+     */
+    else if (!strncmp (cmd, ":LM", 3) || !strncmp (cmd, ":LC", 3)
+                                      || !strncmp (cmd, ":LS", 3)) {
+        unsigned int num;
+        int catalog = cmd[2] == 'M' ? OBJLIB_MESSIER
+                    : cmd[2] == 'C' ? OBJLIB_NGC : OBJLIB_STAR;
+        const struct objlib_entry *e = NULL;
+
+        if (c->lx->objlib && sscanf (cmd + 3, "%u#", &num) == 1)
+            e = objlib_lookup (c->lx->objlib, catalog, num);
+        if (e) {
+            c->lx->object = e;
+            point_set_target_j2000 (c->lx->point, e->ra, e->dec);
+        }
+        else if ((c->lx->flags & LX200_DEBUG))
+            msg ("client[%d]: object not found", c->num);
+    }
+    /* :LI# - get selected object information (returns <string>#)
+     */
+    else if (!strcmp (cmd, ":LI#")) {
+        const struct objlib_entry *e = c->lx->object;
+
+        if (e)
+            rc = wpf (c, "%c%u %s MAG %.1f#", e->catalog, e->number,
+                      e->name, e->mag);
+        else
+            rc = wpf (c, "#");
+    }
     /* :Gr# - get target object RA (returns HH:MM.T# or HH:MM:SS)
      */
     else if (!strcmp (cmd, ":Gr#")) {
@@ -371,9 +465,13 @@ static int process_command (struct client *c, const char *cmd)
             c->lx->pos_ha.cb (c->lx, c->lx->pos_ha.arg); // update position t
         if (c->lx->pos_dec.cb)
             c->lx->pos_dec.cb (c->lx, c->lx->pos_dec.arg); // update position d
+        c->lx->goto_error = NULL;
         if (c->lx->gto.cb)
             c->lx->gto.cb (c->lx, c->lx->gto.arg);
-        rc = write_all (c, "0", 1); // success
+        if (c->lx->goto_error)
+            rc = wpf (c, "1%s#", c->lx->goto_error);
+        else
+            rc = write_all (c, "0", 1); // success
     }
 
     /* Slew commands trigger callback if mask changed
@@ -561,6 +659,11 @@ void lx200_set_goto_cb  (struct lx200 *lx, lx200_cb_f cb, void *arg)
     lx->gto.arg = arg;
 }
 
+void lx200_set_goto_error (struct lx200 *lx, const char *reason)
+{
+    lx->goto_error = reason;
+}
+
 void lx200_set_stop_cb  (struct lx200 *lx, lx200_cb_f cb, void *arg)
 {
     lx->stop.cb = cb;
@@ -574,17 +677,35 @@ void lx200_set_tracking_cb  (struct lx200 *lx, lx200_cb_f cb, void *arg)
     lx->tracking.arg = arg;
 }
 
+void lx200_set_guide_cb (struct lx200 *lx, lx200_cb_f cb, void *arg)
+{
+    lx->guide.cb = cb;
+    lx->guide.arg = arg;
+}
+
+int lx200_get_guide_direction (struct lx200 *lx)
+{
+    return lx->guide_mask;
+}
+
 void lx200_set_tracking_rate (struct lx200 *lx, double dps)
 {
     lx->tracking_rate = dps;
 }
 
-int lx200_init (struct lx200 *lx, int port, int flags)
+void lx200_set_objlib (struct lx200 *lx, struct objlib *objlib)
+{
+    lx->objlib = objlib;
+    lx->object = NULL;
+}
+
+int lx200_init (struct lx200 *lx, int port, struct point *point, int flags)
 {
     struct sockaddr_in addr;
-    int point_flags = 0;
+    int i;
 
     lx->flags = flags;
+    lx->point = point;
 
     lx->fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (lx->fd < 0)
@@ -599,16 +720,14 @@ int lx200_init (struct lx200 *lx, int port, int flags)
         return -1;
 
     ev_io_init (&lx->listen_w, listen_cb, lx->fd, EV_READ);
+    for (i = 0; i < 2; i++) {
+        ev_timer_init (&lx->guide_w[i], guide_cb, 0., 0.);
+        lx->guide_w[i].data = lx;
+    }
 
     if ((lx->flags & LX200_DEBUG))
         msg ("listening on port %d", port);
 
-    if ((lx->flags & LX200_DEBUG))
-        point_flags |= POINT_DEBUG;
-    if ((lx->flags & LX200_POINT_WEST))
-        point_flags |= POINT_WEST;
-    point_set_flags (lx->point, point_flags);
-
     return 0;
 }
 
@@ -629,6 +748,8 @@ void lx200_stop (struct ev_loop *loop, struct lx200 *lx)
     int i;
 
     ev_io_stop (loop, &lx->listen_w);
+    for (i = 0; i < 2; i++)
+        ev_timer_stop (loop, &lx->guide_w[i]);
 
     for (i = 0; i < MAX_CLIENTS; i++) {
         if (lx->clients[i].fd != -1)
@@ -641,9 +762,6 @@ struct lx200 *lx200_new (void)
     struct lx200 *lx = xzmalloc (sizeof (*lx));
     int i;
 
-    if (!(lx->point = point_new ()))
-        err_exit ("point_create");
-
     for (i = 0; i < MAX_CLIENTS; i++) {
         lx->clients[i].fd = -1;
         lx->clients[i].lx = lx;
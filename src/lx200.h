@@ -5,16 +5,19 @@
 
 enum {
     LX200_DEBUG = 1,
-    LX200_POINT_WEST = 2,
 };
 
 struct lx200;
+struct point;
+struct objlib;
 typedef void (*lx200_cb_f)(struct lx200 *lx, void *arg);
 
 struct lx200 *lx200_new (void);
 void lx200_destroy (struct lx200 *lx);
 
-int lx200_init (struct lx200 *lx, int port, int flags);
+/* The pointing model 'point' is shared with the caller and other protocols.
+ */
+int lx200_init (struct lx200 *lx, int port, struct point *point, int flags);
 
 /* Register callback that is triggered when the protocol needs
  * a position update.  Callback should call lx200_set_position().
@@ -28,12 +31,23 @@ void lx200_set_position_dec_cb  (struct lx200 *lx, lx200_cb_f cb, void *arg);
  */
 void lx200_set_slew_cb  (struct lx200 *lx, lx200_cb_f cb, void *arg);
 
+/* Register callback that is triggered when a guide pulse starts or ends.
+ * Callback should call lx200_get_guide_direction() and move at guide rate.
+ */
+void lx200_set_guide_cb  (struct lx200 *lx, lx200_cb_f cb, void *arg);
+
 /* Register callback that is triggered when protocol wants to goto
  * the target object.  Callback should call lx200_get_target ()
  * and then move to those coordinates.
  */
 void lx200_set_goto_cb  (struct lx200 *lx, lx200_cb_f cb, void *arg);
 
+/* Called from the goto callback to refuse the target with a short
+ * reason, e.g. "Object Below Horizon", which is returned to the client.
+ * The reason string must remain valid until the callback returns.
+ */
+void lx200_set_goto_error (struct lx200 *lx, const char *reason);
+
 /* Register callback that is triggered when protocol wants to stop all motion.
  */
 void lx200_set_stop_cb  (struct lx200 *lx, lx200_cb_f cb, void *arg);
@@ -47,12 +61,20 @@ void lx200_set_tracking_cb  (struct lx200 *lx, lx200_cb_f cb, void *arg);
  */
 void lx200_set_tracking_rate (struct lx200 *lx, double dps);
 
+/* Set object library used by the :L commands (NULL to disable).
+ */
+void lx200_set_objlib (struct lx200 *lx, struct objlib *objlib);
+
 /* Set t,d position in degrees.
  */
 void lx200_set_position_ha (struct lx200 *lx, double t);
 void lx200_set_position_dec (struct lx200 *lx, double d);
 
 int lx200_get_slew_direction (struct lx200 *lx);
+
+/* Get mask of guide directions (slew.h) with a pulse in progress.
+ */
+int lx200_get_guide_direction (struct lx200 *lx);
 int lx200_get_slew_rate  (struct lx200 *lx);
 
 void lx200_get_target (struct lx200 *lx, double *t, double *d);
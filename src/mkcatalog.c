@@ -0,0 +1,257 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* Convert an ASCII star list to the binary catalog format read by
+ * catalog_open().  Each input line holds a catalog number, J2000 RA
+ * and DEC in degrees, and visual magnitude, separated by white space.
+ * Blank lines and lines beginning with '#' are ignored.
+ *
+ * With --query, the resulting catalog is opened and searched at the
+ * current sidereal time for the site, printing matches with their apparent
+ * place (converted in one batch) and the query cost, e.g. to check a
+ * candidate set of alignment stars.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libgen.h>
+#include <math.h>
+
+#include "log.h"
+#include "xzmalloc.h"
+#include "catalog.h"
+#include "point.h"
+
+#define OPTIONS "+m:q:r:a:o:L:H:n:h"
+static const struct option longopts[] = {
+    {"max-mag",              required_argument, 0, 'm'},
+    {"query",                required_argument, 0, 'q'},
+    {"radius",               required_argument, 0, 'r'},
+    {"min-alt",              required_argument, 0, 'a'},
+    {"longitude",            required_argument, 0, 'o'},
+    {"latitude",             required_argument, 0, 'L'},
+    {"horizon",              required_argument, 0, 'H'},
+    {"count",                required_argument, 0, 'n'},
+    {"help",                 no_argument,       0, 'h'},
+    {0, 0, 0, 0},
+};
+
+static void usage (void)
+{
+    fprintf (stderr,
+"Usage: mkcatalog [OPTIONS] INPUT OUTPUT\n"
+"    -m,--max-mag MAG    omit stars fainter than MAG\n"
+"    -q,--query HA,DEC   search OUTPUT near HA,DEC (degrees) when done\n"
+"    -r,--radius DEG     query search radius (default 30)\n"
+"    -a,--min-alt DEG    query minimum altitude (default 20)\n"
+"    -o,--longitude DEG  query longitude, east positive (default 0)\n"
+"    -L,--latitude DEG   query latitude (default 45)\n"
+"    -H,--horizon AZ:ALT,...  omit query results below horizon profile\n"
+"    -n,--count N        maximum query results (default 10)\n"
+);
+    exit (1);
+}
+
+static double monotime (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static int read_stars (const char *path, double max_mag,
+                       struct catalog_star **starsp)
+{
+    FILE *f;
+    char line[256];
+    struct catalog_star *stars = NULL;
+    int n = 0, size = 0, lineno = 0;
+
+    if (!(f = fopen (path, "r")))
+        err_exit ("%s", path);
+    while (fgets (line, sizeof (line), f)) {
+        unsigned long id;
+        double ra, dec, mag;
+
+        lineno++;
+        if (line[strspn (line, " \t\r\n")] == '\0' || line[0] == '#')
+            continue;
+        if (sscanf (line, "%lu %lf %lf %lf", &id, &ra, &dec, &mag) != 4
+                || ra < 0. || ra >= 360. || dec < -90. || dec > 90.)
+            msg_exit ("%s:%d: parse error", path, lineno);
+        if (mag > max_mag)
+            continue;
+        if (n == size) {
+            size = size ? size * 2 : 1024;
+            if (!(stars = realloc (stars, size * sizeof (*stars))))
+                oom ();
+        }
+        stars[n].id = id;
+        stars[n].ra = ra;
+        stars[n].dec = dec;
+        stars[n].mag = mag;
+        n++;
+    }
+    if (ferror (f))
+        err_exit ("%s", path);
+    fclose (f);
+    *starsp = stars;
+    return n;
+}
+
+/* Set site (degrees) in the point object.
+ */
+static void set_site (struct point *p, double lat, double lng)
+{
+    point_set_latitude (p, (int)lat, (int)(fabs (lat) * 60.) % 60,
+                        fmod (fabs (lat) * 3600., 60.));
+    point_set_longitude (p, (int)fabs (lng), (int)(fabs (lng) * 60.) % 60,
+                         fmod (fabs (lng) * 3600., 60.));
+    point_set_longitude_neg (p, lng < 0.);
+}
+
+static void query (const char *path, double lat, double lng,
+                   const char *horizon,
+                   double ha, double dec, double radius, double min_alt,
+                   int max)
+{
+    struct catalog *cat;
+    struct catalog_star *out = xzmalloc (max * sizeof (*out));
+    double *ra = xzmalloc (max * sizeof (double));
+    double *de = xzmalloc (max * sizeof (double));
+    double *h = xzmalloc (max * sizeof (double));
+    double *hd = xzmalloc (max * sizeof (double));
+    bool *visible = xzmalloc (max * sizeof (bool));
+    struct point *p;
+    double t0, elapsed, lst;
+    int i, n = 0, nvis, runs = 1000;
+
+    if (!(p = point_new ()))
+        oom ();
+    set_site (p, lat, lng);
+    if (horizon && point_set_horizon (p, horizon) < 0)
+        msg_exit ("error parsing horizon profile");
+    lst = point_get_lst (p);
+    if (!(cat = catalog_open (path)))
+        err_exit ("%s", path);
+    t0 = monotime ();
+    for (i = 0; i < runs; i++)
+        n = catalog_query (cat, lst, lat, ha, dec, radius, min_alt, out, max);
+    elapsed = (monotime () - t0) / runs;
+    for (i = 0; i < n; i++) {
+        ra[i] = out[i].ra;
+        de[i] = out[i].dec;
+    }
+    point_batch_convert (p, POINT_EPOCH_J2000, n, ra, de, h, hd, NULL, NULL);
+    nvis = point_batch_visible (p, n, h, hd, visible);
+    for (i = 0; i < n; i++) {
+        if (!visible[i])
+            continue;
+        msg ("%6u ra=%7.3f dec=%+7.3f mag=%5.2f ha=%+8.3f app dec=%+7.3f",
+             out[i].id, out[i].ra, out[i].dec, out[i].mag, h[i], hd[i]);
+    }
+    msg ("%d of %d stars (%d above horizon) in %.1f us/query at lst %.3f",
+         n, catalog_get_count (cat), nvis, elapsed * 1E6, lst);
+    catalog_close (cat);
+    point_destroy (p);
+    free (out);
+    free (ra);
+    free (de);
+    free (h);
+    free (hd);
+    free (visible);
+}
+
+int main (int argc, char *argv[])
+{
+    int ch;
+    char *prog;
+    double max_mag = 99.;
+    double radius = 30., min_alt = 20., lng = 0., lat = 45.;
+    const char *horizon = NULL;
+    double ha = 0., dec = 0.;
+    int max = 10;
+    int do_query = 0;
+    struct catalog_star *stars;
+    int n;
+
+    prog = basename (argv[0]);
+    log_init (prog);
+
+    while ((ch = getopt_long (argc, argv, OPTIONS, longopts, NULL)) != -1) {
+        switch (ch) {
+            case 'm':   /* --max-mag MAG */
+                max_mag = strtod (optarg, NULL);
+                break;
+            case 'q':   /* --query HA,DEC */
+                if (sscanf (optarg, "%lf,%lf", &ha, &dec) != 2)
+                    usage ();
+                do_query = 1;
+                break;
+            case 'r':   /* --radius DEG */
+                radius = strtod (optarg, NULL);
+                break;
+            case 'a':   /* --min-alt DEG */
+                min_alt = strtod (optarg, NULL);
+                break;
+            case 'o':   /* --longitude DEG */
+                lng = strtod (optarg, NULL);
+                break;
+            case 'L':   /* --latitude DEG */
+                lat = strtod (optarg, NULL);
+                break;
+            case 'H':   /* --horizon AZ:ALT,... */
+                horizon = optarg;
+                break;
+            case 'n':   /* --count N */
+                max = strtoul (optarg, NULL, 10);
+                break;
+            case 'h':   /* --help */
+            default:
+                usage ();
+        }
+    }
+    if (optind != argc - 2 || max <= 0)
+        usage ();
+
+    n = read_stars (argv[optind], max_mag, &stars);
+    if (catalog_write (argv[optind + 1], stars, n) < 0)
+        err_exit ("%s", argv[optind + 1]);
+    msg ("%s: wrote %d stars", argv[optind + 1], n);
+    free (stars);
+
+    if (do_query)
+        query (argv[optind + 1], lat, lng, horizon, ha, dec, radius, min_alt,
+               max);
+
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,170 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* Convert an ASCII object list to the binary object library read by
+ * objlib_open().  Each input line holds a catalog letter (M, N, or S for
+ * Messier, NGC, or star), a number, J2000 RA and DEC in degrees, visual
+ * magnitude, and an optional name, separated by white space, e.g.
+ *
+ *   M 31 10.6847 41.2687 3.4 Andromeda Galaxy
+ *
+ * Blank lines and lines beginning with '#' are ignored.  Names longer
+ * than 15 characters are truncated.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libgen.h>
+
+#include "log.h"
+#include "objlib.h"
+
+#define OPTIONS "+l:h"
+static const struct option longopts[] = {
+    {"lookup",               required_argument, 0, 'l'},
+    {"help",                 no_argument,       0, 'h'},
+    {0, 0, 0, 0},
+};
+
+static void usage (void)
+{
+    fprintf (stderr,
+"Usage: mkobjlib [OPTIONS] INPUT OUTPUT\n"
+"    -l,--lookup CNUM    look up e.g. M31 in OUTPUT when done\n"
+);
+    exit (1);
+}
+
+static int read_objects (const char *path, struct objlib_entry **entriesp)
+{
+    FILE *f;
+    char line[256];
+    struct objlib_entry *entries = NULL;
+    int n = 0, size = 0, lineno = 0;
+
+    if (!(f = fopen (path, "r")))
+        err_exit ("%s", path);
+    while (fgets (line, sizeof (line), f)) {
+        char catalog;
+        unsigned long number;
+        double ra, dec, mag;
+        int len = 0;
+        char *name;
+
+        lineno++;
+        if (line[strspn (line, " \t\r\n")] == '\0' || line[0] == '#')
+            continue;
+        if (sscanf (line, " %c %lu %lf %lf %lf %n", &catalog, &number,
+                    &ra, &dec, &mag, &len) != 5 || len == 0
+                || (catalog != OBJLIB_MESSIER && catalog != OBJLIB_NGC
+                                              && catalog != OBJLIB_STAR)
+                || ra < 0. || ra >= 360. || dec < -90. || dec > 90.)
+            msg_exit ("%s:%d: parse error", path, lineno);
+        if (n == size) {
+            size = size ? size * 2 : 1024;
+            if (!(entries = realloc (entries, size * sizeof (*entries))))
+                oom ();
+        }
+        memset (&entries[n], 0, sizeof (entries[n]));
+        entries[n].catalog = catalog;
+        entries[n].number = number;
+        entries[n].ra = ra;
+        entries[n].dec = dec;
+        entries[n].mag = mag;
+        name = line + len;
+        name[strcspn (name, "\r\n")] = '\0';
+        snprintf (entries[n].name, sizeof (entries[n].name), "%s", name);
+        n++;
+    }
+    if (ferror (f))
+        err_exit ("%s", path);
+    fclose (f);
+    *entriesp = entries;
+    return n;
+}
+
+static void lookup (const char *path, const char *key)
+{
+    struct objlib *ol;
+    const struct objlib_entry *e;
+    char catalog;
+    unsigned long number;
+
+    if (sscanf (key, "%c%lu", &catalog, &number) != 2)
+        usage ();
+    if (!(ol = objlib_open (path)))
+        err_exit ("%s", path);
+    if (!(e = objlib_lookup (ol, catalog, number)))
+        msg ("%c%lu: not found", catalog, number);
+    else
+        msg ("%c%u ra=%7.3f dec=%+7.3f mag=%5.2f %s", e->catalog, e->number,
+             e->ra, e->dec, e->mag, e->name);
+    objlib_close (ol);
+}
+
+int main (int argc, char *argv[])
+{
+    int ch;
+    char *prog;
+    char *key = NULL;
+    struct objlib_entry *entries;
+    int n;
+
+    prog = basename (argv[0]);
+    log_init (prog);
+
+    while ((ch = getopt_long (argc, argv, OPTIONS, longopts, NULL)) != -1) {
+        switch (ch) {
+            case 'l':   /* --lookup CNUM */
+                key = optarg;
+                break;
+            case 'h':   /* --help */
+            default:
+                usage ();
+        }
+    }
+    if (optind != argc - 2)
+        usage ();
+
+    n = read_objects (argv[optind], &entries);
+    if (objlib_write (argv[optind + 1], entries, n) < 0) {
+        if (errno == EEXIST)
+            msg_exit ("%s: duplicate catalog number", argv[optind]);
+        err_exit ("%s", argv[optind + 1]);
+    }
+    msg ("%s: wrote %d objects", argv[optind + 1], n);
+    free (entries);
+
+    if (key)
+        lookup (argv[optind + 1], key);
+
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
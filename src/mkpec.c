@@ -0,0 +1,351 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* Build a periodic error correction table for the t (RA) axis from the
+ * guide pulse ring file written by gem-controld ([guide] stats_file).
+ *
+ * The cumulative guide correction is the negative of the tracking error
+ * the guider removed.  It is split into sessions at gaps longer than a
+ * worm period, the linear drift (e.g. polar misalignment) is removed
+ * from each, and what remains is phase-folded on the worm period, taken
+ * from the axis position so gotos between sessions don't matter.  An FFT
+ * of the folded curve keeps only the low worm harmonics, and the table
+ * is the time derivative of that smoothed curve: the rate correction a
+ * PEC player adds to tracking at each worm phase.
+ *
+ * Worm phase is relative to the controller's step origin, so the table
+ * is only valid while that origin is kept.
+ */
+
+#include <stdio.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <libgen.h>
+#include <math.h>
+
+#include "log.h"
+#include "xzmalloc.h"
+#include "configfile.h"
+#include "guidestat.h"
+
+#define OPTIONS "+c:b:H:h"
+static const struct option longopts[] = {
+    {"config",               required_argument, 0, 'c'},
+    {"bins",                 required_argument, 0, 'b'},
+    {"harmonics",            required_argument, 0, 'H'},
+    {"help",                 no_argument,       0, 'h'},
+    {0, 0, 0, 0},
+};
+
+static void usage (void)
+{
+    fprintf (stderr,
+"Usage: mkpec [OPTIONS] RINGFILE OUTPUT\n"
+"    -c,--config FILE    set path to config file\n"
+"    -b,--bins N         table entries per worm period, power of 2 (128)\n"
+"    -H,--harmonics N    worm harmonics to keep (8)\n"
+);
+    exit (1);
+}
+
+struct sample {
+    double time;            // sec
+    double position;        // degrees
+    double correction;      // arcsec
+};
+
+static int sample_cmp (const void *a, const void *b)
+{
+    const struct sample *s1 = a;
+    const struct sample *s2 = b;
+
+    return s1->time < s2->time ? -1 : s1->time > s2->time ? 1 : 0;
+}
+
+/* Read t axis pulses with known position, in time order.
+ */
+static int read_ring (const char *path, struct sample **sp)
+{
+    struct guidestat_header hdr;
+    struct guidestat_record rec;
+    struct sample *s;
+    FILE *f;
+    uint32_t i;
+    int n = 0;
+
+    if (!(f = fopen (path, "r")))
+        err_exit ("%s", path);
+    if (fread (&hdr, sizeof (hdr), 1, f) != 1
+                || memcmp (hdr.magic, GUIDESTAT_MAGIC, sizeof (GUIDESTAT_MAGIC))
+                || hdr.nrecords == 0)
+        msg_exit ("%s: not a guide ring file", path);
+    s = xzmalloc (hdr.nrecords * sizeof (s[0]));
+    for (i = 0; i < hdr.nrecords; i++) {
+        if (fread (&rec, sizeof (rec), 1, f) != 1)
+            err_exit ("%s: read", path);
+        if (rec.time == 0 || rec.axis != 0
+                          || rec.position == GUIDESTAT_NOPOS)
+            continue;
+        s[n].time = rec.time * 1E-6 + rec.duration * 0.5E-3;
+        s[n].position = rec.position * 1E-6;
+        s[n].correction = rec.correction * 1E-3;
+        n++;
+    }
+    (void)fclose (f);
+    qsort (s, n, sizeof (s[0]), sample_cmp);
+    *sp = s;
+    return n;
+}
+
+/* In-place radix-2 complex FFT of length n (a power of 2).
+ * 'sign' is -1 for the forward transform, +1 for the (unscaled) inverse.
+ */
+static void fft (double *re, double *im, int n, int sign)
+{
+    int i, j, k, len;
+
+    for (i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; (j & bit); bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            double t;
+            t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (len = 2; len <= n; len <<= 1) {
+        double a = sign * 2 * M_PI / len;
+        double wr = cos (a), wi = sin (a);
+        for (i = 0; i < n; i += len) {
+            double ur = 1., ui = 0.;
+            for (k = 0; k < len / 2; k++) {
+                int p = i + k, q = i + k + len / 2;
+                double xr = re[q] * ur - im[q] * ui;
+                double xi = re[q] * ui + im[q] * ur;
+                double t;
+                re[q] = re[p] - xr;
+                im[q] = im[p] - xi;
+                re[p] += xr;
+                im[p] += xi;
+                t = ur * wr - ui * wi;
+                ui = ur * wi + ui * wr;
+                ur = t;
+            }
+        }
+    }
+}
+
+/* Remove least squares line from cumulative correction of s[0..n-1],
+ * storing the residual in 'resid'.
+ */
+static void detrend (const struct sample *s, const double *cum, int n,
+                     double *resid)
+{
+    double st = 0., sc = 0., stt = 0., stc = 0., b = 0., a;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        double t = s[i].time - s[0].time;
+        st += t;
+        sc += cum[i];
+        stt += t * t;
+        stc += t * cum[i];
+    }
+    if (n * stt - st * st > 0.)
+        b = (n * stc - st * sc) / (n * stt - st * st);
+    a = (sc - b * st) / n;
+    for (i = 0; i < n; i++)
+        resid[i] = cum[i] - (a + b * (s[i].time - s[0].time));
+}
+
+int main (int argc, char *argv[])
+{
+    int ch;
+    char *config_filename = NULL;
+    struct config cfg;
+    int bins = 128, harmonics = 8;
+    struct sample *s;
+    double *cum, *resid, *sum, *re, *im;
+    int *count;
+    double worm_deg, period, pp_min = 0., pp_max = 0.;
+    int i, j, k, n, start, used = 0, filled = 0;
+    FILE *f;
+
+    memset (&cfg, 0, sizeof (cfg));
+    log_init (basename (argv[0]));
+
+    while ((ch = getopt_long (argc, argv, OPTIONS, longopts, NULL)) != -1) {
+        switch (ch) {
+            case 'c':   /* --config FILE */
+                config_filename = xstrdup (optarg);
+                break;
+            case 'b':   /* --bins N */
+                bins = strtoul (optarg, NULL, 10);
+                break;
+            case 'H':   /* --harmonics N */
+                harmonics = strtoul (optarg, NULL, 10);
+                break;
+            case 'h':   /* --help */
+            default:
+                usage ();
+        }
+    }
+    if (optind != argc - 2)
+        usage ();
+    if (bins < 8 || (bins & (bins - 1)) != 0)
+        msg_exit ("bins must be a power of 2 >= 8");
+    if (harmonics < 1 || harmonics >= bins / 2)
+        msg_exit ("harmonics must be 1 to %d", bins / 2 - 1);
+    configfile_init (config_filename, &cfg);
+    if (cfg.t.worm <= 0 || cfg.t.sidereal <= 0)
+        msg_exit ("t_axis worm and sidereal must be configured");
+    worm_deg = 360. / cfg.t.worm;
+    period = worm_deg / cfg.t.sidereal;
+
+    n = read_ring (argv[optind], &s);
+    cum = xzmalloc ((n + 1) * sizeof (double));
+    resid = xzmalloc ((n + 1) * sizeof (double));
+    for (i = 0; i < n; i++)
+        cum[i] = (i > 0 ? cum[i - 1] : 0.) + s[i].correction;
+
+    /* Detrend each session, folding those that span a worm period.
+     */
+    sum = xzmalloc (bins * sizeof (double));
+    count = xzmalloc (bins * sizeof (int));
+    for (start = 0; start < n; start = i) {
+        for (i = start + 1; i < n; i++) {
+            if (s[i].time - s[i - 1].time > period)
+                break;
+        }
+        if (s[i - 1].time - s[start].time < period)
+            continue;
+        detrend (&s[start], &cum[start], i - start, &resid[start]);
+        for (j = start; j < i; j++) {
+            double phase = fmod (s[j].position, worm_deg) / worm_deg;
+            if (phase < 0)
+                phase += 1.;
+            k = (int)(phase * bins) % bins;
+            sum[k] += resid[j];
+            count[k]++;
+        }
+        used += i - start;
+    }
+    for (k = 0; k < bins; k++) {
+        if (count[k] > 0)
+            filled++;
+    }
+    if (filled < bins / 2)
+        msg_exit ("%d of %d pulses cover only %d of %d worm phase bins",
+                  used, n, filled, bins);
+
+    /* Fill empty bins by circular linear interpolation.
+     */
+    re = xzmalloc (bins * sizeof (double));
+    im = xzmalloc (bins * sizeof (double));
+    for (k = 0; k < bins; k++) {
+        int lo, hi;
+        if (count[k] > 0) {
+            re[k] = sum[k] / count[k];
+            continue;
+        }
+        for (lo = 1; count[(k - lo + bins) % bins] == 0; lo++)
+            ;
+        for (hi = 1; count[(k + hi) % bins] == 0; hi++)
+            ;
+        j = (k - lo + bins) % bins;
+        re[k] = (sum[j] / count[j] * hi
+              + sum[(k + hi) % bins] / count[(k + hi) % bins] * lo)
+              / (lo + hi);
+    }
+
+    /* Keep harmonics 1..H of the folded error; the derivative of
+     * harmonic k is i*2*pi*k/period times it.
+     */
+    fft (re, im, bins, -1);
+    msg ("worm period %.1fs, %d of %d pulses used", period, used, n);
+    for (k = 1; k <= harmonics; k++)
+        msg ("harmonic %d: %.2f\" peak", k,
+             2 * hypot (re[k], im[k]) / bins);
+    {
+        double *dre = xzmalloc (bins * sizeof (double));
+        double *dim = xzmalloc (bins * sizeof (double));
+
+        for (k = 0; k < bins; k++) {
+            int kk = k <= bins / 2 ? k : k - bins;
+            double w = 2 * M_PI * kk / period;
+            if (kk == 0 || abs (kk) > harmonics) {
+                re[k] = im[k] = 0.;
+                continue;
+            }
+            dre[k] = -w * im[k];
+            dim[k] = w * re[k];
+        }
+        fft (re, im, bins, 1);
+        fft (dre, dim, bins, 1);
+
+        if (!(f = fopen (argv[optind + 1], "w")))
+            err_exit ("%s", argv[optind + 1]);
+        for (k = 0; k < bins; k++) {
+            re[k] /= bins;
+            if (k == 0 || re[k] < pp_min)
+                pp_min = re[k];
+            if (k == 0 || re[k] > pp_max)
+                pp_max = re[k];
+        }
+        fprintf (f, "# gem-controld PEC table\n");
+        fprintf (f, "# worm period %.3fs (%.6f degrees, %.1f steps)\n",
+                 period, worm_deg, (double)cfg.t.steps / cfg.t.worm);
+        fprintf (f, "# %d bins, %d harmonics, %d pulses,"
+                 " %.2f\" peak-to-peak\n", bins, harmonics, used,
+                 pp_max - pp_min);
+        fprintf (f, "# phase is measured from the t axis step origin\n");
+        fprintf (f, "# phase(degrees) rate(degrees/sec) correction(arcsec)\n");
+        for (k = 0; k < bins; k++)
+            fprintf (f, "%.6f %+.6e %+.3f\n", worm_deg * k / bins,
+                     dre[k] / bins / 3600., re[k]);
+        if (fclose (f) != 0)
+            err_exit ("%s", argv[optind + 1]);
+        free (dre);
+        free (dim);
+    }
+
+    free (re);
+    free (im);
+    free (sum);
+    free (count);
+    free (cum);
+    free (resid);
+    free (s);
+    free (config_filename);
+    return 0;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
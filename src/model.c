@@ -0,0 +1,355 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "model.h"
+
+#define N MODEL_TERMS
+
+static const double ridge = 1E-2;       // regularization of non-index terms
+static const double min_cos_dec = 1E-2; // limit sec(dec) near the pole
+static const int inverse_iterations = 3;
+
+static const char *term_names[N] = {
+    "IH", "ID", "CH", "NP", "MA", "ME", "TF",
+};
+
+struct model {
+    double x[N];        // fitted terms (degrees)
+    double ata[N][N];   // normal equations A'A
+    double atb[N];      // normal equations A'b
+    double btb;         // b'b, for residual
+    int count;          // number of syncs
+    int drifts;         // number of drift observations
+    double ih, id;      // index errors in effect before the first sync
+    double lat;         // observer latitude (radians)
+};
+
+static double rad (double deg)
+{
+    return deg * M_PI / 180.;
+}
+
+static double wrap180 (double deg)
+{
+    deg = fmod (deg, 360.);
+    if (deg > 180.)
+        deg -= 360.;
+    else if (deg < -180.)
+        deg += 360.;
+    return deg;
+}
+
+static double sec_dec (double cos_dec)
+{
+    if (fabs (cos_dec) < min_cos_dec)
+        cos_dec = cos_dec < 0 ? -min_cos_dec : min_cos_dec;
+    return 1. / cos_dec;
+}
+
+/* Partial derivatives of HA correction (times cos dec, i.e. on the sky)
+ * and DEC correction with respect to each term, at sky position (h,dec).
+ */
+static void basis (struct model *m, double h, double dec,
+                   double ah[N], double ad[N])
+{
+    double sh = sin (rad (h)), ch = cos (rad (h));
+    double sd = sin (rad (dec)), cd = cos (rad (dec));
+    double sl = sin (m->lat), cl = cos (m->lat);
+
+    ah[MODEL_IH] = cd;          ad[MODEL_IH] = 0.;
+    ah[MODEL_ID] = 0.;          ad[MODEL_ID] = 1.;
+    ah[MODEL_CH] = 1.;          ad[MODEL_CH] = 0.;
+    ah[MODEL_NP] = sd;          ad[MODEL_NP] = 0.;
+    ah[MODEL_MA] = -ch * sd;    ad[MODEL_MA] = sh;
+    ah[MODEL_ME] = sh * sd;     ad[MODEL_ME] = ch;
+    ah[MODEL_TF] = cl * sh;     ad[MODEL_TF] = cl * ch * sd - sl * cd;
+}
+
+/* Partial derivatives of basis() with respect to h (per degree), i.e.
+ * how each term's corrections change as an object is tracked.
+ */
+static void basis_rate (struct model *m, double h, double dec,
+                        double ah[N], double ad[N])
+{
+    double sh = sin (rad (h)), ch = cos (rad (h));
+    double sd = sin (rad (dec));
+    double cl = cos (m->lat);
+    double k = rad (1.);
+
+    memset (ah, 0, N * sizeof (ah[0]));
+    memset (ad, 0, N * sizeof (ad[0]));
+    ah[MODEL_MA] = k * sh * sd;     ad[MODEL_MA] = k * ch;
+    ah[MODEL_ME] = k * ch * sd;     ad[MODEL_ME] = -k * sh;
+    ah[MODEL_TF] = k * cl * ch;     ad[MODEL_TF] = -k * cl * sh * sd;
+}
+
+/* Evaluate corrections (dh,dd) at sky position (h,dec).
+ */
+static void corrections (struct model *m, double h, double dec,
+                         double *dh, double *dd)
+{
+    double ah[N], ad[N];
+    double sum_h = 0., sum_d = 0.;
+    int i;
+
+    basis (m, h, dec, ah, ad);
+    for (i = 0; i < N; i++) {
+        if (i != MODEL_IH)
+            sum_h += ah[i] * m->x[i];
+        sum_d += ad[i] * m->x[i];
+    }
+    *dh = m->x[MODEL_IH] + sum_h * sec_dec (cos (rad (dec)));
+    *dd = sum_d;
+}
+
+static void update (struct model *m, const double a[N], double b)
+{
+    int i, j;
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < N; j++)
+            m->ata[i][j] += a[i] * a[j];
+        m->atb[i] += a[i] * b;
+    }
+    m->btb += b * b;
+}
+
+/* Solve (A'A + ridge) x = A'b by Cholesky decomposition.
+ * Until there is a sync, only drift observations constrain the terms,
+ * and they say nothing about the index errors, so those are held at
+ * their current values.
+ */
+static int solve (struct model *m, double x[N])
+{
+    double l[N][N], y[N];
+    int i, j, k;
+
+    memset (l, 0, sizeof (l));
+    for (i = 0; i < N; i++) {
+        for (j = 0; j <= i; j++) {
+            double sum = m->ata[i][j];
+            if (i == j && i != MODEL_IH && i != MODEL_ID)
+                sum += ridge;
+            else if (i == j && m->count == 0)
+                sum += 1.;
+            for (k = 0; k < j; k++)
+                sum -= l[i][k] * l[j][k];
+            if (i == j) {
+                if (sum <= 0.)
+                    return -1;
+                l[i][i] = sqrt (sum);
+            }
+            else
+                l[i][j] = sum / l[j][j];
+        }
+    }
+    for (i = 0; i < N; i++) {
+        double sum = m->atb[i];
+        if (m->count == 0 && (i == MODEL_IH || i == MODEL_ID))
+            sum += m->x[i];
+        for (k = 0; k < i; k++)
+            sum -= l[i][k] * y[k];
+        y[i] = sum / l[i][i];
+    }
+    for (i = N - 1; i >= 0; i--) {
+        double sum = y[i];
+        for (k = i + 1; k < N; k++)
+            sum -= l[k][i] * x[k];
+        x[i] = sum / l[i][i];
+    }
+    return 0;
+}
+
+int model_add_sync (struct model *m, double t, double d, double h, double dec)
+{
+    double ah[N], ad[N];
+    double x[N];
+
+    basis (m, h, dec, ah, ad);
+    update (m, ah, wrap180 (h - t) * cos (rad (dec)));
+    update (m, ad, dec - d);
+    m->count++;
+
+    if (solve (m, x) < 0)
+        return -1;
+    memcpy (m->x, x, sizeof (m->x));
+    return 0;
+}
+
+/* A drift observation is one equation: the DEC axis rate, scaled to
+ * degrees per radian of hour angle so it is weighted like a sync residual
+ * of the same size.
+ */
+int model_add_drift (struct model *m, double t, double d, double rate)
+{
+    double ah[N], ad[N];
+    double a[N];
+    double x[N];
+    int i;
+
+    basis_rate (m, t + m->x[MODEL_IH], d + m->x[MODEL_ID], ah, ad);
+    for (i = 0; i < N; i++)
+        a[i] = -ad[i] / rad (1.);
+    update (m, a, rate / rad (1.));
+    m->drifts++;
+
+    if (solve (m, x) < 0)
+        return -1;
+    memcpy (m->x, x, sizeof (m->x));
+    return 0;
+}
+
+/* Axis position is t = h - dh(h,dec), d = dec - dd(h,dec), so holding
+ * (h,dec) on the sky while h advances takes axis rates 1 - ddh/dh and
+ * -ddd/dh.
+ */
+void model_get_rates (struct model *m, double t, double d,
+                      double *t_rate, double *d_rate)
+{
+    double h0 = t + m->x[MODEL_IH];
+    double d0 = d + m->x[MODEL_ID];
+    double ah[N], ad[N];
+    double sum_h = 0., sum_d = 0.;
+    int i;
+
+    basis_rate (m, h0, d0, ah, ad);
+    for (i = 0; i < N; i++) {
+        sum_h += ah[i] * m->x[i];
+        sum_d += ad[i] * m->x[i];
+    }
+    *t_rate = 1. - sum_h * sec_dec (cos (rad (d0)));
+    *d_rate = -sum_d;
+}
+
+double model_get_rms (struct model *m)
+{
+    double sum = m->btb;
+    int i, j;
+
+    if (m->count == 0 && m->drifts == 0)
+        return 0.;
+    for (i = 0; i < N; i++) {
+        sum -= 2. * m->x[i] * m->atb[i];
+        for (j = 0; j < N; j++)
+            sum += m->x[i] * m->ata[i][j] * m->x[j];
+    }
+    return sum > 0. ? sqrt (sum / (2 * m->count + m->drifts)) : 0.;
+}
+
+/* Terms are evaluated at the index-corrected axis position, which differs
+ * from the sky position only by the (small) remaining terms.
+ */
+void model_raw_to_sky (struct model *m, double t, double d,
+                       double *h, double *dec)
+{
+    double h0 = t + m->x[MODEL_IH];
+    double d0 = d + m->x[MODEL_ID];
+    double dh, dd;
+
+    corrections (m, h0, d0, &dh, &dd);
+    *h = t + dh;
+    *dec = d + dd;
+}
+
+void model_sky_to_raw (struct model *m, double h, double dec,
+                       double *t, double *d)
+{
+    double tt = h - m->x[MODEL_IH];
+    double dd = dec - m->x[MODEL_ID];
+    double ch, cd;
+    int i;
+
+    for (i = 0; i < inverse_iterations; i++) {
+        corrections (m, tt + m->x[MODEL_IH], dd + m->x[MODEL_ID], &ch, &cd);
+        tt = h - ch;
+        dd = dec - cd;
+    }
+    *t = tt;
+    *d = dd;
+}
+
+double model_get_term (struct model *m, int term)
+{
+    return term >= 0 && term < N ? m->x[term] : 0.;
+}
+
+const char *model_term_name (int term)
+{
+    return term >= 0 && term < N ? term_names[term] : "??";
+}
+
+int model_get_count (struct model *m)
+{
+    return m->count;
+}
+
+int model_get_drifts (struct model *m)
+{
+    return m->drifts;
+}
+
+void model_set_latitude (struct model *m, double lat)
+{
+    m->lat = rad (lat);
+}
+
+void model_set_index (struct model *m, double ih, double id)
+{
+    m->ih = ih;
+    m->id = id;
+    if (m->count == 0) {
+        m->x[MODEL_IH] = ih;
+        m->x[MODEL_ID] = id;
+    }
+}
+
+void model_reset (struct model *m)
+{
+    double lat = m->lat;
+    double ih = m->ih;
+    double id = m->id;
+
+    memset (m, 0, sizeof (*m));
+    m->lat = lat;
+    model_set_index (m, ih, id);
+}
+
+struct model *model_new (void)
+{
+    struct model *m = calloc (1, sizeof (*m));
+    return m;
+}
+
+void model_destroy (struct model *m)
+{
+    free (m);
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,98 @@
+/* Pointing model terms for an equatorial mount
+ *
+ * The model maps uncorrected axis positions (t,d) to sky hour angle
+ * and declination (h,dec) using the classic TPOINT terms:
+ *
+ *   IH  HA index error
+ *   ID  DEC index error
+ *   CH  collimation error (optical axis not perpendicular to DEC axis)
+ *   NP  HA/DEC non-perpendicularity
+ *   MA  polar axis misalignment in azimuth (east of north is positive)
+ *   ME  polar axis misalignment in elevation
+ *   TF  tube flexure (sine of zenith distance)
+ *
+ * All terms are in degrees.  Each sync adds a pair of equations to the
+ * normal equations via rank-one updates, then the small system is solved
+ * by Cholesky decomposition, so a sync costs microseconds.  Terms other
+ * than the index errors are lightly regularized toward zero, so the model
+ * degrades gracefully to a one-star zero point correction until enough
+ * syncs are available to determine them.
+ *
+ * The same terms predict how the axes must move to follow an object, so
+ * polar misalignment also shows up as DEC drift while tracking at the
+ * sidereal rate.  Drift observations (e.g. the net DEC guide correction
+ * over a few minutes) can be added to the fit alongside syncs, so the
+ * misalignment terms can be estimated with no syncs at all.
+ *
+ * Ref: "Telescope Pointing" by Patrick Wallace, http://www.tpointsw.uk/
+ */
+
+struct model;
+
+enum {
+    MODEL_IH,
+    MODEL_ID,
+    MODEL_CH,
+    MODEL_NP,
+    MODEL_MA,
+    MODEL_ME,
+    MODEL_TF,
+    MODEL_TERMS,
+};
+
+struct model *model_new (void);
+void model_destroy (struct model *m);
+
+/* Set observer's latitude (degrees), used by the tube flexure term.
+ */
+void model_set_latitude (struct model *m, double lat);
+
+/* Set index errors (degrees) to be used until the first sync.
+ */
+void model_set_index (struct model *m, double ih, double id);
+
+/* Discard all syncs.
+ */
+void model_reset (struct model *m);
+
+/* Add a sync: axis position (t,d) was observed to be at sky (h,dec).
+ * Refit the model.  Returns 0 on success, -1 if the fit failed
+ * (the previous terms are retained).
+ */
+int model_add_sync (struct model *m, double t, double d, double h, double dec);
+
+/* Add a drift observation: at axis position (t,d), holding an object
+ * took a DEC axis rate of 'rate' degrees per degree of hour angle.
+ * Refit the model.  Returns 0 on success, -1 if the fit failed.
+ */
+int model_add_drift (struct model *m, double t, double d, double rate);
+
+/* Get axis rates (t_rate,d_rate) per degree of hour angle that hold the
+ * sky position under axis position (t,d) fixed: (1,0) for a perfect mount.
+ */
+void model_get_rates (struct model *m, double t, double d,
+                      double *t_rate, double *d_rate);
+
+/* Convert axis position to sky position (direct evaluation).
+ */
+void model_raw_to_sky (struct model *m, double t, double d,
+                       double *h, double *dec);
+
+/* Convert sky position to axis position (fixed number of iterations).
+ */
+void model_sky_to_raw (struct model *m, double h, double dec,
+                       double *t, double *d);
+
+double model_get_term (struct model *m, int term);
+const char *model_term_name (int term);
+int model_get_count (struct model *m);
+int model_get_drifts (struct model *m);
+
+/* Get RMS sky residual of syncs and drift observations against the
+ * current fit (degrees).
+ */
+double model_get_rms (struct model *m);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
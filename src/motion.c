@@ -530,19 +530,54 @@ static void status_poll_cb (struct ev_loop *loop, ev_timer *w, int revents)
     }
 }
 
+/* Velocity units (as passed to motion_move_constant()) per degree/sec.
+ */
+static double velocity_scale (struct motion *m)
+{
+    double scale = m->cfg.steps / 360.;
+
+    if (m->cfg.mode == 1) // fixed=0, auto=1
+        scale *= 1<<(m->cfg.resolution);
+    return scale;
+}
+
 /* Calculate velocity in steps/sec for motion controller from degrees/sec.
  * Take into account controller velocity scaling in 'auto' mode.
  * Then move at that velocity.
  */
 int motion_move_constant_dps (struct motion *m, double dps)
 {
-    double sps = dps * m->cfg.steps / 360.;
-
-    if (m->cfg.mode == 1) // fixed=0, auto=1
-        sps *= 1<<(m->cfg.resolution);
-    return motion_move_constant (m, lrint (sps));
+    return motion_move_constant (m, lrint (dps * velocity_scale (m)));
 };
 
+double motion_get_goto_dps (struct motion *m)
+{
+    return m->cfg.finalv / velocity_scale (m);
+}
+
+void motion_bracket_dps (struct motion *m, double dps, double *lo,
+                         double *hi)
+{
+    double scale = velocity_scale (m);
+    double v = dps * scale;
+    double l = floor (v), h = ceil (v);
+
+    if (l > -20. && l < 0.)
+        l = -20.;
+    if (h > 0. && h < 20.)
+        h = 20.;
+    if (v > 0. && l < 20.)
+        l = 0.;
+    if (v < 0. && h > -20.)
+        h = 0.;
+    if (l > 20000.)
+        l = h = 20000.;
+    if (h < -20000.)
+        l = h = -20000.;
+    *lo = l / scale;
+    *hi = h / scale;
+}
+
 static int motion_configure (struct motion *m, struct motion_config *cfg)
 {
     if (cfg->resolution < 0 || cfg->resolution > 8)
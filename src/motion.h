@@ -55,6 +55,17 @@ int motion_move_constant (struct motion *m, int sps);
  */
 int motion_move_constant_dps (struct motion *m, double dps);
 
+/* Get the velocities nearest 'dps' (degrees per second) that
+ * motion_move_constant_dps() can run at exactly, lo <= dps <= hi.
+ * The controller has no velocities between zero and its minimum.
+ */
+void motion_bracket_dps (struct motion *m, double dps, double *lo,
+                         double *hi);
+
+/* Get the goto (final) velocity in degrees per second.
+ */
+double motion_get_goto_dps (struct motion *m);
+
 /* Query current position.
  */
 int motion_get_position (struct motion *m, double *position);
@@ -0,0 +1,740 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* Ref: NexStar Communication Protocol, Version 1.2, Celestron.
+ * https://www.nexstarsite.com/download/manuals/NexStarCommunicationProtocolV1.2.zip
+ *
+ * Commands are a single character followed by a fixed number of argument
+ * bytes, so framing is by command length.  Responses are terminated by '#'.
+ * Positions are hex encoded fractions of a revolution, 16 bits ('E', 'R',
+ * 'S') or 32 bits ('e', 'r', 's'), with RA and DEC combined in one reply.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <ev.h>
+
+#include "log.h"
+#include "xzmalloc.h"
+#include "point.h"
+#include "slew.h"
+
+#include "nexstar.h"
+
+#define LISTEN_BACKLOG 5
+#define MAX_CLIENTS 16
+#define MAX_COMMAND_BYTES 32
+
+/* Pass-through ('P') device and command codes
+ */
+enum {
+    DEV_AZM_RA = 16,
+    DEV_ALT_DEC = 17,
+    MC_SET_POS_GUIDERATE = 6,
+    MC_SET_NEG_GUIDERATE = 7,
+    MC_MOVE_POS = 36,
+    MC_MOVE_NEG = 37,
+};
+
+/* Tracking modes ('t', 'T')
+ */
+enum {
+    TRACK_OFF = 0,
+    TRACK_ALTAZ = 1,
+    TRACK_EQ_NORTH = 2,
+    TRACK_EQ_SOUTH = 3,
+};
+
+struct client {
+    int fd;
+    ev_io w;
+    uint8_t buf[MAX_COMMAND_BYTES];
+    int len;
+    struct nexstar *nx;
+    int num;
+};
+
+struct callback {
+    nexstar_cb_f cb;
+    void *arg;
+};
+
+struct nexstar {
+    int flags;
+    int fd;
+    struct callback pos;
+    struct callback status;
+    struct callback slew;
+    struct callback gto;
+    struct callback stop;
+    struct callback tracking;
+    ev_io listen_w;
+    struct client clients[MAX_CLIENTS];
+    double t, d; // axis angular position (degrees)
+    bool pos_valid; // t,d refreshed by the position callback
+    bool goto_active;
+    bool tracking_enabled;
+    int slew_mask;
+    int slew_rate;
+    struct point *point;
+    struct ev_loop *loop;
+};
+
+static void client_free (struct client *c);
+
+static int write_all (struct client *c, const void *buf, int len)
+{
+    int n, done = 0;
+
+    if ((c->nx->flags & NEXSTAR_DEBUG))
+        msg ("client[%d]: < '%.*s'", c->num, len, (char *)buf);
+
+    while (done < len) {
+        n = write (c->fd, (char *)buf + done, len - done);
+        if (n < 0)
+            return -1;
+        done += n;
+    }
+    return len;
+}
+
+/* Return the number of bytes in command starting with 'cmd' (including it),
+ * or 0 if the command is unknown.
+ */
+static int command_length (uint8_t cmd)
+{
+    switch (cmd) {
+        case 'e': case 'E':
+        case 'L': case 'M':
+        case 'J': case 'V':
+        case 'm': case 't':
+        case 'w': case 'h':
+            return 1;
+        case 'K': case 'T':
+            return 2;
+        case 'P':
+            return 8;
+        case 'W': case 'H':
+            return 9;
+        case 'R': case 'S':
+            return 10;
+        case 'r': case 's':
+            return 18;
+    }
+    return 0;
+}
+
+/* Convert degrees to/from a fraction of a revolution with 'bits' precision.
+ */
+static uint32_t deg_to_rev (double deg, int bits)
+{
+    double rev = fmod (deg / 360., 1.);
+
+    if (rev < 0.)
+        rev += 1.;
+    return (uint32_t)((uint64_t)llrint (rev * ldexp (1., bits))
+                      & (((uint64_t)1 << bits) - 1));
+}
+
+static double rev_to_deg (uint32_t rev, int bits)
+{
+    return 360. * ldexp ((double)rev, -bits);
+}
+
+/* Parse "RRRR,DDDD" (bits=16) or "RRRRRRRR,DDDDDDDD" (bits=32) into
+ * ra, dec in degrees.
+ */
+static int parse_radec (const uint8_t *s, int bits, double *ra, double *dec)
+{
+    int digits = bits / 4;
+    char buf[MAX_COMMAND_BYTES];
+    unsigned long r, d;
+    char *endptr;
+
+    memcpy (buf, s, digits * 2 + 1);
+    buf[digits * 2 + 1] = '\0';
+    if (buf[digits] != ',')
+        return -1;
+    buf[digits] = '\0';
+    r = strtoul (buf, &endptr, 16);
+    if (*endptr != '\0')
+        return -1;
+    d = strtoul (buf + digits + 1, &endptr, 16);
+    if (*endptr != '\0')
+        return -1;
+    *ra = rev_to_deg (r, bits);
+    *dec = rev_to_deg (d, bits);
+    if (*dec > 180.)
+        *dec -= 360.;
+    return 0;
+}
+
+/* Refresh t,d from the position callback.
+ * Returns -1 if the position could not be read.
+ */
+static int update_position (struct nexstar *nx)
+{
+    nx->pos_valid = false;
+    if (nx->pos.cb)
+        nx->pos.cb (nx, nx->pos.arg);
+    return nx->pos_valid ? 0 : -1;
+}
+
+static void update_status (struct nexstar *nx)
+{
+    if (nx->status.cb)
+        nx->status.cb (nx, nx->status.arg);
+}
+
+/* Map NexStar fixed slew rates (1-9) to slew.h rates.
+ */
+static int slew_rate (int rate)
+{
+    if (rate <= 3)
+        return SLEW_RATE_GUIDE;
+    if (rate <= 5)
+        return SLEW_RATE_SLOW;
+    if (rate <= 7)
+        return SLEW_RATE_MEDIUM;
+    return SLEW_RATE_FAST;
+}
+
+/* Pass-through command: 'P', len, dest, cmd, a1, a2, a3, response bytes.
+ * Only axis slews are acted upon.  Anything else gets a response
+ * of the requested length filled with zeroes.
+ */
+static int process_passthrough (struct client *c, const uint8_t *p)
+{
+    struct nexstar *nx = c->nx;
+    int new_slew_mask = nx->slew_mask;
+    int plus, minus;
+    uint8_t resp[8];
+    int rate = -1;
+    int resp_len = p[7];
+
+    if (p[2] == DEV_AZM_RA) {
+        plus = SLEW_RA_PLUS;
+        minus = SLEW_RA_MINUS;
+    }
+    else if (p[2] == DEV_ALT_DEC) {
+        plus = SLEW_DEC_PLUS;
+        minus = SLEW_DEC_MINUS;
+    }
+    else
+        goto respond;
+
+    switch (p[3]) {
+        case MC_MOVE_POS:
+        case MC_MOVE_NEG:
+            rate = p[4];
+            break;
+        case MC_SET_POS_GUIDERATE:
+        case MC_SET_NEG_GUIDERATE: { // rate in 1/4 arcsec/sec
+            double asps = ((p[4] << 8) | p[5]) / 4.;
+            if (asps == 0.)
+                rate = 0;
+            else if (asps <= 60.)
+                rate = 2;
+            else if (asps <= 600.)
+                rate = 5;
+            else if (asps <= 3600.)
+                rate = 7;
+            else
+                rate = 9;
+            break;
+        }
+        default:
+            goto respond;
+    }
+    new_slew_mask &= ~(plus | minus);
+    if (rate > 0) {
+        if (p[3] == MC_MOVE_POS || p[3] == MC_SET_POS_GUIDERATE)
+            new_slew_mask |= plus;
+        else
+            new_slew_mask |= minus;
+        nx->slew_rate = slew_rate (rate);
+    }
+    if (new_slew_mask != nx->slew_mask) {
+        nx->slew_mask = new_slew_mask;
+        if (nx->slew.cb)
+            nx->slew.cb (nx, nx->slew.arg);
+    }
+respond:
+    if (resp_len > sizeof (resp) - 1)
+        resp_len = sizeof (resp) - 1;
+    memset (resp, 0, resp_len);
+    resp[resp_len] = '#';
+    return write_all (c, resp, resp_len + 1);
+}
+
+/* Return 0 on success, -1 on error.
+ * Returning -1 causes a disconnect, so don't do it when error can
+ * be returned in the command response to the client.
+ */
+static int process_command (struct client *c, const uint8_t *cmd)
+{
+    struct nexstar *nx = c->nx;
+    char buf[32];
+    int rc = 0;
+
+    if ((nx->flags & NEXSTAR_DEBUG))
+        msg ("client[%d]: > '%c'", c->num, cmd[0]);
+
+    switch (cmd[0]) {
+        /* E, e - get RA/DEC (16 or 32 bit)
+         */
+        case 'E':
+        case 'e': {
+            double ra, dec;
+            if (update_position (nx) < 0) {
+                rc = write_all (c, "#", 1);
+                break;
+            }
+            point_convert_position (nx->point, nx->t, nx->d, &ra, &dec);
+            if (cmd[0] == 'E')
+                snprintf (buf, sizeof (buf), "%04X,%04X#",
+                          deg_to_rev (ra, 16), deg_to_rev (dec, 16));
+            else
+                snprintf (buf, sizeof (buf), "%08X,%08X#",
+                          deg_to_rev (ra, 32), deg_to_rev (dec, 32));
+            rc = write_all (c, buf, strlen (buf));
+            break;
+        }
+        /* R, r - goto RA/DEC (16 or 32 bit)
+         * S, s - sync RA/DEC (16 or 32 bit)
+         */
+        case 'R':
+        case 'r':
+        case 'S':
+        case 's': {
+            int bits = (cmd[0] == 'R' || cmd[0] == 'S') ? 16 : 32;
+            double ra, dec;
+            if (parse_radec (cmd + 1, bits, &ra, &dec) < 0) {
+                if ((nx->flags & NEXSTAR_DEBUG))
+                    msg ("client[%d]: bad coordinates", c->num);
+                rc = write_all (c, "#", 1);
+                break;
+            }
+            point_set_target (nx->point, ra, dec);
+            if (cmd[0] == 'S' || cmd[0] == 's') {
+                if (update_position (nx) == 0) {
+                    point_set_position_ha (nx->point, nx->t);
+                    point_set_position_dec (nx->point, nx->d);
+                    point_sync_target (nx->point);
+                }
+            }
+            else if (nx->gto.cb)
+                nx->gto.cb (nx, nx->gto.arg);
+            rc = write_all (c, "#", 1);
+            break;
+        }
+        /* L - is goto in progress (returns "0#" or "1#")
+         */
+        case 'L':
+            update_status (nx);
+            rc = write_all (c, nx->goto_active ? "1#" : "0#", 2);
+            break;
+        /* M - cancel goto
+         */
+        case 'M':
+            if (nx->stop.cb) {
+                nx->stop.cb (nx, nx->stop.arg);
+                nx->slew_mask = 0;
+            }
+            rc = write_all (c, "#", 1);
+            break;
+        /* J - is alignment complete (returns 1 byte + '#')
+         */
+        case 'J':
+            rc = write_all (c, "\001#", 2);
+            break;
+        /* V - get version (returns major, minor + '#')
+         */
+        case 'V':
+            rc = write_all (c, "\004\012#", 3);
+            break;
+        /* m - get model (returns 1 byte + '#')
+         */
+        case 'm':
+            rc = write_all (c, "\006#", 2); // Advanced GT (equatorial)
+            break;
+        /* K - echo
+         */
+        case 'K':
+            buf[0] = cmd[1];
+            buf[1] = '#';
+            rc = write_all (c, buf, 2);
+            break;
+        /* t - get tracking mode (returns 1 byte + '#')
+         */
+        case 't': {
+            int lat_deg, lat_min;
+            double lat_sec;
+            update_status (nx);
+            point_get_latitude (nx->point, &lat_deg, &lat_min, &lat_sec);
+            buf[0] = !nx->tracking_enabled ? TRACK_OFF
+                   : lat_deg < 0 ? TRACK_EQ_SOUTH : TRACK_EQ_NORTH;
+            buf[1] = '#';
+            rc = write_all (c, buf, 2);
+            break;
+        }
+        /* T - set tracking mode
+         */
+        case 'T':
+            nx->tracking_enabled = (cmd[1] == TRACK_EQ_NORTH
+                                 || cmd[1] == TRACK_EQ_SOUTH);
+            if (nx->tracking.cb)
+                nx->tracking.cb (nx, nx->tracking.arg);
+            rc = write_all (c, "#", 1);
+            break;
+        /* P - pass through to motor controller or accessory
+         */
+        case 'P':
+            rc = process_passthrough (c, cmd);
+            break;
+        /* w - get location (returns 8 bytes + '#')
+         * lat deg, min, sec, 0=N/1=S, lng deg, min, sec, 0=E/1=W
+         */
+        case 'w': {
+            int deg, min;
+            double sec;
+            point_get_latitude (nx->point, &deg, &min, &sec);
+            buf[0] = abs (deg);
+            buf[1] = min;
+            buf[2] = lrint (sec);
+            buf[3] = deg < 0 ? 1 : 0;
+            point_get_longitude (nx->point, &deg, &min, &sec);
+            buf[4] = abs (deg);
+            buf[5] = min;
+            buf[6] = lrint (sec);
+            buf[7] = deg < 0 ? 1 : 0;
+            buf[8] = '#';
+            rc = write_all (c, buf, 9);
+            break;
+        }
+        /* W - set location (8 bytes as above)
+         */
+        case 'W':
+            point_set_latitude (nx->point, cmd[1] * (cmd[4] ? -1 : 1),
+                                cmd[2], cmd[3]);
+            point_set_longitude (nx->point, cmd[5], cmd[6], cmd[7]);
+            point_set_longitude_neg (nx->point, cmd[8] ? 1 : 0);
+            rc = write_all (c, "#", 1);
+            break;
+        /* h - get time (returns 8 bytes + '#')
+         * hour, min, sec, month, day, year-2000, gmt offset, dst
+         */
+        case 'h': {
+            int hr, min, day, month, year;
+            double sec, offset;
+            point_get_localtime (nx->point, &hr, &min, &sec);
+            point_get_localdate (nx->point, &day, &month, &year);
+            point_get_gmtoff (nx->point, &offset);
+            buf[0] = hr;
+            buf[1] = min;
+            buf[2] = (int)sec;
+            buf[3] = month;
+            buf[4] = day;
+            buf[5] = year - 2000;
+            buf[6] = (signed char)lrint (offset / 3600.);
+            buf[7] = 0;
+            buf[8] = '#';
+            rc = write_all (c, buf, 9);
+            break;
+        }
+        /* H - set time
+         * N.B. ignored by pointing model.
+         */
+        case 'H':
+            rc = write_all (c, "#", 1);
+            break;
+    }
+    return rc < 0 ? -1 : 0;
+}
+
+static void client_cb (struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct client *c = (struct client *)((char *)w
+                        - offsetof (struct client, w));
+    int n;
+
+    n = read (c->fd, c->buf + c->len, sizeof (c->buf) - c->len);
+    if (n < 0) {
+        if (errno == EWOULDBLOCK || errno == EAGAIN)
+            goto out;
+        goto disconnect;
+    }
+    if (n == 0) // EOF
+        goto disconnect;
+    c->len += n;
+
+    while (c->len > 0) {
+        uint8_t cmd[MAX_COMMAND_BYTES];
+        int cmdlen = command_length (c->buf[0]);
+        /* Framing: discard unknown command characters.
+         */
+        if (cmdlen == 0) {
+            if ((c->nx->flags & NEXSTAR_DEBUG))
+                msg ("%s[%d]: dropping received 0x%x", __FUNCTION__, c->num,
+                     c->buf[0]);
+            memmove (&c->buf[0], &c->buf[1], --c->len);
+            continue;
+        }
+        /* Framing: wait for command arguments.
+         */
+        if (c->len < cmdlen)
+            goto out;
+        memcpy (cmd, c->buf, cmdlen);
+        memmove (c->buf, c->buf + cmdlen, c->len -= cmdlen);
+        if (process_command (c, cmd) < 0)
+            goto disconnect;
+    }
+out:
+    return;
+disconnect:
+    client_free (c);
+}
+
+static void client_free (struct client *c)
+{
+    if (c->fd != -1) {
+        close (c->fd);
+        c->fd = -1;
+        ev_io_stop (c->nx->loop, &c->w);
+    }
+}
+
+static struct client *client_alloc (struct nexstar *nx, int fd)
+{
+    int i;
+    struct client *c;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (nx->clients[i].fd == -1)
+            break;
+    }
+    if (i == MAX_CLIENTS)
+        return NULL; // no client slot
+    c = &nx->clients[i];
+    c->fd = fd;
+    c->len = 0;
+    ev_io_init (&c->w, client_cb, c->fd, EV_READ);
+    ev_io_start (c->nx->loop, &c->w);
+    return c;
+}
+
+/* Accept a connection and allocate client slot.
+ */
+static void listen_cb (struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct nexstar *nx = (struct nexstar *)((char *)w
+                        - offsetof (struct nexstar, listen_w));
+
+    if ((revents & EV_READ)) {
+        int cfd;
+        struct client *c;
+        if ((cfd = accept4 (nx->fd, NULL, NULL, SOCK_CLOEXEC)) < 0)
+            return;
+        if (!(c = client_alloc (nx, cfd))) { // too many open connections
+            close (cfd);
+            return;
+        }
+    }
+}
+
+static void slew_dump (int val)
+{
+    msg ("nexstar slew: (0x%x) %sN %sS %sE %sW", val,
+         (val & SLEW_DEC_PLUS) ? "*" : " ",
+         (val & SLEW_DEC_MINUS) ? "*" : " ",
+         (val & SLEW_RA_PLUS) ? "*" : " ",
+         (val & SLEW_RA_MINUS) ? "*" : " ");
+}
+
+int nexstar_get_slew_direction (struct nexstar *nx)
+{
+    if ((nx->flags & NEXSTAR_DEBUG))
+        slew_dump (nx->slew_mask);
+    return nx->slew_mask;
+}
+
+int nexstar_get_slew_rate (struct nexstar *nx)
+{
+    if ((nx->flags & NEXSTAR_DEBUG))
+        msg ("nexstar slew rate: %d", nx->slew_rate);
+    return nx->slew_rate;
+}
+
+bool nexstar_get_tracking (struct nexstar *nx)
+{
+    return nx->tracking_enabled;
+}
+
+void nexstar_set_position (struct nexstar *nx, double t, double d)
+{
+    nx->t = t;
+    nx->d = d;
+    nx->pos_valid = true;
+}
+
+void nexstar_set_status (struct nexstar *nx, bool goto_active, bool tracking)
+{
+    nx->goto_active = goto_active;
+    nx->tracking_enabled = tracking;
+}
+
+void nexstar_get_target (struct nexstar *nx, double *t, double *d)
+{
+    point_get_target (nx->point, t, d);
+}
+
+void nexstar_set_position_cb (struct nexstar *nx, nexstar_cb_f cb, void *arg)
+{
+    nx->pos.cb = cb;
+    nx->pos.arg = arg;
+}
+
+void nexstar_set_status_cb (struct nexstar *nx, nexstar_cb_f cb, void *arg)
+{
+    nx->status.cb = cb;
+    nx->status.arg = arg;
+}
+
+void nexstar_set_slew_cb (struct nexstar *nx, nexstar_cb_f cb, void *arg)
+{
+    nx->slew.cb = cb;
+    nx->slew.arg = arg;
+}
+
+void nexstar_set_goto_cb (struct nexstar *nx, nexstar_cb_f cb, void *arg)
+{
+    nx->gto.cb = cb;
+    nx->gto.arg = arg;
+}
+
+void nexstar_set_stop_cb (struct nexstar *nx, nexstar_cb_f cb, void *arg)
+{
+    nx->stop.cb = cb;
+    nx->stop.arg = arg;
+}
+
+void nexstar_set_tracking_cb (struct nexstar *nx, nexstar_cb_f cb, void *arg)
+{
+    nx->tracking.cb = cb;
+    nx->tracking.arg = arg;
+}
+
+int nexstar_init (struct nexstar *nx, int port, struct point *point,
+                  int flags)
+{
+    struct sockaddr_in addr;
+
+    nx->flags = flags;
+    nx->point = point;
+
+    nx->fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (nx->fd < 0)
+        return -1;
+    memset (&addr, 0, sizeof (struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons (port);
+    if (bind (nx->fd, (struct sockaddr *)&addr, sizeof (addr)) < 0)
+        return -1;
+    if (listen (nx->fd, LISTEN_BACKLOG) < 0)
+        return -1;
+
+    ev_io_init (&nx->listen_w, listen_cb, nx->fd, EV_READ);
+
+    if ((nx->flags & NEXSTAR_DEBUG))
+        msg ("listening on port %d", port);
+
+    return 0;
+}
+
+void nexstar_start (struct ev_loop *loop, struct nexstar *nx)
+{
+    int i;
+
+    nx->loop = loop;
+    ev_io_start (loop, &nx->listen_w);
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (nx->clients[i].fd != -1)
+            ev_io_start (loop, &nx->clients[i].w);
+    }
+}
+
+void nexstar_stop (struct ev_loop *loop, struct nexstar *nx)
+{
+    int i;
+
+    ev_io_stop (loop, &nx->listen_w);
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (nx->clients[i].fd != -1)
+            ev_io_stop (loop, &nx->clients[i].w);
+    }
+}
+
+struct nexstar *nexstar_new (void)
+{
+    struct nexstar *nx = xzmalloc (sizeof (*nx));
+    int i;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        nx->clients[i].fd = -1;
+        nx->clients[i].nx = nx;
+        nx->clients[i].num = i;
+    }
+    nx->fd = -1;
+
+    return nx;
+}
+
+void nexstar_destroy (struct nexstar *nx)
+{
+    int i;
+
+    if (nx) {
+        for (i = 0; i < MAX_CLIENTS; i++)
+            client_free (&nx->clients[i]);
+        if (nx->fd != -1)
+            close (nx->fd);
+        free (nx);
+    }
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
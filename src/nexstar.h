@@ -0,0 +1,76 @@
+#include <ev.h>
+#include <stdbool.h>
+
+#define DEFAULT_NEXSTAR_PORT  4033
+
+enum {
+    NEXSTAR_DEBUG = 1,
+};
+
+/* Implement the Celestron NexStar hand controller serial protocol,
+ * or the equatorial subset of it used by planetarium programs.
+ */
+
+struct nexstar;
+struct point;
+typedef void (*nexstar_cb_f)(struct nexstar *nx, void *arg);
+
+struct nexstar *nexstar_new (void);
+void nexstar_destroy (struct nexstar *nx);
+
+/* The pointing model 'point' is shared with the caller and other protocols.
+ */
+int nexstar_init (struct nexstar *nx, int port, struct point *point,
+                  int flags);
+
+/* Register callback that is triggered when the protocol needs
+ * a position update.  Callback should call nexstar_set_position().
+ */
+void nexstar_set_position_cb (struct nexstar *nx, nexstar_cb_f cb, void *arg);
+
+/* Register callback that is triggered when the protocol needs
+ * a status update.  Callback should call nexstar_set_status().
+ */
+void nexstar_set_status_cb (struct nexstar *nx, nexstar_cb_f cb, void *arg);
+
+/* Register callback that is triggered when slew (virtual) buttons
+ * are pressed or released.  Callback should call nexstar_get_slew_direction()
+ * and nexstar_get_slew_rate(), then make appropriate movement.
+ */
+void nexstar_set_slew_cb (struct nexstar *nx, nexstar_cb_f cb, void *arg);
+
+/* Register callback that is triggered when protocol wants to goto
+ * the target object.  Callback should call nexstar_get_target ()
+ * and then move to those coordinates.
+ */
+void nexstar_set_goto_cb (struct nexstar *nx, nexstar_cb_f cb, void *arg);
+
+/* Register callback that is triggered when protocol wants to stop all motion.
+ */
+void nexstar_set_stop_cb (struct nexstar *nx, nexstar_cb_f cb, void *arg);
+
+/* Register callback that is triggered when protocol turns tracking
+ * on or off.  Callback should call nexstar_get_tracking().
+ */
+void nexstar_set_tracking_cb (struct nexstar *nx, nexstar_cb_f cb, void *arg);
+
+/* Set t,d position in degrees.
+ */
+void nexstar_set_position (struct nexstar *nx, double t, double d);
+
+/* Set goto in progress and RA tracking status.
+ */
+void nexstar_set_status (struct nexstar *nx, bool goto_active, bool tracking);
+
+int nexstar_get_slew_direction (struct nexstar *nx);
+int nexstar_get_slew_rate (struct nexstar *nx);
+bool nexstar_get_tracking (struct nexstar *nx);
+
+void nexstar_get_target (struct nexstar *nx, double *t, double *d);
+
+void nexstar_start (struct ev_loop *loop, struct nexstar *nx);
+void nexstar_stop (struct ev_loop *loop, struct nexstar *nx);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
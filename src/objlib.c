@@ -0,0 +1,217 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "objlib.h"
+
+#define OBJLIB_MAGIC "gemobj1"
+
+struct objlib_header {
+    char magic[8];
+    uint32_t nentries;
+    uint32_t nslots;    // power of two
+    // struct objlib_entry entries[nentries]
+    // uint32_t slots[nslots], entry index + 1, 0 = empty
+};
+
+struct objlib {
+    void *map;
+    size_t size;
+    const struct objlib_header *hdr;
+    const struct objlib_entry *entries;
+    const uint32_t *slots;
+};
+
+static uint32_t hash (int catalog, uint32_t number)
+{
+    return (number ^ ((uint32_t)catalog << 24)) * 2654435761u;
+}
+
+const struct objlib_entry *objlib_lookup (struct objlib *ol,
+                                          int catalog, uint32_t number)
+{
+    uint32_t mask = ol->hdr->nslots - 1;
+    uint32_t i = hash (catalog, number) & mask;
+    uint32_t slot;
+
+    while ((slot = ol->slots[i]) != 0) {
+        const struct objlib_entry *e = &ol->entries[slot - 1];
+        if (e->number == number && e->catalog == catalog)
+            return e;
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+int objlib_get_count (struct objlib *ol)
+{
+    return ol->hdr->nentries;
+}
+
+struct objlib *objlib_open (const char *path)
+{
+    struct objlib *ol;
+    struct stat sb;
+    uint32_t nslots, i, empty = 0;
+    size_t need;
+    int fd;
+    int saved_errno;
+
+    if (!(ol = calloc (1, sizeof (*ol))))
+        return NULL;
+    ol->map = MAP_FAILED;
+    if ((fd = open (path, O_RDONLY | O_CLOEXEC)) < 0)
+        goto error;
+    if (fstat (fd, &sb) < 0)
+        goto error_close;
+    if (sb.st_size < sizeof (*ol->hdr)) {
+        errno = EPROTO;
+        goto error_close;
+    }
+    ol->size = sb.st_size;
+    ol->map = mmap (NULL, ol->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ol->map == MAP_FAILED)
+        goto error_close;
+    close (fd);
+
+    ol->hdr = ol->map;
+    ol->entries = (const struct objlib_entry *)(ol->hdr + 1);
+    ol->slots = (const uint32_t *)(ol->entries + ol->hdr->nentries);
+    nslots = ol->hdr->nslots;
+    need = sizeof (*ol->hdr)
+         + (size_t)ol->hdr->nentries * sizeof (struct objlib_entry)
+         + (size_t)nslots * sizeof (uint32_t);
+    if (memcmp (ol->hdr->magic, OBJLIB_MAGIC, sizeof (ol->hdr->magic))
+            || nslots == 0 || (nslots & (nslots - 1)) != 0
+            || nslots <= ol->hdr->nentries || ol->size != need) {
+        errno = EPROTO;
+        goto error;
+    }
+    /* Check indices once so lookups need not, and that some slot is
+     * empty so a probe for a missing object terminates.
+     */
+    for (i = 0; i < nslots; i++) {
+        if (ol->slots[i] > ol->hdr->nentries) {
+            errno = EPROTO;
+            goto error;
+        }
+        if (ol->slots[i] == 0)
+            empty++;
+    }
+    if (empty == 0) {
+        errno = EPROTO;
+        goto error;
+    }
+    /* Names are printed as strings.
+     */
+    for (i = 0; i < ol->hdr->nentries; i++) {
+        if (ol->entries[i].name[sizeof (ol->entries[i].name) - 1] != '\0') {
+            errno = EPROTO;
+            goto error;
+        }
+    }
+    return ol;
+error_close:
+    saved_errno = errno;
+    close (fd);
+    errno = saved_errno;
+error:
+    saved_errno = errno;
+    objlib_close (ol);
+    errno = saved_errno;
+    return NULL;
+}
+
+void objlib_close (struct objlib *ol)
+{
+    if (ol) {
+        if (ol->map != MAP_FAILED)
+            munmap (ol->map, ol->size);
+        free (ol);
+    }
+}
+
+int objlib_write (const char *path, const struct objlib_entry *entries, int n)
+{
+    struct objlib_header hdr;
+    uint32_t nslots = 16;
+    uint32_t *slots;
+    FILE *f = NULL;
+    int i;
+    int saved_errno;
+
+    while (nslots < 2 * n) // load factor at most 1/2
+        nslots *= 2;
+    if (!(slots = calloc (nslots, sizeof (*slots))))
+        return -1;
+    for (i = 0; i < n; i++) {
+        uint32_t s = hash (entries[i].catalog, entries[i].number)
+                   & (nslots - 1);
+        while (slots[s] != 0) {
+            const struct objlib_entry *e = &entries[slots[s] - 1];
+            if (e->number == entries[i].number
+                                    && e->catalog == entries[i].catalog) {
+                errno = EEXIST;
+                goto error;
+            }
+            s = (s + 1) & (nslots - 1);
+        }
+        slots[s] = i + 1;
+    }
+
+    memset (&hdr, 0, sizeof (hdr));
+    memcpy (hdr.magic, OBJLIB_MAGIC, sizeof (hdr.magic));
+    hdr.nentries = n;
+    hdr.nslots = nslots;
+
+    if (!(f = fopen (path, "w")))
+        goto error;
+    if (fwrite (&hdr, sizeof (hdr), 1, f) != 1
+            || (n > 0 && fwrite (entries, sizeof (*entries), n, f) != n)
+            || fwrite (slots, sizeof (*slots), nslots, f) != nslots)
+        goto error;
+    free (slots);
+    return fclose (f);
+error:
+    saved_errno = errno;
+    if (f)
+        fclose (f);
+    free (slots);
+    errno = saved_errno;
+    return -1;
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,49 @@
+/* Object library
+ *
+ * A table of named objects (Messier, NGC, bright stars) generated by
+ * mkobjlib and mapped read-only.  Lookup by catalog and number goes
+ * through an open addressing hash index stored in the same file, so
+ * selecting an object costs a probe or two and no parsing.  Positions
+ * are J2000.
+ */
+
+#include <stdint.h>
+
+struct objlib;
+
+enum {
+    OBJLIB_MESSIER = 'M',
+    OBJLIB_NGC = 'N',
+    OBJLIB_STAR = 'S',
+};
+
+struct objlib_entry {
+    uint32_t number;
+    uint8_t catalog;    // OBJLIB_*
+    uint8_t reserved[3];
+    float ra, dec;      // J2000 (degrees)
+    float mag;          // visual magnitude
+    char name[16];      // NULL terminated
+};
+
+/* Map object library 'path'.  Returns NULL with errno set on failure.
+ */
+struct objlib *objlib_open (const char *path);
+void objlib_close (struct objlib *ol);
+
+/* Find object by catalog and number.  Returns NULL if not found.
+ */
+const struct objlib_entry *objlib_lookup (struct objlib *ol,
+                                          int catalog, uint32_t number);
+
+int objlib_get_count (struct objlib *ol);
+
+/* Write 'n' objects to a new library at 'path' (used by mkobjlib).
+ * Returns 0 on success, -1 on failure with errno set (EEXIST on a
+ * duplicate catalog number).
+ */
+int objlib_write (const char *path, const struct objlib_entry *entries, int n);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -22,25 +22,88 @@
  *  See also:  http://www.gnu.org/licenses/
 \*****************************************************************************/
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <libnova/libnova.h>
 #include <math.h>
 
 #include "point.h"
+#include "model.h"
+#include "syncmap.h"
+#include "horizon.h"
 #include "log.h"
 
 static const double sol_sid_ratio = 1.002737909350795; // solar/sidereal day
+static const double default_lst_interval = 60.; // full LST calc (sec)
+static const double apparent_interval = 600.;   // precession/nutation (sec)
+static const double j2000 = 2451545.0;          // Julian date of J2000.0
+static const double aberration_k = 20.49552;    // constant of aberration (")
+
+#define STATE_MAGIC "gempnt1"
+#define BATCH_CHUNK 256
+
+enum {
+    STATE_LAT = 1,
+    STATE_LNG_POS = 2,
+    STATE_LNG_SIGN = 4,
+};
+
+/* State file: header followed by 'nsyncs' syncs, in host byte order.
+ */
+struct state_header {
+    char magic[8];
+    uint32_t nsyncs;
+    uint32_t flags;         // POINT_WEST at time of save
+    uint32_t site;          // STATE_* bits for site values that were set
+    uint32_t reserved;
+    double lat, lng;        // degrees, east longitude positive
+};
+
+struct state_sync {
+    double t, d;            // uncorrected telescope position (deg)
+    double h, dec;          // observed (ha,dec) apparent place (deg)
+};
+
+/* Cached mean (J2000) to apparent place transformation.
+ */
+struct apparent {
+    double epoch;           // CLOCK_MONOTONIC time of calculation, 0 = none
+    double m[3][3];         // precession then nutation: J2000 -> true of date
+    double v[3];            // earth velocity / c, equatorial of date
+};
 
 struct point {
     int flags;
     struct lnh_lnlat_posn   observer; // observer's latitude, longitude
     struct ln_equ_posn      posn_raw; // uncorrected telescope position (deg)
-    struct ln_equ_posn      zpc;      // zero point correction (deg)
+    struct model            *model;   // raw <-> (ha,dec) correction
+    struct syncmap          *syncmap; // local residuals of model
+    struct horizon          *horizon; // local horizon, if set
     struct lnh_equ_posn     target;   // ra,dec of current "target" (deg)
+    bool target_apparent;             // target is already apparent place
+    int epoch;                        // POINT_EPOCH_* of external coordinates
     int lng_pos_isset:1;
     int lng_sign_isset:1;
+    int lat_isset:1;
+    char *state_path;                 // persist state here, if set
 
     double utc_offset;
+
+    double lst_interval;    // seconds between full GAST calculations
+    double gast;            // apparent Greenwich sidereal time (hours)
+    double gast_epoch;      // CLOCK_MONOTONIC time of gast (sec), 0 = none
+
+    struct apparent app;
 };
 
 /* Get the local time, derived from the system clock.
@@ -79,15 +142,53 @@ void point_get_localdate (struct point *p, int *day, int *month, int *year)
     *year = zd.years;
 }
 
+static void save_state (struct point *p);
+
+static double monotime (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+/* Get the apparent Greenwich sidereal time, in hours.
+ * ln_get_apparent_sidereal_time() evaluates the nutation series for the
+ * equation of the equinoxes, which changes by only milliseconds per day,
+ * so do that once per lst_interval and advance the result at the sidereal
+ * rate using the monotonic clock in between.  The wall clock is consulted
+ * again at each refresh, so clock steps are picked up then.
+ */
+static double get_gast (struct point *p)
+{
+    double now = monotime ();
+    double elapsed = now - p->gast_epoch;
+
+    if (p->gast_epoch == 0. || elapsed < 0. || elapsed >= p->lst_interval) {
+        p->gast = ln_get_apparent_sidereal_time (ln_get_julian_from_sys ());
+        p->gast_epoch = now;
+        elapsed = 0.;
+    }
+    return fmod (p->gast + elapsed * sol_sid_ratio / 3600., 24.);
+}
+
+void point_set_lst_interval (struct point *p, double seconds)
+{
+    p->lst_interval = seconds;
+    p->gast_epoch = 0.;
+
+    if ((p->flags & POINT_DEBUG))
+        msg ("%s: %.3lf", __FUNCTION__, seconds);
+}
+
 /* Get the apparent local sidereal time, in degrees,
  * derived from the system clock and longitude.
  * Assumes point_set_longitude() and point_set_longitude_neg()
  * have already been called.
  */
-static double get_lst (struct point *p)
+double point_get_lst (struct point *p)
 {
-    double jd = ln_get_julian_from_sys (); // UT
-    double gast = ln_get_apparent_sidereal_time (jd);
+    double gast = get_gast (p);
     double lng_hrs = ln_dms_to_deg (&p->observer.lng) / 15;
     double lst = gast + lng_hrs*sol_sid_ratio;
 
@@ -96,15 +197,254 @@ static double get_lst (struct point *p)
     return lst*15;
 }
 
+/* Precession matrix from J2000 to Julian centuries T after J2000,
+ * IAU 1976 angles (Meeus, Astronomical Algorithms, eq. 21.3).
+ */
+static void precession_matrix (double T, double m[3][3])
+{
+    double zeta = (2306.2181*T + 0.30188*T*T + 0.017998*T*T*T) / 3600.;
+    double z = (2306.2181*T + 1.09468*T*T + 0.018203*T*T*T) / 3600.;
+    double theta = (2004.3109*T - 0.42665*T*T - 0.041833*T*T*T) / 3600.;
+    double cz = cos (zeta * M_PI/180.), sz = sin (zeta * M_PI/180.);
+    double cZ = cos (z * M_PI/180.), sZ = sin (z * M_PI/180.);
+    double ct = cos (theta * M_PI/180.), st = sin (theta * M_PI/180.);
+
+    m[0][0] = cz*ct*cZ - sz*sZ;
+    m[0][1] = -sz*ct*cZ - cz*sZ;
+    m[0][2] = -st*cZ;
+    m[1][0] = cz*ct*sZ + sz*cZ;
+    m[1][1] = -sz*ct*sZ + cz*cZ;
+    m[1][2] = -st*sZ;
+    m[2][0] = cz*st;
+    m[2][1] = -sz*st;
+    m[2][2] = ct;
+}
+
+/* Nutation matrix from mean to true equator and equinox of date,
+ * given mean obliquity 'eps', and nutation in longitude 'dpsi' and
+ * obliquity 'deps' (radians).
+ */
+static void nutation_matrix (double eps, double dpsi, double deps,
+                             double m[3][3])
+{
+    double ce = cos (eps), se = sin (eps);
+    double ct = cos (eps + deps), st = sin (eps + deps);
+    double cp = cos (dpsi), sp = sin (dpsi);
+
+    m[0][0] = cp;
+    m[0][1] = -sp*ce;
+    m[0][2] = -sp*se;
+    m[1][0] = sp*ct;
+    m[1][1] = cp*ce*ct + se*st;
+    m[1][2] = cp*se*ct - ce*st;
+    m[2][0] = sp*st;
+    m[2][1] = cp*ce*st - se*ct;
+    m[2][2] = cp*se*st + ce*ct;
+}
+
+/* Recompute the mean to apparent transformation for the current time.
+ * Annual aberration uses the Sun's geometric longitude from the low
+ * precision formula (Meeus ch. 25) and ignores the E-terms (< 0.4").
+ * Light deflection and annual parallax are below the resolution of the
+ * mount and are ignored.
+ */
+static void update_apparent (struct point *p)
+{
+    double jd = ln_get_julian_from_sys ();
+    double T = (jd - j2000) / 36525.;
+    double eps = (23.439291111 - (46.8150*T + 0.00059*T*T
+                                 - 0.001813*T*T*T) / 3600.) * M_PI/180.;
+    double L0 = 280.46646 + 36000.76983*T + 0.0003032*T*T;
+    double M = (357.52911 + 35999.05029*T - 0.0001537*T*T) * M_PI/180.;
+    double C = (1.914602 - 0.004817*T - 0.000014*T*T) * sin (M)
+             + (0.019993 - 0.000101*T) * sin (2*M)
+             + 0.000289 * sin (3*M);
+    double sun = (L0 + C) * M_PI/180.;
+    double k = aberration_k / 3600. * M_PI/180.;
+    struct ln_nutation nut;
+    double P[3][3], N[3][3];
+    int i, j;
+
+    ln_get_nutation (jd, &nut);
+    precession_matrix (T, P);
+    nutation_matrix (eps, nut.longitude * M_PI/180.,
+                     nut.obliquity * M_PI/180., N);
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++)
+            p->app.m[i][j] = N[i][0]*P[0][j] + N[i][1]*P[1][j]
+                                             + N[i][2]*P[2][j];
+    eps += nut.obliquity * M_PI/180.;
+    p->app.v[0] = k * sin (sun);
+    p->app.v[1] = -k * cos (sun) * cos (eps);
+    p->app.v[2] = -k * cos (sun) * sin (eps);
+    p->app.epoch = monotime ();
+
+    if ((p->flags & POINT_DEBUG))
+        msg ("%s: T=%.8lf dpsi=%.2lf\" deps=%.2lf\"", __FUNCTION__, T,
+             nut.longitude * 3600., nut.obliquity * 3600.);
+}
+
+static struct apparent *get_apparent (struct point *p)
+{
+    double elapsed = monotime () - p->app.epoch;
+
+    if (p->app.epoch == 0. || elapsed < 0. || elapsed >= apparent_interval)
+        update_apparent (p);
+    return &p->app;
+}
+
+static void equ_to_vec (double ra, double dec, double v[3])
+{
+    ra *= M_PI/180.;
+    dec *= M_PI/180.;
+    v[0] = cos (dec) * cos (ra);
+    v[1] = cos (dec) * sin (ra);
+    v[2] = sin (dec);
+}
+
+static void vec_to_equ (const double v[3], double *ra, double *dec)
+{
+    double r = sqrt (v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+    double a = atan2 (v[1], v[0]) * 180./M_PI;
+
+    if (a < 0.)
+        a += 360.;
+    *ra = a;
+    *dec = asin (v[2] / r) * 180./M_PI;
+}
+
+/* Convert J2000 mean place (degrees) to apparent place (degrees).
+ */
+static void j2000_to_apparent (struct point *p, double *ra, double *dec)
+{
+    struct apparent *app = get_apparent (p);
+    double u[3], w[3];
+    int i;
+
+    equ_to_vec (*ra, *dec, u);
+    for (i = 0; i < 3; i++)
+        w[i] = app->m[i][0]*u[0] + app->m[i][1]*u[1] + app->m[i][2]*u[2]
+             + app->v[i];
+    vec_to_equ (w, ra, dec);
+}
+
+/* Convert catalog mean place (degrees) to apparent place (degrees).
+ */
+static void mean_to_apparent (struct point *p, double *ra, double *dec)
+{
+    if (p->epoch == POINT_EPOCH_J2000)
+        j2000_to_apparent (p, ra, dec);
+}
+
+/* Convert apparent place (degrees) to catalog mean place (degrees).
+ */
+static void apparent_to_mean (struct point *p, double *ra, double *dec)
+{
+    struct apparent *app;
+    double u[3], w[3];
+    int i;
+
+    if (p->epoch == POINT_EPOCH_JNOW)
+        return;
+    app = get_apparent (p);
+    equ_to_vec (*ra, *dec, u);
+    for (i = 0; i < 3; i++)
+        u[i] -= app->v[i];
+    for (i = 0; i < 3; i++) // inverse of rotation is its transpose
+        w[i] = app->m[0][i]*u[0] + app->m[1][i]*u[1] + app->m[2][i]*u[2];
+    vec_to_equ (w, ra, dec);
+}
+
+/* Batch conversion.  Work proceeds in chunks held on the stack, one
+ * stage per loop over restrict-qualified arrays, so the arithmetic stages
+ * (rotation, aberration, hour angle) vectorize where the target has
+ * double precision SIMD.  Trig stages are libm calls.
+ */
+void point_batch_convert (struct point *p, int epoch, int n,
+                          const double *restrict ra,
+                          const double *restrict dec,
+                          double *restrict ha, double *restrict hdec,
+                          double *restrict t, double *restrict d)
+{
+    double x[BATCH_CHUNK], y[BATCH_CHUNK], z[BATCH_CHUNK];
+    const double k = M_PI/180.;
+    double lst = point_get_lst (p);
+    int base, i;
+
+    for (base = 0; base < n; base += BATCH_CHUNK) {
+        int len = n - base < BATCH_CHUNK ? n - base : BATCH_CHUNK;
+        const double *restrict r = ra + base;
+        const double *restrict de = dec + base;
+        double *restrict h = ha + base;
+        double *restrict hd = hdec + base;
+
+        for (i = 0; i < len; i++) {
+            double cd = cos (de[i] * k);
+            x[i] = cd * cos (r[i] * k);
+            y[i] = cd * sin (r[i] * k);
+            z[i] = sin (de[i] * k);
+        }
+        if (epoch == POINT_EPOCH_J2000) {
+            struct apparent *app = get_apparent (p);
+            const double m00 = app->m[0][0], m01 = app->m[0][1];
+            const double m02 = app->m[0][2], m10 = app->m[1][0];
+            const double m11 = app->m[1][1], m12 = app->m[1][2];
+            const double m20 = app->m[2][0], m21 = app->m[2][1];
+            const double m22 = app->m[2][2];
+            const double v0 = app->v[0], v1 = app->v[1], v2 = app->v[2];
+
+            for (i = 0; i < len; i++) {
+                double xi = x[i], yi = y[i], zi = z[i];
+                x[i] = m00*xi + m01*yi + m02*zi + v0;
+                y[i] = m10*xi + m11*yi + m12*zi + v1;
+                z[i] = m20*xi + m21*yi + m22*zi + v2;
+            }
+        }
+        for (i = 0; i < len; i++) {
+            h[i] = atan2 (y[i], x[i]) / k;
+            hd[i] = atan2 (z[i], sqrt (x[i]*x[i] + y[i]*y[i])) / k;
+        }
+        for (i = 0; i < len; i++) { // HA = LST - RA, wrapped to [-180,180)
+            double a = lst - h[i];
+            h[i] = a - 360. * floor ((a + 180.) / 360.);
+        }
+    }
+    if (!t || !d)
+        return;
+    for (i = 0; i < n; i++) {
+        double dh, dd;
+        syncmap_get_correction (p->syncmap, ha[i], hdec[i], &dh, &dd);
+        model_sky_to_raw (p->model, ha[i] - dh, hdec[i] - dd, &t[i], &d[i]);
+        t[i] -= 360. * floor ((t[i] + 180.) / 360.);
+    }
+}
+
+void point_set_epoch (struct point *p, int epoch)
+{
+    p->epoch = epoch;
+
+    if ((p->flags & POINT_DEBUG))
+        msg ("%s: %s", __FUNCTION__,
+             epoch == POINT_EPOCH_JNOW ? "JNow" : "J2000");
+}
+
+int point_get_epoch (struct point *p)
+{
+    return p->epoch;
+}
+
 void point_set_latitude (struct point *p, int deg, int min, double sec)
 {
     p->observer.lat.neg = (deg < 0);
     p->observer.lat.degrees = abs (deg);
     p->observer.lat.minutes = min;
     p->observer.lat.seconds = sec;
+    p->lat_isset = 1;
+    model_set_latitude (p->model, ln_dms_to_deg (&p->observer.lat));
 
     if ((p->flags & POINT_DEBUG))
         msg ("%s: %.6lf", __FUNCTION__, ln_dms_to_deg (&p->observer.lat));
+    save_state (p);
 }
 
 void point_set_longitude (struct point *p, int deg, int min, double sec)
@@ -119,6 +459,7 @@ void point_set_longitude (struct point *p, int deg, int min, double sec)
         if (p->lng_sign_isset)
             msg ("%s: %.6lf", __FUNCTION__, ln_dms_to_deg (&p->observer.lng));
     }
+    save_state (p);
 }
 
 void point_set_longitude_neg (struct point *p, unsigned short neg)
@@ -130,6 +471,7 @@ void point_set_longitude_neg (struct point *p, unsigned short neg)
         if (p->lng_pos_isset)
             msg ("%s: %.6lf", __FUNCTION__, ln_dms_to_deg (&p->observer.lng));
     }
+    save_state (p);
 }
 
 void point_get_latitude (struct point *p, int *deg, int *min, double *sec)
@@ -152,6 +494,7 @@ void point_set_target_dec (struct point *p, int deg, int min, double sec)
     p->target.dec.degrees = abs (deg);
     p->target.dec.minutes = min;
     p->target.dec.seconds = sec;
+    p->target_apparent = false;
 
     if ((p->flags & POINT_DEBUG))
         msg ("%s: %.6lf", __FUNCTION__, ln_dms_to_deg (&p->target.dec));
@@ -162,16 +505,63 @@ void point_set_target_ra (struct point *p, int hr, int min, double sec)
     p->target.ra.hours = hr;
     p->target.ra.minutes = min;
     p->target.ra.seconds = sec;
+    p->target_apparent = false;
 
     if ((p->flags & POINT_DEBUG))
         msg ("%s: %.6lf", __FUNCTION__, ln_hms_to_deg (&p->target.ra));
 }
 
+void point_set_target (struct point *p, double ra, double dec)
+{
+    ln_deg_to_hms (ra, &p->target.ra);
+    ln_deg_to_dms (dec, &p->target.dec);
+    p->target_apparent = false;
+
+    if ((p->flags & POINT_DEBUG))
+        msg ("%s: %.6lf, %.6lf", __FUNCTION__, ra, dec);
+}
+
+void point_set_target_apparent (struct point *p, double ra, double dec)
+{
+    ln_deg_to_hms (ra, &p->target.ra);
+    ln_deg_to_dms (dec, &p->target.dec);
+    p->target_apparent = true;
+
+    if ((p->flags & POINT_DEBUG))
+        msg ("%s: %.6lf, %.6lf", __FUNCTION__, ra, dec);
+}
+
+void point_set_target_j2000 (struct point *p, double ra, double dec)
+{
+    if (p->epoch == POINT_EPOCH_J2000) {
+        point_set_target (p, ra, dec);
+        return;
+    }
+    j2000_to_apparent (p, &ra, &dec);
+    point_set_target_apparent (p, ra, dec);
+}
+
+/* Get apparent place of target (degrees).
+ */
+static void get_target_apparent (struct point *p, double *ra, double *dec)
+{
+    *ra = ln_hms_to_deg (&p->target.ra);
+    *dec = ln_dms_to_deg (&p->target.dec);
+    if (!p->target_apparent)
+        mean_to_apparent (p, ra, dec);
+}
+
 void point_get_target (struct point *p, double *t, double *d)
 {
-    double ha = get_lst (p) - ln_hms_to_deg (&p->target.ra) - p->zpc.ra;
-    double dec = ln_dms_to_deg (&p->target.dec) - p->zpc.dec;
+    double ra, dec, ha;
+    double dh, dd;
+
+    get_target_apparent (p, &ra, &dec);
+    ha = point_get_lst (p) - ra;
+    syncmap_get_correction (p->syncmap, ha, dec, &dh, &dd);
+    model_sky_to_raw (p->model, ha - dh, dec - dd, &ha, &dec);
 
+    ha = fmod (ha, 360.);
     if (ha > 180.)
         ha -= 360.;
     else if (ha < -180.)
@@ -179,13 +569,49 @@ void point_get_target (struct point *p, double *t, double *d)
 
     if (dec > 180.)
         dec -= 360.;
-    else if (ha < -180.)
-        ha += 360.;
+    else if (dec < -180.)
+        dec += 360.;
 
     *t = ha;
     *d = dec;
 }
 
+int point_set_horizon (struct point *p, const char *profile)
+{
+    if (!p->horizon && !(p->horizon = horizon_new ()))
+        return -1;
+    if (horizon_set_profile (p->horizon, profile) < 0)
+        return -1;
+    if ((p->flags & POINT_DEBUG))
+        msg ("%s: %s", __FUNCTION__, profile);
+    return 0;
+}
+
+bool point_target_visible (struct point *p)
+{
+    double ra, dec;
+
+    if (!p->horizon || !p->lat_isset)
+        return true;
+    get_target_apparent (p, &ra, &dec);
+    return horizon_check (p->horizon, ln_dms_to_deg (&p->observer.lat),
+                          point_get_lst (p) - ra, dec);
+}
+
+int point_batch_visible (struct point *p, int n, const double *ha,
+                         const double *hdec, bool *visible)
+{
+    int i;
+
+    if (!p->horizon || !p->lat_isset) {
+        for (i = 0; i < n; i++)
+            visible[i] = true;
+        return n;
+    }
+    return horizon_filter (p->horizon, ln_dms_to_deg (&p->observer.lat),
+                           n, ha, hdec, visible);
+}
+
 void point_set_position_ha (struct point *p, double t)
 {
     p->posn_raw.ra = t;
@@ -204,24 +630,60 @@ void point_set_position_dec (struct point *p, double d)
 
 void point_sync_target (struct point *p)
 {
-    double ha = get_lst (p) - ln_hms_to_deg (&p->target.ra);
-    double dec = ln_dms_to_deg (&p->target.dec);
+    double ra, dec, ha;
 
-    p->zpc.ra = ha - p->posn_raw.ra;
-    p->zpc.dec = dec - p->posn_raw.dec;
+    int i;
 
-    if ((p->flags & POINT_DEBUG))
-        msg ("%s: zero point corrections = (%.6lf, %.6lf)",
-             __FUNCTION__, p->zpc.ra, p->zpc.dec);
+    get_target_apparent (p, &ra, &dec);
+    ha = point_get_lst (p) - ra;
+
+    if (model_add_sync (p->model, p->posn_raw.ra, p->posn_raw.dec,
+                        ha, dec) < 0)
+        msg ("%s: model fit failed, keeping previous terms", __FUNCTION__);
+    if (syncmap_add (p->syncmap, p->posn_raw.ra, p->posn_raw.dec,
+                     ha, dec) < 0)
+        msg ("%s: out of memory for sync map", __FUNCTION__);
+    syncmap_update (p->syncmap, p->model);
+
+    if ((p->flags & POINT_DEBUG)) {
+        for (i = 0; i < MODEL_TERMS; i++)
+            msg ("%s: %s = %.1lf\"", __FUNCTION__, model_term_name (i),
+                 model_get_term (p->model, i) * 3600.);
+        msg ("%s: %d syncs, rms residual %.1lf\"", __FUNCTION__,
+             model_get_count (p->model), model_get_rms (p->model) * 3600.);
+    }
+    save_state (p);
+}
+
+void point_get_rates (struct point *p, double t, double d,
+                      double *t_rate, double *d_rate)
+{
+    model_get_rates (p->model, t, d, t_rate, d_rate);
+}
+
+void point_add_drift (struct point *p, double t, double d, double d_rate)
+{
+    if (model_add_drift (p->model, t, d, d_rate) < 0)
+        msg ("%s: model fit failed, keeping previous terms", __FUNCTION__);
+    syncmap_update (p->syncmap, p->model);
+
+    if ((p->flags & POINT_DEBUG)) {
+        msg ("%s: %.3lf %.3lf rate %.6lf", __FUNCTION__, t, d, d_rate);
+        msg ("%s: MA = %.1lf\" ME = %.1lf\"", __FUNCTION__,
+             model_get_term (p->model, MODEL_MA) * 3600.,
+             model_get_term (p->model, MODEL_ME) * 3600.);
+        msg ("%s: %d drifts, rms residual %.1lf\"", __FUNCTION__,
+             model_get_drifts (p->model), model_get_rms (p->model) * 3600.);
+    }
 }
 
 void point_get_position_ra (struct point *p, int *hr, int *min, double *sec)
 {
-    double ha = p->posn_raw.ra + p->zpc.ra; // hour angle
-    double lst = get_lst (p);               // apparent local sidereal time
-    struct ln_hms ra;                       // ra = lst - ha
+    double r, d;
+    struct ln_hms ra;
 
-    ln_deg_to_hms (lst - ha, &ra);
+    point_get_position (p, &r, &d);
+    ln_deg_to_hms (r, &ra);
     *hr = ra.hours;
     *min = ra.minutes;
     *sec = ra.seconds;
@@ -229,33 +691,270 @@ void point_get_position_ra (struct point *p, int *hr, int *min, double *sec)
 
 void point_get_position_dec (struct point *p, int *deg, int *min, double *sec)
 {
+    double r, d;
     struct ln_dms dec;
 
-    ln_deg_to_dms (p->posn_raw.dec + p->zpc.dec, &dec);
+    point_get_position (p, &r, &d);
+    ln_deg_to_dms (d, &dec);
     *deg = dec.degrees*(dec.neg ? -1 : 1);
     *min = dec.minutes;
     *sec = dec.seconds;
 }
 
+/* Convert uncorrected telescope position (t,d) to apparent place.
+ */
+static void raw_to_apparent (struct point *p, double t, double dec_raw,
+                             double *ra, double *dec)
+{
+    double ha, d, r, dh, dd;
+
+    model_raw_to_sky (p->model, t, dec_raw, &ha, &d);
+    syncmap_get_correction (p->syncmap, ha, d, &dh, &dd);
+    ha += dh;
+    d += dd;
+    r = fmod (point_get_lst (p) - ha, 360.);
+    if (r < 0.)
+        r += 360.;
+    *ra = r;
+    *dec = d;
+}
+
+void point_get_position_apparent (struct point *p, double *ra, double *dec)
+{
+    raw_to_apparent (p, p->posn_raw.ra, p->posn_raw.dec, ra, dec);
+}
+
+void point_get_position (struct point *p, double *ra, double *dec)
+{
+    point_get_position_apparent (p, ra, dec);
+    apparent_to_mean (p, ra, dec);
+}
+
+void point_convert_position (struct point *p, double t, double d,
+                             double *ra, double *dec)
+{
+    raw_to_apparent (p, t, d, ra, dec);
+    apparent_to_mean (p, ra, dec);
+}
+
+void point_convert_position_apparent (struct point *p, double t, double d,
+                                      double *ra, double *dec)
+{
+    raw_to_apparent (p, t, d, ra, dec);
+}
+
 void point_set_flags (struct point *p, int flags)
 {
     p->flags = flags;
 
     if ((p->flags & POINT_WEST))
-        p->zpc.ra = 90.;    // W horizon (until sync)
+        model_set_index (p->model, 90., 0.);    // W horizon (until sync)
     else
-        p->zpc.ra = -90.;   // E horizon (until sync)
+        model_set_index (p->model, -90., 0.);   // E horizon (until sync)
+}
+
+void point_reset_model (struct point *p)
+{
+    model_reset (p->model);
+    syncmap_clear (p->syncmap);
+
+    if ((p->flags & POINT_DEBUG))
+        msg ("%s", __FUNCTION__);
+    save_state (p);
+}
+
+/* Write state to a temporary file, then rename it over the old one,
+ * so a crash or power loss leaves either the old or new state intact.
+ */
+static void save_state (struct point *p)
+{
+    struct state_header hdr;
+    struct state_sync *syncs = NULL;
+    char *tmp = NULL;
+    int fd = -1;
+    int i, n;
+    size_t len;
+
+    if (!p->state_path)
+        return;
+    memset (&hdr, 0, sizeof (hdr));
+    memcpy (hdr.magic, STATE_MAGIC, sizeof (hdr.magic));
+    hdr.flags = p->flags & POINT_WEST;
+    hdr.lat = ln_dms_to_deg (&p->observer.lat);
+    hdr.lng = ln_dms_to_deg (&p->observer.lng);
+    if (p->lat_isset)
+        hdr.site |= STATE_LAT;
+    if (p->lng_pos_isset)
+        hdr.site |= STATE_LNG_POS;
+    if (p->lng_sign_isset)
+        hdr.site |= STATE_LNG_SIGN;
+    n = syncmap_get_count (p->syncmap);
+    hdr.nsyncs = n;
+    len = n * sizeof (*syncs);
+    if (n > 0 && !(syncs = malloc (len)))
+        goto error;
+    for (i = 0; i < n; i++)
+        syncmap_get_sync (p->syncmap, i, &syncs[i].t, &syncs[i].d,
+                          &syncs[i].h, &syncs[i].dec);
+
+    if (asprintf (&tmp, "%s.tmp", p->state_path) < 0) {
+        tmp = NULL;
+        goto error;
+    }
+    if ((fd = open (tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+        goto error;
+    if (write (fd, &hdr, sizeof (hdr)) != sizeof (hdr))
+        goto error;
+    if (len > 0 && write (fd, syncs, len) != len)
+        goto error;
+    if (fsync (fd) < 0 || close (fd) < 0) {
+        fd = -1;
+        goto error;
+    }
+    fd = -1;
+    if (rename (tmp, p->state_path) < 0)
+        goto error;
+
+    if ((p->flags & POINT_DEBUG))
+        msg ("%s: %s: %d syncs", __FUNCTION__, p->state_path, n);
+    goto done;
+error:
+    err ("%s", p->state_path);
+    if (fd != -1)
+        close (fd);
+    if (tmp)
+        (void)unlink (tmp);
+done:
+    free (tmp);
+    free (syncs);
+}
+
+/* Map state file and restore site and syncs.  A missing file is not
+ * an error.  Syncs saved with a different POINT_WEST setting are
+ * discarded, since declination axis direction depends on it.
+ */
+static int load_state (struct point *p, const char *path)
+{
+    struct stat sb;
+    const struct state_header *hdr;
+    const struct state_sync *syncs;
+    void *map = MAP_FAILED;
+    int fd, i, rc = -1;
+
+    if ((fd = open (path, O_RDONLY | O_CLOEXEC)) < 0)
+        return errno == ENOENT ? 0 : -1;
+    if (fstat (fd, &sb) < 0)
+        goto done;
+    if (sb.st_size < sizeof (*hdr)) {
+        errno = EPROTO;
+        goto done;
+    }
+    map = mmap (NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        goto done;
+    hdr = map;
+    syncs = (const struct state_sync *)(hdr + 1);
+    if (memcmp (hdr->magic, STATE_MAGIC, sizeof (hdr->magic)) != 0
+            || hdr->nsyncs > (sb.st_size - sizeof (*hdr)) / sizeof (*syncs)
+            || sb.st_size != sizeof (*hdr) + hdr->nsyncs * sizeof (*syncs)) {
+        errno = EPROTO;
+        goto done;
+    }
+    if ((hdr->site & STATE_LAT)) {
+        ln_deg_to_dms (hdr->lat, &p->observer.lat);
+        p->lat_isset = 1;
+        model_set_latitude (p->model, hdr->lat);
+    }
+    if ((hdr->site & STATE_LNG_POS)) {
+        ln_deg_to_dms (hdr->lng, &p->observer.lng);
+        p->lng_pos_isset = 1;
+    }
+    if ((hdr->site & STATE_LNG_SIGN))
+        p->lng_sign_isset = 1;
+    if (hdr->flags != (p->flags & POINT_WEST)) {
+        if (hdr->nsyncs > 0)
+            msg ("%s: alignment was saved for the other side of the pier,"
+                 " discarding %d syncs", path, hdr->nsyncs);
+    }
+    else {
+        for (i = 0; i < hdr->nsyncs; i++) {
+            if (syncmap_add (p->syncmap, syncs[i].t, syncs[i].d,
+                             syncs[i].h, syncs[i].dec) < 0)
+                goto done;
+            (void)model_add_sync (p->model, syncs[i].t, syncs[i].d,
+                                  syncs[i].h, syncs[i].dec);
+        }
+        syncmap_update (p->syncmap, p->model);
+    }
+    if ((p->flags & POINT_DEBUG))
+        msg ("%s: %s: lat %.6lf lng %.6lf, %d syncs", __FUNCTION__, path,
+             ln_dms_to_deg (&p->observer.lat),
+             ln_dms_to_deg (&p->observer.lng),
+             syncmap_get_count (p->syncmap));
+    rc = 0;
+done:
+    if (map != MAP_FAILED)
+        munmap (map, sb.st_size);
+    close (fd);
+    return rc;
+}
+
+int point_set_state_file (struct point *p, const char *path)
+{
+    char *cpy, *bad = NULL;
+    int rc = -1;
+
+    if (!(cpy = strdup (path)))
+        return -1;
+    free (p->state_path);
+    p->state_path = NULL;
+    if (load_state (p, path) < 0) {
+        /* Move an unreadable file aside rather than stop saving state
+         * for the whole run.
+         */
+        err ("%s", path);
+        if (asprintf (&bad, "%s.bad", path) < 0) {
+            bad = NULL;
+            goto done;
+        }
+        if (rename (path, bad) < 0)
+            goto done;
+        msg ("%s: moved aside to %s", path, bad);
+    }
+    p->state_path = cpy;
+    cpy = NULL;
+    rc = 0;
+done:
+    free (bad);
+    free (cpy);
+    return rc;
 }
 
 struct point *point_new (void)
 {
     struct point *p = calloc (1, sizeof (*p));
+
+    if (!p)
+        return NULL;
+    if (!(p->model = model_new ()) || !(p->syncmap = syncmap_new ())) {
+        model_destroy (p->model);
+        free (p);
+        return NULL;
+    }
+    model_set_index (p->model, -90., 0.);
+    p->lst_interval = default_lst_interval;
     return p;
 }
 
 void point_destroy (struct point *p)
 {
-    free (p);
+    if (p) {
+        horizon_destroy (p->horizon);
+        syncmap_destroy (p->syncmap);
+        model_destroy (p->model);
+        free (p->state_path);
+        free (p);
+    }
 }
 
 /*
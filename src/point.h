@@ -1,25 +1,33 @@
 /* Pointing model
  *
- * Conversion from externally provided catalog mean positions to "apparent
- * place" is currently lacking, thus parallax, light deflection, annual
- * aberration, precession, and nutation are not accounted for.  We just
- * go with the catalog mean for now.
+ * Externally provided coordinates are catalog mean positions for J2000
+ * (default) or JNow, selected with point_set_epoch().  J2000 positions
+ * are converted to apparent place (precession, nutation, and annual
+ * aberration) before use, and telescope positions are converted back.
+ * The per-epoch rotation matrix and aberration vector are cached and
+ * refreshed every few minutes, so conversion costs a few multiplies.
+ * Light deflection and parallax are ignored.  JNow coordinates are taken
+ * as apparent place and used without conversion.
  *
  * The apparent local sidereal time (LST) is obtained (from libnova) by
  * starting with the UNIX system time (GMT), converting to Julian date,
  * converting that to apparent sidereal time, then adding the east longitude.
  * Since HA = RA - LST, the LST enables us to convert catalog RA to HA.
  *
- * A "sync" operation (one star alignment) sets a zero point correction
- * for each axis that is used to convert HA,DEC to an instrument position
- * suitable for feeding to the motion controllers.  There is currently no
- * provision for correcting for collimation errors, non-perpendicularity
- * of the axes, polar misalignment, or tube flexure.
+ * Each "sync" operation adds an observation to a multi-term pointing
+ * model (see model.h) that converts HA,DEC to an instrument position
+ * suitable for feeding to the motion controllers.  With one sync this is
+ * a zero point correction for each axis; as syncs accumulate, collimation,
+ * non-perpendicularity of the axes, polar misalignment, and tube flexure
+ * are fitted too.  Residuals of the syncs against the model are then
+ * interpolated locally (see syncmap.h) to absorb what the terms cannot.
  *
  * Refs:
  * "Telecope Pointing" by Patrick Wallce, http://www.tpointsw.uk/pointing.htm
  */
 
+#include <stdbool.h>
+
 struct point;
 
 enum {
@@ -27,11 +35,21 @@ enum {
     POINT_WEST = 2,     // set initial point to western horizon, not eastern
 };
 
+enum {
+    POINT_EPOCH_J2000 = 0,
+    POINT_EPOCH_JNOW = 1,
+};
+
 struct point *point_new (void);
 void point_destroy (struct point *p);
 
 void point_set_flags (struct point *p, int flags);
 
+/* Set/get the epoch of external (catalog) coordinates.
+ */
+void point_set_epoch (struct point *p, int epoch);
+int point_get_epoch (struct point *p);
+
 /* Set observer's position (lat,lng)
  * Sign is set separately with _neg(), to support a quirk of LX200 protocol
  */
@@ -45,34 +63,133 @@ void point_get_latitude (struct point *p, int *deg, int *min, double *sec);
 void point_get_longitude (struct point *p, int *deg, int *min, double *sec);
 
 /* Set target object coordinates in (ra,dec).
- * The target object is a "register" used for syncing zero point corrections
+ * The target object is a "register" used for syncing the pointing model
  * and goto operations.
  */
 void point_set_target_dec (struct point *p, int deg, int min, double sec);
 void point_set_target_ra (struct point *p, int hr, int min, double sec);
 
+/* Set target object coordinates in (ra,dec) degrees.
+ */
+void point_set_target (struct point *p, double ra, double dec);
+
+/* Set target object apparent place (ra,dec) degrees, bypassing conversion.
+ */
+void point_set_target_apparent (struct point *p, double ra, double dec);
+
+/* Set target object J2000 coordinates (ra,dec) degrees, regardless of
+ * the configured epoch, e.g. from a built-in catalog.
+ */
+void point_set_target_j2000 (struct point *p, double ra, double dec);
+
 /* Get target object coordinates in uncorrected telescope position (degrees).
  * This will be used for goto.
  */
 void point_get_target (struct point *p, double *t, double *d);
 
-/* Set internal zero point corrections so that uncorrected telescope position
- * plus zpc equals (ha,dec) of target object.
+/* Add an observation to the pointing model: the uncorrected telescope
+ * position is pointing at (ha,dec) of target object.  Refit the model.
  */
 void point_sync_target (struct point *p);
 
+/* Convert 'n' catalog positions (ra[i],dec[i]) in 'epoch' (POINT_EPOCH_*)
+ * to apparent (ha[i],hdec[i]) and, if 't' and 'd' are non-NULL, to
+ * uncorrected telescope positions (t[i],d[i]), all in degrees.  Multiply
+ * t,d by steps/360 for motor steps.  Arrays must not overlap.
+ */
+void point_batch_convert (struct point *p, int epoch, int n,
+                          const double *restrict ra,
+                          const double *restrict dec,
+                          double *restrict ha, double *restrict hdec,
+                          double *restrict t, double *restrict d);
+
+/* Set local horizon profile (see horizon.h).  Until one is set, and
+ * until the site latitude is known, every position is considered visible.
+ * Returns -1 on parse error.
+ */
+int point_set_horizon (struct point *p, const char *profile);
+
+/* Return true if the target object is above the local horizon.
+ */
+bool point_target_visible (struct point *p);
+
+/* Set visible[i] for 'n' apparent places (ha[i],hdec[i]) in degrees,
+ * e.g. the output of point_batch_convert(), using the horizon table.
+ * Returns the number of visible positions.
+ */
+int point_batch_visible (struct point *p, int n, const double *ha,
+                         const double *hdec, bool *visible);
+
+/* Get axis rates (t_rate,d_rate), in degrees per degree of hour angle,
+ * that follow the sky at uncorrected telescope position (t,d) degrees,
+ * according to the pointing model: (1,0) until polar misalignment and
+ * the other terms are known.  Sync map residuals are not included.
+ */
+void point_get_rates (struct point *p, double t, double d,
+                      double *t_rate, double *d_rate);
+
+/* Add a drift observation to the pointing model: at uncorrected
+ * telescope position (t,d), following the sky took a DEC axis rate of
+ * 'd_rate' degrees per degree of hour angle.  Refit the model.
+ * Drift observations are not saved in the state file.
+ */
+void point_add_drift (struct point *p, double t, double d, double d_rate);
+
+/* Discard all syncs, reverting to the initial index corrections.
+ */
+void point_reset_model (struct point *p);
+
+/* Restore site and syncs from 'path' if it exists, then rewrite it
+ * (atomically) whenever they change.  Call after point_set_flags().
+ * Syncs are in uncorrected telescope position, so they remain valid only
+ * if the mount is started from the same (park) position each time.
+ * A file that cannot be loaded is renamed to 'path'.bad and saving
+ * continues; -1 is returned only if state will not be saved.
+ */
+int point_set_state_file (struct point *p, const char *path);
+
 /* Set/update uncorrected telescope position (in degrees).
  */
 void point_set_position_ha (struct point *p, double t);
 void point_set_position_dec (struct point *p, double dec);
 
 /* Get corrected telescope position in (ra,dec).
- * This is computed from uncorrected telescope position, zero point
- * corrections, and apparent local sidereal time.
+ * This is computed from uncorrected telescope position, the pointing
+ * model, and apparent local sidereal time.
  */
 void point_get_position_ra (struct point *p, int *hr, int *min, double *sec);
 void point_get_position_dec (struct point *p, int *deg, int *min, double *sec);
 
+/* Get corrected telescope position in (ra,dec) degrees.
+ */
+void point_get_position (struct point *p, double *ra, double *dec);
+
+/* Get corrected telescope position as apparent place (ra,dec) degrees.
+ */
+void point_get_position_apparent (struct point *p, double *ra, double *dec);
+
+/* Convert uncorrected telescope position (t,d) degrees to (ra,dec)
+ * degrees in the configured epoch, like point_get_position() but
+ * without changing the shared telescope position.
+ */
+void point_convert_position (struct point *p, double t, double d,
+                             double *ra, double *dec);
+
+/* Likewise, but to apparent place, like point_get_position_apparent().
+ */
+void point_convert_position_apparent (struct point *p, double t, double d,
+                                      double *ra, double *dec);
+
+/* Set the interval between full apparent sidereal time calculations.
+ * In between, sidereal time is extrapolated from the monotonic clock.
+ * An interval of zero recalculates on every call.
+ */
+void point_set_lst_interval (struct point *p, double seconds);
+
+/* Get the apparent local sidereal time, in degrees.
+ */
+double point_get_lst (struct point *p);
+
 void point_get_gmtoff (struct point *p, double *offset);
 void point_get_localtime (struct point *p, int *hour, int *min, double *sec);
 void point_get_localdate (struct point *p, int *day, int *month, int *year);
@@ -0,0 +1,388 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* Ref: Stellarium telescope control plugin, "Stellarium Telescope Protocol"
+ * https://free-astro.org/images/b/b7/Stellarium_telescope_protocol.txt
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <ev.h>
+
+#include "log.h"
+#include "xzmalloc.h"
+#include "point.h"
+
+#include "stellarium.h"
+
+#define LISTEN_BACKLOG 5
+#define MAX_CLIENTS 16
+
+#define GOTO_LENGTH     20
+#define POSITION_LENGTH 24
+
+static const double report_period = 0.5;    // current position (sec)
+
+struct client {
+    int fd;
+    ev_io w;
+    uint8_t buf[GOTO_LENGTH];
+    int len;
+    struct stellarium *st;
+    int num;
+};
+
+struct callback {
+    stellarium_cb_f cb;
+    void *arg;
+};
+
+struct stellarium {
+    int flags;
+    int fd;
+    struct callback pos;
+    struct callback gto;
+    ev_io listen_w;
+    ev_timer report_w;
+    struct client clients[MAX_CLIENTS];
+    int nclients;
+    double t, d; // axis angular position (degrees)
+    bool pos_valid; // t,d refreshed by the position callback
+    struct point *point;
+    struct ev_loop *loop;
+};
+
+static void client_free (struct client *c);
+
+static void put_u16 (uint8_t *p, uint16_t val)
+{
+    p[0] = val & 0xff;
+    p[1] = (val >> 8) & 0xff;
+}
+
+static void put_u32 (uint8_t *p, uint32_t val)
+{
+    put_u16 (p, val & 0xffff);
+    put_u16 (p + 2, (val >> 16) & 0xffff);
+}
+
+static void put_u64 (uint8_t *p, uint64_t val)
+{
+    put_u32 (p, val & 0xffffffff);
+    put_u32 (p + 4, (val >> 32) & 0xffffffff);
+}
+
+static uint16_t get_u16 (const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32 (const uint8_t *p)
+{
+    return get_u16 (p) | ((uint32_t)get_u16 (p + 2) << 16);
+}
+
+/* Handle a complete goto message.
+ */
+static int process_goto (struct client *c)
+{
+    struct stellarium *st = c->st;
+    uint32_t ra_int;
+    int32_t dec_int;
+    double ra, dec;
+
+    if (get_u16 (&c->buf[0]) != GOTO_LENGTH || get_u16 (&c->buf[2]) != 0) {
+        if ((st->flags & STELLARIUM_DEBUG))
+            msg ("stellarium[%d]: protocol error", c->num);
+        errno = EPROTO;
+        return -1;
+    }
+    ra_int = get_u32 (&c->buf[12]);
+    dec_int = (int32_t)get_u32 (&c->buf[16]);
+    ra = ra_int * (360. / 4294967296.);
+    dec = dec_int * (90. / 1073741824.);
+
+    if ((st->flags & STELLARIUM_DEBUG))
+        msg ("stellarium[%d]: > goto %.6f, %.6f", c->num, ra, dec);
+
+    point_set_target (st->point, ra, dec);
+    if (st->gto.cb)
+        st->gto.cb (st, st->gto.arg);
+    return 0;
+}
+
+static void client_cb (struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct client *c = (struct client *)((char *)w
+                        - offsetof (struct client, w));
+    int n;
+
+    n = read (c->fd, c->buf + c->len, sizeof (c->buf) - c->len);
+    if (n < 0) {
+        if (errno == EWOULDBLOCK || errno == EAGAIN)
+            goto out;
+        goto disconnect;
+    }
+    if (n == 0) // EOF
+        goto disconnect;
+    c->len += n;
+    if (c->len < sizeof (c->buf))
+        goto out;
+    c->len = 0;
+    if (process_goto (c) < 0)
+        goto disconnect;
+out:
+    return;
+disconnect:
+    client_free (c);
+}
+
+static int send_position (struct client *c, const uint8_t *buf, int len)
+{
+    int n;
+
+    n = write (c->fd, buf, len);
+    if (n < 0) {
+        if (errno == EWOULDBLOCK || errno == EAGAIN)
+            return 0; // client isn't keeping up, drop this one
+        return -1;
+    }
+    if (n < len) { // framing is lost
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+/* Push the current position to all connected clients.
+ * The position is obtained once per period regardless of client count,
+ * and nothing is sent if it could not be obtained.
+ */
+static void report_cb (struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct stellarium *st = (struct stellarium *)((char *)w
+                            - offsetof (struct stellarium, report_w));
+    uint8_t buf[POSITION_LENGTH];
+    double ra, dec;
+    int i;
+
+    st->pos_valid = false;
+    if (st->pos.cb)
+        st->pos.cb (st, st->pos.arg);
+    if (!st->pos_valid)
+        return;
+    point_convert_position (st->point, st->t, st->d, &ra, &dec);
+
+    put_u16 (&buf[0], POSITION_LENGTH);
+    put_u16 (&buf[2], 0);
+    put_u64 (&buf[4], (uint64_t)llrint (ev_now (loop) * 1E6));
+    put_u32 (&buf[12], (uint32_t)llrint (ra * (4294967296. / 360.)));
+    put_u32 (&buf[16], (uint32_t)(int32_t)lrint (dec * (1073741824. / 90.)));
+    put_u32 (&buf[20], 0);
+
+    if ((st->flags & STELLARIUM_DEBUG))
+        msg ("stellarium: < position %.6f, %.6f", ra, dec);
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        struct client *c = &st->clients[i];
+        if (c->fd != -1 && send_position (c, buf, sizeof (buf)) < 0)
+            client_free (c);
+    }
+}
+
+static void client_free (struct client *c)
+{
+    if (c->fd != -1) {
+        close (c->fd);
+        c->fd = -1;
+        ev_io_stop (c->st->loop, &c->w);
+        if (--c->st->nclients == 0)
+            ev_timer_stop (c->st->loop, &c->st->report_w);
+    }
+}
+
+static struct client *client_alloc (struct stellarium *st, int fd)
+{
+    int i;
+    struct client *c;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (st->clients[i].fd == -1)
+            break;
+    }
+    if (i == MAX_CLIENTS)
+        return NULL; // no client slot
+    c = &st->clients[i];
+    c->fd = fd;
+    c->len = 0;
+    ev_io_init (&c->w, client_cb, c->fd, EV_READ);
+    ev_io_start (c->st->loop, &c->w);
+    if (st->nclients++ == 0)
+        ev_timer_again (st->loop, &st->report_w);
+    return c;
+}
+
+/* Accept a connection and allocate client slot.
+ */
+static void listen_cb (struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct stellarium *st = (struct stellarium *)((char *)w
+                            - offsetof (struct stellarium, listen_w));
+
+    if ((revents & EV_READ)) {
+        int cfd;
+        struct client *c;
+        if ((cfd = accept4 (st->fd, NULL, NULL,
+                            SOCK_CLOEXEC | SOCK_NONBLOCK)) < 0)
+            return;
+        if (!(c = client_alloc (st, cfd))) { // too many open connections
+            close (cfd);
+            return;
+        }
+    }
+}
+
+void stellarium_set_position_cb (struct stellarium *st,
+                                 stellarium_cb_f cb, void *arg)
+{
+    st->pos.cb = cb;
+    st->pos.arg = arg;
+}
+
+void stellarium_set_goto_cb (struct stellarium *st,
+                             stellarium_cb_f cb, void *arg)
+{
+    st->gto.cb = cb;
+    st->gto.arg = arg;
+}
+
+void stellarium_set_position (struct stellarium *st, double t, double d)
+{
+    st->t = t;
+    st->d = d;
+    st->pos_valid = true;
+}
+
+void stellarium_get_target (struct stellarium *st, double *t, double *d)
+{
+    point_get_target (st->point, t, d);
+}
+
+int stellarium_init (struct stellarium *st, int port, struct point *point,
+                     int flags)
+{
+    struct sockaddr_in addr;
+
+    st->flags = flags;
+    st->point = point;
+
+    st->fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (st->fd < 0)
+        return -1;
+    memset (&addr, 0, sizeof (struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons (port);
+    if (bind (st->fd, (struct sockaddr *)&addr, sizeof (addr)) < 0)
+        return -1;
+    if (listen (st->fd, LISTEN_BACKLOG) < 0)
+        return -1;
+
+    ev_io_init (&st->listen_w, listen_cb, st->fd, EV_READ);
+    ev_timer_init (&st->report_w, report_cb, 0., report_period);
+
+    if ((st->flags & STELLARIUM_DEBUG))
+        msg ("listening on port %d", port);
+
+    return 0;
+}
+
+void stellarium_start (struct ev_loop *loop, struct stellarium *st)
+{
+    int i;
+
+    st->loop = loop;
+    ev_io_start (loop, &st->listen_w);
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (st->clients[i].fd != -1)
+            ev_io_start (loop, &st->clients[i].w);
+    }
+    if (st->nclients > 0)
+        ev_timer_again (loop, &st->report_w);
+}
+
+void stellarium_stop (struct ev_loop *loop, struct stellarium *st)
+{
+    int i;
+
+    ev_io_stop (loop, &st->listen_w);
+    ev_timer_stop (loop, &st->report_w);
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (st->clients[i].fd != -1)
+            ev_io_stop (loop, &st->clients[i].w);
+    }
+}
+
+struct stellarium *stellarium_new (void)
+{
+    struct stellarium *st = xzmalloc (sizeof (*st));
+    int i;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        st->clients[i].fd = -1;
+        st->clients[i].st = st;
+        st->clients[i].num = i;
+    }
+    st->fd = -1;
+
+    return st;
+}
+
+void stellarium_destroy (struct stellarium *st)
+{
+    int i;
+
+    if (st) {
+        for (i = 0; i < MAX_CLIENTS; i++)
+            client_free (&st->clients[i]);
+        if (st->fd != -1)
+            close (st->fd);
+        free (st);
+    }
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,64 @@
+#include <ev.h>
+
+#define DEFAULT_STELLARIUM_PORT  10001
+
+enum {
+    STELLARIUM_DEBUG = 1,
+};
+
+/* Implement the Stellarium Telescope Control binary protocol.
+ * All integers are little endian.
+ *
+ * Goto (client to server, 20 bytes):
+ *   uint16 length (20)
+ *   uint16 type (0)
+ *   int64  client time in microseconds since the UNIX epoch (ignored)
+ *   uint32 ra (0x100000000 = 24h)
+ *   int32  dec (0x40000000 = 90 degrees)
+ *
+ * Current position (server to client, 24 bytes, sent periodically):
+ *   uint16 length (24)
+ *   uint16 type (0)
+ *   int64  server time in microseconds since the UNIX epoch
+ *   uint32 ra (0x100000000 = 24h)
+ *   int32  dec (0x40000000 = 90 degrees)
+ *   int32  status (0 = ok)
+ */
+
+struct stellarium;
+struct point;
+typedef void (*stellarium_cb_f)(struct stellarium *st, void *arg);
+
+struct stellarium *stellarium_new (void);
+void stellarium_destroy (struct stellarium *st);
+
+/* The pointing model 'point' is shared with the caller and other protocols.
+ */
+int stellarium_init (struct stellarium *st, int port, struct point *point,
+                     int flags);
+
+/* Register callback that is triggered when the protocol needs
+ * a position update.  Callback should call stellarium_set_position().
+ */
+void stellarium_set_position_cb (struct stellarium *st,
+                                 stellarium_cb_f cb, void *arg);
+
+/* Register callback that is triggered when protocol wants to goto
+ * the target object.  Callback should call stellarium_get_target ()
+ * and then move to those coordinates.
+ */
+void stellarium_set_goto_cb (struct stellarium *st,
+                             stellarium_cb_f cb, void *arg);
+
+/* Set t,d position in degrees.
+ */
+void stellarium_set_position (struct stellarium *st, double t, double d);
+
+void stellarium_get_target (struct stellarium *st, double *t, double *d);
+
+void stellarium_start (struct ev_loop *loop, struct stellarium *st);
+void stellarium_stop (struct ev_loop *loop, struct stellarium *st);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
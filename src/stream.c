@@ -0,0 +1,501 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+/* Push-based position subscription protocol (see stream.h).
+ *
+ * A single timer runs at the period of the fastest subscriber.  Each tick
+ * triggers one position update callback, and the result is fanned out to
+ * every subscriber whose period has elapsed, so the serial cost is the same
+ * no matter how many clients are connected.
+ *
+ * Client sockets are non-blocking.  A frame that cannot be written because
+ * the client is not keeping up is dropped rather than stalling the daemon.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <ev.h>
+
+#include "log.h"
+#include "xzmalloc.h"
+
+#include "stream.h"
+
+#define LISTEN_BACKLOG 5
+#define MAX_CLIENTS 16
+
+static const double min_period = 0.02;  // 50 Hz
+static const double max_period = 60.;
+
+struct client {
+    int fd;
+    ev_io w;
+    uint8_t buf[STREAM_SUBSCRIBE_LENGTH];
+    int len;
+    struct stream *st;
+    int num;
+    double period;      // 0 = not subscribed
+    double next;        // time next frame is due
+    uint32_t seq;
+    uint32_t guide_gen; // generation of guide statistics last sent
+};
+
+struct stream {
+    int flags;
+    int fd;
+    stream_cb_f cb;
+    void *cb_arg;
+    ev_io listen_w;
+    ev_timer timer_w;
+    struct client clients[MAX_CLIENTS];
+    double t, d;        // axis angular position (degrees)
+    double t_v, d_v;    // axis angular velocity (degrees/sec)
+    double sample_time; // time t,d were read
+    bool sample_valid;  // previous sample exists for velocity
+    bool pos_set;       // callback set the position this period
+    int status;
+    struct stream_guide guide[2];
+    uint32_t guide_gen;
+    struct ev_loop *loop;
+};
+
+static void client_free (struct client *c);
+
+static void put_u16 (uint8_t *p, uint16_t val)
+{
+    p[0] = val & 0xff;
+    p[1] = (val >> 8) & 0xff;
+}
+
+static void put_u32 (uint8_t *p, uint32_t val)
+{
+    put_u16 (p, val & 0xffff);
+    put_u16 (p + 2, (val >> 16) & 0xffff);
+}
+
+static void put_u64 (uint8_t *p, uint64_t val)
+{
+    put_u32 (p, val & 0xffffffff);
+    put_u32 (p + 4, (val >> 32) & 0xffffffff);
+}
+
+static uint16_t get_u16 (const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32 (const uint8_t *p)
+{
+    return get_u16 (p) | ((uint32_t)get_u16 (p + 2) << 16);
+}
+
+static int32_t micro (double val)
+{
+    double u = val * 1E6;
+
+    if (u > INT32_MAX)
+        return INT32_MAX;
+    if (u < INT32_MIN)
+        return INT32_MIN;
+    return lrint (u);
+}
+
+/* Start, stop, or change the period of the frame timer to match the
+ * fastest subscriber.
+ */
+static void timer_update (struct stream *st)
+{
+    double period = 0.;
+    int i;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        struct client *c = &st->clients[i];
+        if (c->fd != -1 && c->period > 0.) {
+            if (period == 0. || c->period < period)
+                period = c->period;
+        }
+    }
+    if (period == 0.) {
+        if (ev_is_active (&st->timer_w)) {
+            ev_timer_stop (st->loop, &st->timer_w);
+            st->sample_valid = false;
+            if ((st->flags & STREAM_DEBUG))
+                msg ("stream: no subscribers");
+        }
+    }
+    else if (!ev_is_active (&st->timer_w) || st->timer_w.repeat != period) {
+        st->timer_w.repeat = period;
+        ev_timer_again (st->loop, &st->timer_w);
+        if ((st->flags & STREAM_DEBUG))
+            msg ("stream: frame period %.3fs", period);
+    }
+}
+
+static uint32_t milli (double val)
+{
+    double m = val * 1E3;
+
+    if (m > UINT32_MAX)
+        return UINT32_MAX;
+    if (m < 0)
+        return 0;
+    return lrint (m);
+}
+
+static int send_buf (struct client *c, const uint8_t *buf, int len)
+{
+    struct stream *st = c->st;
+    int n;
+
+    n = write (c->fd, buf, len);
+    if (n < 0) {
+        if (errno == EWOULDBLOCK || errno == EAGAIN) {
+            if ((st->flags & STREAM_DEBUG))
+                msg ("stream[%d]: dropped frame %u", c->num, c->seq - 1);
+            return 0;
+        }
+        return -1;
+    }
+    if (n < len) { // framing is lost, give up on this client
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static int send_guide_frame (struct client *c)
+{
+    struct stream *st = c->st;
+    uint8_t buf[STREAM_GUIDE_LENGTH];
+    int i;
+
+    put_u16 (&buf[0], STREAM_GUIDE_LENGTH);
+    put_u16 (&buf[2], STREAM_MSG_GUIDE);
+    put_u32 (&buf[4], c->seq++);
+    for (i = 0; i < 2; i++) {
+        struct stream_guide *g = &st->guide[i];
+        uint8_t *p = &buf[8 + 24 * i];
+
+        put_u32 (&p[0], g->count > UINT32_MAX ? UINT32_MAX : g->count);
+        put_u32 (&p[4], milli (g->duration));
+        put_u32 (&p[8], micro (g->net * 1E-3));
+        put_u32 (&p[12], milli (g->rms));
+        put_u32 (&p[16], milli (g->period));
+        put_u32 (&p[20], milli (g->amplitude));
+    }
+    return send_buf (c, buf, sizeof (buf));
+}
+
+static int send_frame (struct client *c)
+{
+    struct stream *st = c->st;
+    uint8_t buf[STREAM_POSITION_LENGTH];
+
+    put_u16 (&buf[0], STREAM_POSITION_LENGTH);
+    put_u16 (&buf[2], STREAM_MSG_POSITION);
+    put_u32 (&buf[4], c->seq++);
+    put_u64 (&buf[8], (uint64_t)llrint (st->sample_time * 1E6));
+    put_u32 (&buf[16], micro (st->t));
+    put_u32 (&buf[20], micro (st->d));
+    put_u32 (&buf[24], micro (st->t_v));
+    put_u32 (&buf[28], micro (st->d_v));
+    put_u32 (&buf[32], st->status);
+
+    if (send_buf (c, buf, sizeof (buf)) < 0)
+        return -1;
+    if (c->guide_gen != st->guide_gen) {
+        if (send_guide_frame (c) < 0)
+            return -1;
+        c->guide_gen = st->guide_gen;
+    }
+    return 0;
+}
+
+static void timer_cb (struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct stream *st = (struct stream *)((char *)w
+                        - offsetof (struct stream, timer_w));
+    double now = ev_now (loop);
+    double t = st->t, d = st->d, time = st->sample_time;
+    int i;
+
+    /* No frame is sent if the position could not be obtained.  The
+     * position may be cached, so velocity is only derived when the time
+     * it was read advances; otherwise the last velocity stands.
+     */
+    st->pos_set = false;
+    if (st->cb)
+        st->cb (st, st->cb_arg);
+    if (!st->pos_set)
+        return;
+    if (!st->sample_valid) {
+        st->t_v = st->d_v = 0.;
+        st->sample_valid = true;
+    }
+    else if (st->sample_time > time) {
+        st->t_v = (st->t - t) / (st->sample_time - time);
+        st->d_v = (st->d - d) / (st->sample_time - time);
+    }
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        struct client *c = &st->clients[i];
+        if (c->fd == -1 || c->period == 0.)
+            continue;
+        /* Allow half a timer period of slop so a subscriber at a multiple
+         * of the fastest period isn't pushed out by one tick.
+         */
+        if (c->next - w->repeat/2 > now)
+            continue;
+        if (send_frame (c) < 0) {
+            client_free (c);
+            continue;
+        }
+        c->next += c->period;
+        if (c->next < now)
+            c->next = now + c->period;
+    }
+}
+
+static void subscribe (struct client *c, uint32_t period_ms)
+{
+    double period = 1E-3 * period_ms;
+
+    if (period != 0.) {
+        if (period < min_period)
+            period = min_period;
+        if (period > max_period)
+            period = max_period;
+    }
+    if ((c->st->flags & STREAM_DEBUG))
+        msg ("stream[%d]: subscribe period=%.3fs", c->num, period);
+    c->period = period;
+    c->next = ev_now (c->st->loop);
+    timer_update (c->st);
+}
+
+static void client_cb (struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct client *c = (struct client *)((char *)w
+                        - offsetof (struct client, w));
+    int n;
+
+    n = read (c->fd, c->buf + c->len, sizeof (c->buf) - c->len);
+    if (n < 0) {
+        if (errno == EWOULDBLOCK || errno == EAGAIN)
+            goto out;
+        goto disconnect;
+    }
+    if (n == 0) // EOF
+        goto disconnect;
+    c->len += n;
+    if (c->len < sizeof (c->buf))
+        goto out;
+    c->len = 0;
+
+    if (get_u16 (&c->buf[0]) != STREAM_SUBSCRIBE_LENGTH
+                || get_u16 (&c->buf[2]) != STREAM_MSG_SUBSCRIBE) {
+        if ((c->st->flags & STREAM_DEBUG))
+            msg ("stream[%d]: protocol error", c->num);
+        goto disconnect;
+    }
+    subscribe (c, get_u32 (&c->buf[4]));
+out:
+    return;
+disconnect:
+    client_free (c);
+}
+
+static void client_free (struct client *c)
+{
+    if (c->fd != -1) {
+        close (c->fd);
+        c->fd = -1;
+        ev_io_stop (c->st->loop, &c->w);
+        if (c->period > 0.) {
+            c->period = 0.;
+            timer_update (c->st);
+        }
+    }
+}
+
+static struct client *client_alloc (struct stream *st, int fd)
+{
+    int i;
+    struct client *c;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (st->clients[i].fd == -1)
+            break;
+    }
+    if (i == MAX_CLIENTS)
+        return NULL; // no client slot
+    c = &st->clients[i];
+    c->fd = fd;
+    c->len = 0;
+    c->period = 0.;
+    c->seq = 0;
+    c->guide_gen = 0;
+    ev_io_init (&c->w, client_cb, c->fd, EV_READ);
+    ev_io_start (c->st->loop, &c->w);
+    return c;
+}
+
+/* Accept a connection and allocate client slot.
+ */
+static void listen_cb (struct ev_loop *loop, ev_io *w, int revents)
+{
+    struct stream *st = (struct stream *)((char *)w
+                        - offsetof (struct stream, listen_w));
+
+    if ((revents & EV_READ)) {
+        int cfd;
+        struct client *c;
+        if ((cfd = accept4 (st->fd, NULL, NULL,
+                            SOCK_CLOEXEC | SOCK_NONBLOCK)) < 0)
+            return;
+        if (!(c = client_alloc (st, cfd))) { // too many open connections
+            close (cfd);
+            return;
+        }
+    }
+}
+
+void stream_set_position (struct stream *st, double t, double d,
+                          double time)
+{
+    st->t = t;
+    st->d = d;
+    st->sample_time = time;
+    st->pos_set = true;
+}
+
+void stream_set_status (struct stream *st, int status)
+{
+    st->status = status;
+}
+
+void stream_set_guide (struct stream *st, const struct stream_guide g[2])
+{
+    st->guide[0] = g[0];
+    st->guide[1] = g[1];
+    st->guide_gen++;
+}
+
+int stream_init (struct stream *st, int port, stream_cb_f cb, void *arg,
+                 int flags)
+{
+    struct sockaddr_in addr;
+
+    st->cb = cb;
+    st->cb_arg = arg;
+    st->flags = flags;
+
+    st->fd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (st->fd < 0)
+        return -1;
+    memset (&addr, 0, sizeof (struct sockaddr_in));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons (port);
+    if (bind (st->fd, (struct sockaddr *)&addr, sizeof (addr)) < 0)
+        return -1;
+    if (listen (st->fd, LISTEN_BACKLOG) < 0)
+        return -1;
+
+    ev_io_init (&st->listen_w, listen_cb, st->fd, EV_READ);
+    ev_timer_init (&st->timer_w, timer_cb, 0., 0.);
+
+    if ((st->flags & STREAM_DEBUG))
+        msg ("listening on port %d", port);
+
+    return 0;
+}
+
+void stream_start (struct ev_loop *loop, struct stream *st)
+{
+    int i;
+
+    st->loop = loop;
+    ev_io_start (loop, &st->listen_w);
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (st->clients[i].fd != -1)
+            ev_io_start (loop, &st->clients[i].w);
+    }
+    timer_update (st);
+}
+
+void stream_stop (struct ev_loop *loop, struct stream *st)
+{
+    int i;
+
+    ev_io_stop (loop, &st->listen_w);
+    ev_timer_stop (loop, &st->timer_w);
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (st->clients[i].fd != -1)
+            ev_io_stop (loop, &st->clients[i].w);
+    }
+}
+
+struct stream *stream_new (void)
+{
+    struct stream *st = xzmalloc (sizeof (*st));
+    int i;
+
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        st->clients[i].fd = -1;
+        st->clients[i].st = st;
+        st->clients[i].num = i;
+    }
+    st->fd = -1;
+
+    return st;
+}
+
+void stream_destroy (struct stream *st)
+{
+    int i;
+
+    if (st) {
+        for (i = 0; i < MAX_CLIENTS; i++)
+            client_free (&st->clients[i]);
+        if (st->fd != -1)
+            close (st->fd);
+        free (st);
+    }
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
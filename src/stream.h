@@ -0,0 +1,105 @@
+#include <ev.h>
+#include <stdint.h>
+
+#define DEFAULT_STREAM_PORT  4032
+
+enum {
+    STREAM_DEBUG = 1,
+};
+
+/* Bits for stream_set_status().
+ */
+enum {
+    STREAM_STATUS_TRACKING  = 0x01, // RA axis tracking
+    STREAM_STATUS_SLEWING   = 0x02, // slew "button" is pressed
+    STREAM_STATUS_GOTO      = 0x04, // goto in progress
+};
+
+/* Position subscription protocol.
+ * Clients subscribe once and receive position frames at the requested
+ * rate until they unsubscribe or disconnect.  All integers are little endian.
+ *
+ * Subscribe (client to server, 8 bytes):
+ *   uint16 length (8)
+ *   uint16 type (STREAM_MSG_SUBSCRIBE)
+ *   uint32 period in milliseconds, 0 to unsubscribe
+ *
+ * Position (server to client, 36 bytes):
+ *   uint16 length (36)
+ *   uint16 type (STREAM_MSG_POSITION)
+ *   uint32 sequence number (per client)
+ *   int64  time in microseconds since the UNIX epoch
+ *   int32  t axis position in microdegrees
+ *   int32  d axis position in microdegrees
+ *   int32  t axis velocity in microdegrees/sec
+ *   int32  d axis velocity in microdegrees/sec
+ *   uint32 status bits (STREAM_STATUS_*)
+ *
+ * Guide statistics (server to client, 56 bytes), sent after a position
+ * frame when guide pulses have completed since the last one:
+ *   uint16 length (56)
+ *   uint16 type (STREAM_MSG_GUIDE)
+ *   uint32 sequence number (per client, shared with position frames)
+ *   then for the t axis and the d axis:
+ *     uint32 pulse count
+ *     uint32 total pulse duration in milliseconds
+ *     int32  net correction in milliarcseconds
+ *     uint32 RMS correction per pulse in milliarcseconds
+ *     uint32 dominant period of the correction in milliseconds
+ *     uint32 amplitude of that period in milliarcseconds
+ */
+enum {
+    STREAM_MSG_SUBSCRIBE = 1,
+    STREAM_MSG_POSITION = 2,
+    STREAM_MSG_GUIDE = 3,
+};
+
+#define STREAM_SUBSCRIBE_LENGTH     8
+#define STREAM_POSITION_LENGTH      36
+#define STREAM_GUIDE_LENGTH         56
+
+/* Guide statistics for one axis (see guidestat.h).
+ */
+struct stream_guide {
+    unsigned long count;
+    double duration;        // sec
+    double net;             // arcsec
+    double rms;             // arcsec
+    double period;          // sec
+    double amplitude;       // arcsec
+};
+
+struct stream;
+typedef void (*stream_cb_f)(struct stream *st, void *arg);
+
+struct stream *stream_new (void);
+void stream_destroy (struct stream *st);
+
+/* Callback is triggered once per frame period (shared by all subscribers)
+ * when a position update is needed.  Callback should call
+ * stream_set_position() and stream_set_status().  If it does not set
+ * the position, no frame is sent that period.
+ */
+int stream_init (struct stream *st, int port, stream_cb_f cb, void *arg,
+                 int flags);
+
+/* Set t,d position in degrees, read at 'time' (ev_now() timebase).
+ * The frame carries that time.  Velocity is derived from successive
+ * positions read at different times.
+ */
+void stream_set_position (struct stream *st, double t, double d,
+                          double time);
+
+void stream_set_status (struct stream *st, int status);
+
+/* Set t,d guide statistics, to be sent to subscribers with their
+ * next position frame.
+ */
+void stream_set_guide (struct stream *st, const struct stream_guide g[2]);
+
+void stream_start (struct ev_loop *loop, struct stream *st);
+void stream_stop (struct ev_loop *loop, struct stream *st);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
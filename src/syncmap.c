@@ -0,0 +1,314 @@
+/*****************************************************************************\
+ *  Copyright (C) 2017 Jim Garlick
+ *  Written by Jim Garlick <garlick.jim@gmail.com>
+ *  All Rights Reserved.
+ *
+ *  This file is part of gem-controld
+ *  For details, see <https://github.com/garlick/gem-controld>
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the license, or (at your option)
+ *  any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the IMPLIED WARRANTY OF MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the terms and conditions of the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+ *  See also:  http://www.gnu.org/licenses/
+\*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "model.h"
+#include "syncmap.h"
+
+#define BAND_DEGREES    5       // declination band height
+#define NBANDS          (180 / BAND_DEGREES)
+#define MAX_NEIGHBORS   6
+
+static const double radius = 20.;       // influence of a sync (degrees)
+static const double min_cos_dec = 1E-2; // limit sec(dec) near the pole
+
+struct sync {
+    double t, d;        // uncorrected axis position (degrees)
+    double h, dec;      // observed sky position (degrees)
+    double v[3];        // unit vector of (h,dec)
+    double rh, rd;      // residual against model, HA on the sky (degrees)
+    int next;           // next sync in the same grid cell, -1 = end
+};
+
+struct syncmap {
+    struct sync *syncs;
+    int count;
+    int alloc;
+    int band_cells[NBANDS]; // number of HA cells in each band
+    int band_first[NBANDS]; // index of band's first cell in 'cell'
+    int *cell;              // first sync in each cell, -1 = empty
+    int ncells;
+};
+
+static double rad (double deg)
+{
+    return deg * M_PI / 180.;
+}
+
+static void to_vec (double h, double dec, double v[3])
+{
+    v[0] = cos (rad (dec)) * cos (rad (h));
+    v[1] = cos (rad (dec)) * sin (rad (h));
+    v[2] = sin (rad (dec));
+}
+
+static double sec_dec (double dec)
+{
+    double c = cos (rad (dec));
+
+    if (fabs (c) < min_cos_dec)
+        c = c < 0 ? -min_cos_dec : min_cos_dec;
+    return 1. / c;
+}
+
+static double wrap180 (double deg)
+{
+    deg = fmod (deg, 360.);
+    if (deg > 180.)
+        deg -= 360.;
+    else if (deg < -180.)
+        deg += 360.;
+    return deg;
+}
+
+static int band_index (double dec)
+{
+    int b = (int)floor ((dec + 90.) / BAND_DEGREES);
+
+    return b < 0 ? 0 : b >= NBANDS ? NBANDS - 1 : b;
+}
+
+static int cell_index (struct syncmap *sm, int band, double h)
+{
+    double a = fmod (h, 360.);
+    int c;
+
+    if (a < 0.)
+        a += 360.;
+    c = (int)(a / 360. * sm->band_cells[band]);
+    return sm->band_first[band] + (c % sm->band_cells[band]);
+}
+
+/* Cells are roughly square: the number per band scales with cos(dec).
+ */
+static int grid_init (struct syncmap *sm)
+{
+    int b, n = 0;
+
+    for (b = 0; b < NBANDS; b++) {
+        double mid = -90. + (b + 0.5) * BAND_DEGREES;
+        int cells = (int)lrint (360. / BAND_DEGREES * cos (rad (mid)));
+        sm->band_cells[b] = cells < 1 ? 1 : cells;
+        sm->band_first[b] = n;
+        n += sm->band_cells[b];
+    }
+    if (!(sm->cell = malloc (n * sizeof (sm->cell[0]))))
+        return -1;
+    sm->ncells = n;
+    return 0;
+}
+
+static void grid_insert (struct syncmap *sm, int i)
+{
+    struct sync *s = &sm->syncs[i];
+    int c = cell_index (sm, band_index (s->dec), s->h);
+
+    s->next = sm->cell[c];
+    sm->cell[c] = i;
+}
+
+int syncmap_add (struct syncmap *sm, double t, double d, double h, double dec)
+{
+    struct sync *s;
+
+    if (sm->count == sm->alloc) {
+        int n = sm->alloc ? sm->alloc * 2 : 32;
+        struct sync *new = realloc (sm->syncs, n * sizeof (*new));
+        if (!new)
+            return -1;
+        sm->syncs = new;
+        sm->alloc = n;
+    }
+    s = &sm->syncs[sm->count];
+    s->t = t;
+    s->d = d;
+    s->h = h;
+    s->dec = dec;
+    s->rh = s->rd = 0.;
+    to_vec (h, dec, s->v);
+    grid_insert (sm, sm->count++);
+    return 0;
+}
+
+void syncmap_update (struct syncmap *sm, struct model *model)
+{
+    int i;
+
+    for (i = 0; i < sm->count; i++) {
+        struct sync *s = &sm->syncs[i];
+        double h, dec;
+
+        model_raw_to_sky (model, s->t, s->d, &h, &dec);
+        s->rh = wrap180 (s->h - h) * cos (rad (s->dec));
+        s->rd = s->dec - dec;
+    }
+}
+
+/* Modified Shepard weight, which falls smoothly to zero at 'radius'.
+ */
+static double weight (double dist)
+{
+    double w = (radius - dist) / (radius * dist);
+
+    return w * w;
+}
+
+void syncmap_get_correction (struct syncmap *sm, double h, double dec,
+                             double *dh, double *dd)
+{
+    double v[3];
+    double cos_radius = cos (rad (radius));
+    int near[MAX_NEIGHBORS];
+    double near_dot[MAX_NEIGHBORS];
+    int nnear = 0;
+    double sum_w, sum_h, sum_d;
+    int b, i, k;
+
+    *dh = *dd = 0.;
+    if (sm->count == 0)
+        return;
+    to_vec (h, dec, v);
+
+    /* Visit cells overlapping the search cap, keeping the nearest syncs.
+     */
+    for (b = band_index (dec - radius); b <= band_index (dec + radius); b++) {
+        double edge = fmax (fabs (-90. + b * BAND_DEGREES),
+                            fabs (-90. + (b + 1) * BAND_DEGREES));
+        double x = sin (rad (radius)) * sec_dec (edge);
+        double span = x >= 1. ? 360. : asin (x) * 180. / M_PI;
+        int ncells = sm->band_cells[b];
+        int first, last, c;
+
+        if (span >= 180. || ncells == 1) {
+            first = 0;
+            last = ncells - 1;
+        }
+        else {
+            first = (int)floor ((h - span) / 360. * ncells);
+            last = (int)floor ((h + span) / 360. * ncells);
+            if (last - first >= ncells)
+                last = first + ncells - 1;
+        }
+        for (c = first; c <= last; c++) {
+            int cell = sm->band_first[b] + ((c % ncells) + ncells) % ncells;
+            for (i = sm->cell[cell]; i != -1; i = sm->syncs[i].next) {
+                const double *sv = sm->syncs[i].v;
+                double dot = v[0]*sv[0] + v[1]*sv[1] + v[2]*sv[2];
+                if (dot <= cos_radius)
+                    continue;
+                if (nnear == MAX_NEIGHBORS && dot <= near_dot[nnear - 1])
+                    continue;
+                if (nnear < MAX_NEIGHBORS)
+                    nnear++;
+                for (k = nnear - 1; k > 0 && near_dot[k - 1] < dot; k--) {
+                    near[k] = near[k - 1];
+                    near_dot[k] = near_dot[k - 1];
+                }
+                near[k] = i;
+                near_dot[k] = dot;
+            }
+        }
+    }
+    if (nnear == 0)
+        return;
+
+    /* The 1/radius^2 term in the denominator is the weight of a sync at
+     * half the radius, so a lone distant sync contributes only partially
+     * and the correction blends smoothly into the model alone.
+     */
+    sum_w = 1. / (radius * radius);
+    sum_h = sum_d = 0.;
+    for (k = 0; k < nnear; k++) {
+        struct sync *s = &sm->syncs[near[k]];
+        double dist = acos (fmin (near_dot[k], 1.)) * 180. / M_PI;
+        double w;
+        if (dist < 1E-6) { // coincident with a sync
+            *dh = s->rh * sec_dec (dec);
+            *dd = s->rd;
+            return;
+        }
+        w = weight (dist);
+        sum_w += w;
+        sum_h += w * s->rh;
+        sum_d += w * s->rd;
+    }
+    *dh = sum_h / sum_w * sec_dec (dec);
+    *dd = sum_d / sum_w;
+}
+
+void syncmap_clear (struct syncmap *sm)
+{
+    int i;
+
+    for (i = 0; i < sm->ncells; i++)
+        sm->cell[i] = -1;
+    sm->count = 0;
+}
+
+int syncmap_get_count (struct syncmap *sm)
+{
+    return sm->count;
+}
+
+int syncmap_get_sync (struct syncmap *sm, int i, double *t, double *d,
+                      double *h, double *dec)
+{
+    if (i < 0 || i >= sm->count)
+        return -1;
+    *t = sm->syncs[i].t;
+    *d = sm->syncs[i].d;
+    *h = sm->syncs[i].h;
+    *dec = sm->syncs[i].dec;
+    return 0;
+}
+
+struct syncmap *syncmap_new (void)
+{
+    struct syncmap *sm = calloc (1, sizeof (*sm));
+
+    if (!sm)
+        return NULL;
+    if (grid_init (sm) < 0) {
+        free (sm);
+        return NULL;
+    }
+    syncmap_clear (sm);
+    return sm;
+}
+
+void syncmap_destroy (struct syncmap *sm)
+{
+    if (sm) {
+        free (sm->cell);
+        free (sm->syncs);
+        free (sm);
+    }
+}
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
@@ -0,0 +1,48 @@
+/* Sync point correction map
+ *
+ * Non-parametric complement to the pointing model (model.h).  Each sync is
+ * stored with its uncorrected axis position and observed (ha,dec).  Its
+ * residual against the current model is interpolated to nearby positions
+ * by inverse distance weighting, which captures local effects such as
+ * flexure that the model terms cannot.  The correction fades to zero
+ * beyond a fixed radius of the nearest syncs.
+ *
+ * Syncs are indexed by an equal-area sky grid (declination bands divided
+ * into hour angle cells), so a query only examines syncs in nearby cells
+ * and the cost of a position poll does not grow with the number of syncs.
+ */
+
+struct syncmap;
+struct model;
+
+struct syncmap *syncmap_new (void);
+void syncmap_destroy (struct syncmap *sm);
+
+/* Add a sync: axis position (t,d) was observed to be at sky (h,dec).
+ * Returns 0 on success, -1 on allocation failure.
+ */
+int syncmap_add (struct syncmap *sm, double t, double d, double h, double dec);
+
+/* Recompute residuals of all syncs against 'model'.
+ * Call after syncmap_add() and after the model is refitted.
+ */
+void syncmap_update (struct syncmap *sm, struct model *model);
+
+/* Get interpolated correction (dh,dd) in degrees to be added to the model's
+ * sky position (h,dec).  Zero if there are no syncs nearby.
+ */
+void syncmap_get_correction (struct syncmap *sm, double h, double dec,
+                             double *dh, double *dd);
+
+void syncmap_clear (struct syncmap *sm);
+int syncmap_get_count (struct syncmap *sm);
+
+/* Get sync 'i' (0 to count - 1) as passed to syncmap_add().
+ * Returns 0 on success, -1 if 'i' is out of range.
+ */
+int syncmap_get_sync (struct syncmap *sm, int i, double *t, double *d,
+                      double *h, double *dec);
+
+/*
+ * vi:tabstop=4 shiftwidth=4 expandtab
+ */
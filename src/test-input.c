@@ -31,8 +31,7 @@
 #include "log.h"
 #include "xzmalloc.h"
 #include "configfile.h"
-#include "hpad.h"
-#include "guide.h"
+#include "input.h"
 
 #define OPTIONS "+c:h"
 static const struct option longopts[] = {
@@ -41,8 +40,7 @@ static const struct option longopts[] = {
     {0, 0, 0, 0},
 };
 
-void hpad_cb (struct hpad *h, void *arg);
-void guide_cb (struct guide *g, void *arg);
+void input_cb (struct input *in, void *arg);
 
 static void usage (void)
 {
@@ -58,8 +56,7 @@ int main (int argc, char *argv[])
     int ch;
     char *config_filename = NULL;
     struct config cfg;
-    struct hpad *hpad;
-    struct guide *guide;
+    struct input *input;
     char *prog;
     struct ev_loop *loop;
 
@@ -89,48 +86,32 @@ int main (int argc, char *argv[])
     if (!(loop = ev_loop_new (EVFLAG_AUTO)))
         err_exit ("ev_loop_new");
 
-    hpad = hpad_new ();
-    if (hpad_init (hpad, cfg.hpad_gpio, cfg.hpad_debounce,
-                   hpad_cb, NULL, HPAD_DEBUG) < 0)
-        err_exit ("hpad_init");
-    hpad_start (loop, hpad);
+    input = input_new ();
+    if (input_add_group (input, "hpad", cfg.hpad_gpio, false,
+                         cfg.hpad_debounce, input_map_hpad, INPUT_DEBUG) < 0)
+        err_exit ("hpad: %s", cfg.hpad_gpio);
     msg ("hpad configured");
-
-    guide = guide_new ();
-    if (guide_init (guide, cfg.guide_gpio, cfg.guide_debounce,
-                    guide_cb, NULL, GUIDE_DEBUG) < 0)
-        err_exit ("guide_init");
-    guide_start (loop, guide);
+    if (input_add_group (input, "guide", cfg.guide_gpio, true,
+                         cfg.guide_debounce, input_map_guide, INPUT_DEBUG) < 0)
+        err_exit ("guide: %s", cfg.guide_gpio);
     msg ("guide configured");
+    input_set_cb (input, input_cb, NULL);
+    input_start (loop, input);
 
     ev_run (loop, 0);
 
     ev_loop_destroy (loop);
 
-    guide_stop (loop, guide);
-    guide_destroy (guide);
-
-    hpad_stop (loop, hpad);
-    hpad_destroy (hpad);
+    input_stop (loop, input);
+    input_destroy (input);
 
     return 0;
 }
 
-void hpad_cb (struct hpad *h, void *arg)
+void input_cb (struct input *in, void *arg)
 {
-    hpad_get_slew_direction (h);
-    hpad_get_slew_rate (h);
-    hpad_get_control (h);
-}
-
-void guide_cb (struct guide *g, void *arg)
-{
-    int val;
-
-    if ((val = guide_get_slew_direction (g)) < 0) {
-        err ("guide");
-        return;
-    }
+    msg ("events 0x%x (changed 0x%x)", input_get_events (in),
+         input_get_changed (in));
 }
 
 /*
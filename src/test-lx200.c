@@ -32,6 +32,7 @@
 #include "xzmalloc.h"
 #include "configfile.h"
 #include "lx200.h"
+#include "point.h"
 
 struct test_state {
     double t;       // ha position in degrees
@@ -67,6 +68,7 @@ int main (int argc, char *argv[])
     char *config_filename = NULL;
     struct config cfg;
     struct lx200 *lx;
+    struct point *point;
     char *prog;
     struct ev_loop *loop;
     struct test_state ctx;
@@ -94,9 +96,13 @@ int main (int argc, char *argv[])
     if (!(loop = ev_loop_new (EVFLAG_AUTO)))
         err_exit ("ev_loop_new");
 
+    if (!(point = point_new ()))
+        err_exit ("point_new");
+    point_set_flags (point, POINT_DEBUG);
+
     lx = lx200_new ();
-    if (lx200_init (lx, DEFAULT_LX200_PORT, LX200_DEBUG) < 0)
-        err_exit ("hpad_init");
+    if (lx200_init (lx, DEFAULT_LX200_PORT, point, LX200_DEBUG) < 0)
+        err_exit ("lx200_init");
     lx200_set_position_ha_cb (lx, lx200_pos_ha_cb, &ctx);
     lx200_set_position_dec_cb (lx, lx200_pos_dec_cb, &ctx);
     lx200_set_slew_cb (lx, lx200_slew_cb, &ctx);
@@ -112,6 +118,7 @@ int main (int argc, char *argv[])
 
     lx200_stop (loop, lx);
     lx200_destroy (lx);
+    point_destroy (point);
 
     return 0;
 }